@@ -0,0 +1,1076 @@
+/*
+ * Micro benchmarks for leptjson.
+ *
+ * build: make leptjson_bench, or cc -O2 -pthread -o bench bench.c leptjson.c
+ * run:   make bench, or ./bench
+ *        make bench-suite REPEAT=10 LABEL=-, or ./bench suite [repetitions [label]] > results.csv
+ */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "leptjson.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+static double bench_now(){
+    LARGE_INTEGER f, t;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / (double)f.QuadPart;
+}
+#else
+static double bench_now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+#endif
+
+/* xorshift64, fixed seed so every run measures the same data */
+static unsigned long long bench_seed = 88172645463325252ULL;
+
+static unsigned long long bench_rand(){
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 7;
+    bench_seed ^= bench_seed << 17;
+    return bench_seed;
+}
+
+#define BENCH_NUMBERS 1000000
+#define BENCH_REPEAT 5
+
+static double bench_number(int kind){
+    switch(kind){
+        case 0: return (double)(bench_rand() % 1000000000);                 /* integers */
+        case 1: return (double)(bench_rand() % 10000000) / 100.0;           /* prices, 2 decimals */
+        case 2: return (double)(bench_rand() % 1000000) * 1e-9;             /* small measurements */
+        default:{                                                           /* any finite double */
+            unsigned long long bits;
+            double d;
+            do{
+                bits = bench_rand();
+                memcpy(&d, &bits, sizeof(d));
+            }while(d != d || d - d != 0.0);
+            return d;
+        }
+    }
+}
+
+//number formatting
+static void bench_stringify_number(){
+    static const char* names[] = { "integer", "2-decimal", "small", "random-bits" };
+    int kind, r;
+    size_t i, length = 0, sprintf_length = 0;
+    char buf[32];
+    printf("# number formatting: %d numbers x %d runs, numbers per second\n", BENCH_NUMBERS, BENCH_REPEAT);
+    printf("%-12s %16s %16s %10s %14s %14s\n", "kind", "lept_stringify", "sprintf %.17g", "speedup", "bytes", "sprintf bytes");
+    for(kind = 0; kind < 4; kind++){
+        lept_value v;
+        double t, t_lept, t_sprintf;
+        lept_init(&v);
+        lept_set_array(&v, BENCH_NUMBERS);
+        for(i = 0; i < BENCH_NUMBERS; i++)
+            lept_set_number(lept_pushback_array_element(&v), bench_number(kind));
+
+        t = bench_now();
+        for(r = 0; r < BENCH_REPEAT; r++)
+            free(lept_stringify(&v, &length));
+        t_lept = bench_now() - t;
+
+        /* the old LEPT_NUMBER path: one "%.17g" per number */
+        t = bench_now();
+        for(r = 0; r < BENCH_REPEAT; r++){
+            sprintf_length = 0;
+            for(i = 0; i < BENCH_NUMBERS; i++)
+                sprintf_length += sprintf(buf, "%.17g", lept_get_number(lept_get_array_element(&v, i))) + 1;
+        }
+        t_sprintf = bench_now() - t;
+
+        printf("%-12s %16.0f %16.0f %9.2fx %14lu %14lu\n", names[kind],
+            BENCH_NUMBERS * BENCH_REPEAT / t_lept, BENCH_NUMBERS * BENCH_REPEAT / t_sprintf,
+            t_sprintf / t_lept, (unsigned long)length, (unsigned long)sprintf_length + 1);
+        lept_free(&v);
+    }
+}
+
+//object lookup
+#define BENCH_LOOKUPS 2000000
+
+/* the plain memcmp scan lept_find_object_index() did before objects were indexed */
+static size_t bench_linear_find(const lept_value* v, const char* key, size_t klen){
+    size_t i, n = lept_get_object_size(v);
+    for(i = 0; i < n; i++)
+        if(lept_get_object_key_length(v, i) == klen && memcmp(lept_get_object_key(v, i), key, klen) == 0)
+            return i;
+    return LEPT_KEY_NOT_EXIST;
+}
+
+static void bench_object_lookup(){
+    static const size_t sizes[] = { 4, 16, 64, 256, 1024, 4096, 16384, 65536 };
+    size_t s, i, found;
+    printf("\n# object key lookup: %d hits per size, nanoseconds per lookup\n", BENCH_LOOKUPS);
+    printf("%-8s %16s %16s\n", "members", "indexed", "linear scan");
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+        size_t n = sizes[s], lookups = BENCH_LOOKUPS, linear_lookups;
+        char (*keys)[16] = (char (*)[16])malloc(n * sizeof(keys[0]));
+        size_t* klens = (size_t*)malloc(n * sizeof(size_t));
+        size_t* order = (size_t*)malloc(lookups * sizeof(size_t));
+        lept_value o;
+        double t, t_index, t_linear;
+        lept_init(&o);
+        lept_set_object(&o, 0);
+        for(i = 0; i < n; i++){
+            klens[i] = sprintf(keys[i], "field_%lu", (unsigned long)i);
+            lept_set_number(lept_set_object_value(&o, keys[i], klens[i]), (double)i);
+        }
+        for(i = 0; i < lookups; i++)
+            order[i] = (size_t)(bench_rand() % n);
+
+        found = 0;
+        t = bench_now();
+        for(i = 0; i < lookups; i++)
+            found += lept_find_object_index(&o, keys[order[i]], klens[order[i]]) == order[i];
+        t_index = bench_now() - t;
+
+        /* the scan is quadratic over the whole run, so it gets fewer lookups on big objects */
+        linear_lookups = n > 256 ? lookups / (n / 256) : lookups;
+        t = bench_now();
+        for(i = 0; i < linear_lookups; i++)
+            found += bench_linear_find(&o, keys[order[i]], klens[order[i]]) == order[i];
+        t_linear = bench_now() - t;
+
+        if(found != lookups + linear_lookups)
+            printf("lookup mismatch\n");
+        printf("%-8lu %16.1f %16.1f\n", (unsigned long)n, t_index * 1e9 / lookups, t_linear * 1e9 / linear_lookups);
+        lept_free(&o);
+        free(order);
+        free(klens);
+        free(keys);
+    }
+}
+
+//record arrays
+#define BENCH_RECORDS 200000
+
+static void bench_parse_records(){
+    size_t i, len = 0, size = BENCH_RECORDS * 80;
+    char* json = (char*)malloc(size);
+    lept_intern_table keys;
+    lept_value v;
+    double t, t_plain, t_interned;
+    int r;
+    json[len++] = '[';
+    for(i = 0; i < BENCH_RECORDS; i++)
+        len += sprintf(json + len, "%s{\"id\":%lu,\"ts\":%lu,\"host\":\"web-%02d\"}", i ? "," : "",
+            (unsigned long)i, 1700000000UL + (unsigned long)i, (int)(bench_rand() % 64));
+    json[len++] = ']';
+    json[len] = '\0';
+
+    t = bench_now();
+    for(r = 0; r < BENCH_REPEAT; r++){
+        lept_init(&v);
+        lept_parse(&v, json);
+        lept_free(&v);
+    }
+    t_plain = (bench_now() - t) / BENCH_REPEAT;
+
+    lept_intern_init(&keys);
+    t = bench_now();
+    for(r = 0; r < BENCH_REPEAT; r++){
+        lept_init(&v);
+        lept_parse_interned(&v, json, &keys);
+        lept_free(&v);
+    }
+    t_interned = (bench_now() - t) / BENCH_REPEAT;
+
+    printf("\n# %d records {\"id\",\"ts\",\"host\"}, %lu bytes, milliseconds per parse + free\n", BENCH_RECORDS, (unsigned long)len);
+    printf("%-12s %10.2f %12lu key mallocs\n", "lept_parse", t_plain * 1e3, (unsigned long)BENCH_RECORDS * 3);
+    printf("%-12s %10.2f %12lu distinct keys\n", "interned", t_interned * 1e3, (unsigned long)keys.count);
+    lept_intern_free(&keys);
+    free(json);
+}
+
+//node memory
+/*
+ * Heap bytes a parsed tree asks malloc for, without malloc's own overhead:
+ * the root, element and member arrays, keys and the strings too long for the
+ * value itself. None of the benchmark's objects is big enough for a key index.
+ */
+static size_t bench_tree_bytes(const lept_value* v, size_t* values, size_t* allocs){
+    size_t i, bytes = 0;
+    ++*values;
+    switch(lept_get_type(v)){
+        case LEPT_STRING:
+            if(lept_get_string_length(v) > LEPT_SHORT_STRING_MAX){
+                bytes += lept_get_string_length(v) + 1;
+                ++*allocs;
+            }
+            break;
+        case LEPT_ARRAY:
+            bytes += lept_get_array_capacity(v) * sizeof(lept_value);
+            *allocs += lept_get_array_capacity(v) > 0;
+            for(i = 0; i < lept_get_array_size(v); i++)
+                bytes += bench_tree_bytes(lept_get_array_element(v, i), values, allocs);
+            break;
+        case LEPT_OBJECT:
+            bytes += lept_get_object_capacity(v) * sizeof(lept_member);
+            *allocs += lept_get_object_capacity(v) > 0;
+            for(i = 0; i < lept_get_object_size(v); i++){
+                bytes += lept_get_object_key_length(v, i) + 1;
+                ++*allocs;
+                bytes += bench_tree_bytes(lept_get_object_value(v, i), values, allocs);
+            }
+            break;
+        default:
+            break;
+    }
+    return bytes;
+}
+
+static char* bench_records_json(size_t n, size_t* length){
+    size_t i, len = 0;
+    char* json = (char*)malloc(n * 200 + 2);
+    json[len++] = '[';
+    for(i = 0; i < n; i++)
+        len += sprintf(json + len, "%s{\"id\":%lu,\"host\":\"web-%02d\",\"path\":\"/api/v1/items/%lu/details\","
+            "\"status\":%d,\"latency\":%d.%02d,\"tags\":[\"edge\",\"cache-%s\"],\"error\":null}", i ? "," : "",
+            (unsigned long)i, (int)(bench_rand() % 64), (unsigned long)(bench_rand() % 100000),
+            bench_rand() % 10 ? 200 : 404, (int)(bench_rand() % 100), (int)(bench_rand() % 100),
+            bench_rand() % 2 ? "hit" : "miss");
+    json[len++] = ']';
+    json[len] = '\0';
+    *length = len;
+    return json;
+}
+
+static char* bench_matrix_json(size_t rows, size_t* length){
+    size_t i, j, len = 0;
+    char* json = (char*)malloc(rows * 16 * 24 + 2);
+    json[len++] = '[';
+    for(i = 0; i < rows; i++){
+        json[len++] = i ? ',' : ' ';
+        json[len++] = '[';
+        for(j = 0; j < 16; j++)
+            len += sprintf(json + len, "%s%.6g", j ? "," : "", bench_number(3 - (int)(j % 2) * 2));
+        json[len++] = ']';
+    }
+    json[len++] = ']';
+    json[len] = '\0';
+    *length = len;
+    return json;
+}
+
+static void bench_node_memory(){
+    static const char* names[] = { "records", "matrix" };
+    int doc;
+    printf("\n# tree vs compact nodes: heap bytes per value (keys count as values in the compact form), milliseconds per parse + free\n");
+    printf("%-8s %10s %10s %12s %10s %10s %12s %10s %10s\n", "document", "bytes", "values",
+        "tree B/val", "allocs", "tree ms", "compact B/val", "nodes", "compact ms");
+    for(doc = 0; doc < 2; doc++){
+        size_t len, values = 0, allocs = 0, tree_bytes, compact_bytes;
+        char* json = doc == 0 ? bench_records_json(BENCH_RECORDS, &len) : bench_matrix_json(BENCH_RECORDS / 2, &len);
+        lept_value v;
+        lept_compact d;
+        double t, t_tree, t_compact;
+        int r;
+
+        lept_init(&v);
+        lept_parse(&v, json);
+        tree_bytes = sizeof(lept_value) + bench_tree_bytes(&v, &values, &allocs);
+        lept_free(&v);
+        lept_compact_parse(&d, json);
+        compact_bytes = d.size * sizeof(lept_compact_node) + d.strings_size;
+
+        t = bench_now();
+        for(r = 0; r < BENCH_REPEAT; r++){
+            lept_init(&v);
+            lept_parse(&v, json);
+            lept_free(&v);
+        }
+        t_tree = (bench_now() - t) / BENCH_REPEAT;
+        t = bench_now();
+        for(r = 0; r < BENCH_REPEAT; r++){
+            lept_compact_free(&d);
+            lept_compact_parse(&d, json);
+        }
+        t_compact = (bench_now() - t) / BENCH_REPEAT;
+
+        printf("%-8s %10lu %10lu %12.1f %10lu %10.2f %12.1f %10lu %10.2f\n", names[doc], (unsigned long)len,
+            (unsigned long)values, (double)tree_bytes / values, (unsigned long)allocs, t_tree * 1e3,
+            (double)compact_bytes / values, (unsigned long)d.size, t_compact * 1e3);
+        lept_compact_free(&d);
+        free(json);
+    }
+}
+
+//stringify into a caller buffer
+static void bench_stringify_into(){
+    size_t len, length = 0, size = 0;
+    char* json = bench_records_json(BENCH_RECORDS, &len), *buf;
+    lept_value v;
+    double t, t_stringify, t_size, t_into;
+    int r;
+    lept_init(&v);
+    lept_parse(&v, json);
+
+    t = bench_now();
+    for(r = 0; r < BENCH_REPEAT; r++)
+        free(lept_stringify(&v, &length));
+    t_stringify = (bench_now() - t) / BENCH_REPEAT;
+
+    t = bench_now();
+    for(r = 0; r < BENCH_REPEAT; r++)
+        size = lept_stringify_size(&v);
+    t_size = (bench_now() - t) / BENCH_REPEAT;
+
+    buf = (char*)malloc(size);
+    t = bench_now();
+    for(r = 0; r < BENCH_REPEAT; r++)
+        if(lept_stringify_into(&v, buf, size) != length)
+            printf("length mismatch\n");
+    t_into = (bench_now() - t) / BENCH_REPEAT;
+
+    printf("\n# stringify %d records, %lu bytes, milliseconds\n", BENCH_RECORDS, (unsigned long)length);
+    printf("%-26s %10.2f\n", "lept_stringify", t_stringify * 1e3);
+    printf("%-26s %10.2f\n", "lept_stringify_size", t_size * 1e3);
+    printf("%-26s %10.2f\n", "lept_stringify_into", t_into * 1e3);
+    printf("%-26s %10.2f\n", "size + into", (t_size + t_into) * 1e3);
+    free(buf);
+    lept_free(&v);
+    free(json);
+}
+
+//string escaping
+static void bench_stringify_strings(){
+    static const char* names[] = { "10 MB blob", "64-byte", "escaped" };
+    size_t i, j, length = 0;
+    int kind, r;
+    printf("\n# stringify strings, MB of output per second\n");
+    for(kind = 0; kind < 3; kind++){
+        lept_value v;
+        double t;
+        lept_init(&v);
+        if(kind == 0){
+            char* blob = (char*)malloc(10 << 20);
+            for(i = 0; i < 10 << 20; i++)
+                blob[i] = (char)(' ' + bench_rand() % 90);
+            for(i = 0; i < 10 << 20; i++)
+                if(blob[i] == '"' || blob[i] == '\\')
+                    blob[i] = 'x';
+            lept_set_string(&v, blob, 10 << 20);
+            free(blob);
+        }
+        else{
+            char line[64];
+            lept_set_array(&v, 160000);
+            for(i = 0; i < 160000; i++){
+                for(j = 0; j < sizeof(line); j++)
+                    line[j] = (char)('a' + bench_rand() % 26);
+                if(kind == 2)   /* a quoted word and a line break, like a log message */
+                    line[10] = line[20] = '"', line[63] = '\n';
+                lept_set_string(lept_pushback_array_element(&v), line, sizeof(line));
+            }
+        }
+        t = bench_now();
+        for(r = 0; r < BENCH_REPEAT; r++)
+            free(lept_stringify(&v, &length));
+        t = (bench_now() - t) / BENCH_REPEAT;
+        printf("%-12s %10.1f\n", names[kind], length / t / 1e6);
+        lept_free(&v);
+    }
+}
+
+//recursive vs iterative
+#define BENCH_DEPTH 5000
+
+static void bench_iterative(){
+    static const char* names[] = { "nested", "records" };
+    int doc;
+    printf("\n# recursive vs iterative, milliseconds per call\n");
+    printf("%-8s %-10s %10s %10s\n", "document", "call", "recursive", "iterative");
+    for(doc = 0; doc < 2; doc++){
+        size_t i, len = 0, length;
+        char* json;
+        lept_value v, w;
+        double t, t_rec[4], t_it[4];
+        int r, reps = doc == 0 ? 200 : BENCH_REPEAT;
+        if(doc == 0){
+            /* [1,{"k":[1,{"k":...}]}] */
+            json = (char*)malloc(BENCH_DEPTH * 12 + 2);
+            for(i = 0; i < BENCH_DEPTH; i++){
+                memcpy(json + len, "[1,{\"k\":", 8);
+                len += 8;
+            }
+            json[len++] = '0';
+            for(i = 0; i < BENCH_DEPTH; i++){
+                memcpy(json + len, "}]", 2);
+                len += 2;
+            }
+            json[len] = '\0';
+        }
+        else
+            json = bench_records_json(BENCH_RECORDS, &len);
+
+        t = bench_now();
+        for(r = 0; r < reps; r++){
+            lept_init(&v);
+            lept_parse_n(&v, json, len);
+            if(r + 1 < reps)
+                lept_free(&v);
+        }
+        t_rec[0] = (bench_now() - t) / reps;
+        t = bench_now();
+        for(r = 0; r < reps; r++){
+            lept_init(&w);
+            lept_parse_iterative(&w, json, len, 0);
+            if(r + 1 < reps)
+                lept_free_iterative(&w);
+        }
+        t_it[0] = (bench_now() - t) / reps;
+
+        t = bench_now();
+        for(r = 0; r < reps; r++)
+            free(lept_stringify(&v, &length));
+        t_rec[1] = (bench_now() - t) / reps;
+        t = bench_now();
+        for(r = 0; r < reps; r++)
+            free(lept_stringify_iterative(&v, &length));
+        t_it[1] = (bench_now() - t) / reps;
+
+        t = bench_now();
+        for(r = 0; r < reps; r++)
+            if(!lept_is_equal(&v, &w))
+                printf("not equal\n");
+        t_rec[2] = (bench_now() - t) / reps;
+        t = bench_now();
+        for(r = 0; r < reps; r++)
+            if(!lept_is_equal_iterative(&v, &w))
+                printf("not equal\n");
+        t_it[2] = (bench_now() - t) / reps;
+
+        t = bench_now();
+        lept_free(&v);
+        t_rec[3] = bench_now() - t;
+        t = bench_now();
+        lept_free_iterative(&w);
+        t_it[3] = bench_now() - t;
+
+        printf("%-8s %-10s %10.3f %10.3f\n", names[doc], "parse", t_rec[0] * 1e3, t_it[0] * 1e3);
+        printf("%-8s %-10s %10.3f %10.3f\n", names[doc], "stringify", t_rec[1] * 1e3, t_it[1] * 1e3);
+        printf("%-8s %-10s %10.3f %10.3f\n", names[doc], "is_equal", t_rec[2] * 1e3, t_it[2] * 1e3);
+        printf("%-8s %-10s %10.3f %10.3f\n", names[doc], "free", t_rec[3] * 1e3, t_it[3] * 1e3);
+        free(json);
+    }
+}
+
+//lazy values
+#define BENCH_LAZY_BYTES (64 << 20)
+
+/* a few members, first, middle and last, out of documents with more and more of them */
+static void bench_lazy(){
+    static const size_t widths[] = { 8, 32, 128, 512, 2048 };
+    size_t w, i, k;
+    printf("\n# read 3 members of one object, microseconds per document\n");
+    printf("%-8s %10s %14s %14s\n", "members", "bytes", "lept_parse_n", "lept_lazy");
+    for(w = 0; w < sizeof(widths) / sizeof(widths[0]); w++){
+        size_t n = widths[w], len = 0, docs;
+        char* json = (char*)malloc(n * 96 + 64);
+        const char* keys[3] = { "id", "tenant", "type" };
+        double t, t_parse, t_lazy;
+        size_t found = 0;
+        for(i = 0; i < n; i++){
+            const char* key = i == 0 ? keys[0] : i == n / 2 ? keys[1] : i == n - 1 ? keys[2] : NULL;
+            char name[32];
+            if(key == NULL)
+                sprintf(name, "field_%lu", (unsigned long)i);
+            len += sprintf(json + len, "%s\"%s\":", i ? "," : "{", key ? key : name);
+            if(key != NULL || i % 3 == 0)
+                len += sprintf(json + len, "%d.%02d", (int)(bench_rand() % 1000), (int)(bench_rand() % 100));
+            else if(i % 3 == 1)
+                len += sprintf(json + len, "\"value \\\"%lu\\\" [x]\"", (unsigned long)bench_rand() % 100000);
+            else
+                len += sprintf(json + len, "{\"a\":[1,2,{\"b\":null}],\"c\":\"}\"}");
+        }
+        json[len++] = '}';
+        json[len] = '\0';
+        docs = BENCH_LAZY_BYTES / len;
+
+        t = bench_now();
+        for(i = 0; i < docs; i++){
+            lept_value v;
+            lept_parse_n(&v, json, len);
+            for(k = 0; k < 3; k++){
+                lept_value* m = lept_find_object_value(&v, keys[k], strlen(keys[k]));
+                found += m != NULL && lept_get_type(m) == LEPT_NUMBER;
+            }
+            lept_free(&v);
+        }
+        t_parse = bench_now() - t;
+
+        t = bench_now();
+        for(i = 0; i < docs; i++){
+            lept_lazy v, m;
+            lept_lazy_init(&v, json, len);
+            for(k = 0; k < 3; k++)
+                found -= lept_lazy_find_object_value(&v, keys[k], strlen(keys[k]), &m) &&
+                    lept_lazy_get_type(&m) == LEPT_NUMBER;
+        }
+        t_lazy = bench_now() - t;
+
+        if(found != 0)
+            printf("lazy mismatch\n");
+        printf("%-8lu %10lu %14.2f %14.2f\n", (unsigned long)n, (unsigned long)len, t_parse * 1e6 / docs, t_lazy * 1e6 / docs);
+        free(json);
+    }
+}
+
+//pointer extraction
+#define BENCH_EXTRACT_DOCS 200000
+
+/* the routing path: a tenant id and an event type out of each event, the raw bytes forwarded as they are */
+static void bench_extract(){
+    static const char* paths[2] = { "/tenant/id", "/event/type" };
+    size_t i, k, len = 0, found = 0, *offsets = (size_t*)malloc((BENCH_EXTRACT_DOCS + 1) * sizeof(size_t));
+    char* json = (char*)malloc((size_t)BENCH_EXTRACT_DOCS * 1024);
+    lept_pointer p[2];
+    double t, t_parse, t_extract;
+    for(k = 0; k < 2; k++)
+        lept_pointer_compile(&p[k], paths[k], strlen(paths[k]));
+    for(i = 0; i < BENCH_EXTRACT_DOCS; i++){
+        offsets[i] = len;
+        len += sprintf(json + len, "{\"tenant\":{\"id\":\"t-%04d\",\"region\":\"eu-west-%d\"},"
+            "\"event\":{\"type\":\"%s\",\"ts\":%lu,\"seq\":%lu},\"payload\":{\"items\":[",
+            (int)(bench_rand() % 10000), (int)(bench_rand() % 3), bench_rand() % 2 ? "click" : "view",
+            (unsigned long)(1700000000 + i), (unsigned long)i);
+        for(k = 0; k < 8; k++)
+            len += sprintf(json + len, "%s{\"sku\":\"sku-%05d\",\"qty\":%d,\"price\":%d.%02d,\"tags\":[\"a\",\"b\"]}",
+                k ? "," : "", (int)(bench_rand() % 100000), (int)(bench_rand() % 9 + 1), (int)(bench_rand() % 500), (int)(bench_rand() % 100));
+        len += sprintf(json + len, "],\"note\":\"free text with \\\"quotes\\\" and [brackets]\"}}");
+    }
+    offsets[BENCH_EXTRACT_DOCS] = len;
+
+    t = bench_now();
+    for(i = 0; i < BENCH_EXTRACT_DOCS; i++){
+        lept_value v;
+        lept_parse_n(&v, json + offsets[i], offsets[i + 1] - offsets[i]);
+        for(k = 0; k < 2; k++)
+            found += lept_pointer_find(&v, &p[k]) != NULL;
+        lept_free(&v);
+    }
+    t_parse = bench_now() - t;
+
+    t = bench_now();
+    for(i = 0; i < BENCH_EXTRACT_DOCS; i++){
+        lept_lazy values[2];
+        lept_extract(json + offsets[i], offsets[i + 1] - offsets[i], p, 2, values);
+        for(k = 0; k < 2; k++)
+            found -= values[k].json != NULL;
+    }
+    t_extract = bench_now() - t;
+
+    if(found != 0)
+        printf("extract mismatch\n");
+    printf("\n# 2 pointers out of %d events of %lu bytes, documents per second\n", BENCH_EXTRACT_DOCS, (unsigned long)(len / BENCH_EXTRACT_DOCS));
+    printf("%-28s %12.0f\n", "lept_parse_n + pointer_find", BENCH_EXTRACT_DOCS / t_parse);
+    printf("%-28s %12.0f\n", "lept_extract", BENCH_EXTRACT_DOCS / t_extract);
+    for(k = 0; k < 2; k++)
+        lept_pointer_free(&p[k]);
+    free(json);
+    free(offsets);
+}
+
+//projection
+#define BENCH_PROJECT_RECORDS 100000
+
+/* analytics records of 20 members, one of them kept */
+static void bench_parse_projected(){
+    size_t i, k, len = 0, values = 0, allocs = 0, bytes, p_values = 0, p_allocs = 0, p_bytes;
+    char* json = (char*)malloc((size_t)BENCH_PROJECT_RECORDS * 640);
+    lept_pointer p;
+    lept_value v;
+    double t, t_full, t_projected;
+    lept_pointer_compile(&p, "/latency", 8);
+    json[len++] = '[';
+    for(i = 0; i < BENCH_PROJECT_RECORDS; i++){
+        len += sprintf(json + len, "%s{\"id\":%lu,\"latency\":%d.%02d", i ? "," : "", (unsigned long)i,
+            (int)(bench_rand() % 100), (int)(bench_rand() % 100));
+        for(k = 0; k < 18; k++)
+            len += sprintf(json + len, k % 3 == 0 ? ",\"metric_%02lu\":%lu" : k % 3 == 1 ? ",\"label_%02lu\":\"value-%lu\"" : ",\"flag_%02lu\":[%lu,true,null]",
+                (unsigned long)k, (unsigned long)(bench_rand() % 100000));
+        json[len++] = '}';
+    }
+    json[len++] = ']';
+
+    t = bench_now();
+    lept_parse_n(&v, json, len);
+    t_full = bench_now() - t;
+    bytes = bench_tree_bytes(&v, &values, &allocs);
+    lept_free(&v);
+
+    t = bench_now();
+    if(lept_parse_projected(&v, json, len, &p, 1) != LEPT_PARSE_OK)
+        printf("parse error\n");
+    t_projected = bench_now() - t;
+    p_bytes = bench_tree_bytes(&v, &p_values, &p_allocs);
+    lept_free(&v);
+
+    printf("\n# keep 1 of 20 members in %d records, %lu bytes\n", BENCH_PROJECT_RECORDS, (unsigned long)len);
+    printf("%-20s %10s %12s %12s\n", "", "ms", "tree bytes", "mallocs");
+    printf("%-20s %10.2f %12lu %12lu\n", "lept_parse_n", t_full * 1e3, (unsigned long)bytes, (unsigned long)allocs);
+    printf("%-20s %10.2f %12lu %12lu\n", "lept_parse_projected", t_projected * 1e3, (unsigned long)p_bytes, (unsigned long)p_allocs);
+    lept_pointer_free(&p);
+    free(json);
+}
+
+//msgpack
+/* text and binary of the same trees: bytes, and MB per second of the json form so the columns compare */
+static void bench_msgpack(){
+    static const char* names[] = { "records", "matrix" };
+    int doc;
+    printf("\n# json vs msgpack: bytes, encode and decode in MB of json per second\n");
+    printf("%-8s %10s %10s %12s %12s %12s %12s\n", "document", "json", "msgpack",
+        "stringify", "to_msgpack", "parse", "from_msgpack");
+    for(doc = 0; doc < 2; doc++){
+        size_t len, text_len, bin_len;
+        char* json = doc == 0 ? bench_records_json(200000, &len) : bench_matrix_json(200000, &len);
+        char* text, *bin;
+        lept_value v, w;
+        double t, t_stringify, t_encode, t_parse, t_decode;
+        lept_parse_n(&v, json, len);
+
+        t = bench_now();
+        text = lept_stringify(&v, &text_len);
+        t_stringify = bench_now() - t;
+        t = bench_now();
+        bin = lept_to_msgpack(&v, &bin_len);
+        t_encode = bench_now() - t;
+
+        t = bench_now();
+        lept_parse_n(&w, text, text_len);
+        t_parse = bench_now() - t;
+        lept_free(&w);
+        t = bench_now();
+        if(lept_from_msgpack(&w, bin, bin_len) != LEPT_PARSE_OK || !lept_is_equal(&v, &w))
+            printf("msgpack mismatch\n");
+        t_decode = bench_now() - t;
+        lept_free(&w);
+
+        printf("%-8s %10lu %10lu %12.1f %12.1f %12.1f %12.1f\n", names[doc], (unsigned long)text_len, (unsigned long)bin_len,
+            text_len / t_stringify / 1e6, text_len / t_encode / 1e6, text_len / t_parse / 1e6, text_len / t_decode / 1e6);
+        free(text);
+        free(bin);
+        lept_free(&v);
+        free(json);
+    }
+}
+
+//snapshot
+/*
+ * startup as a worker sees it: from a file on disk to the "path" of the last
+ * record, by parsing the json or by mapping a snapshot written once beforehand
+ */
+static void bench_snapshot(){
+    static const size_t records[] = { 10000, 100000, 1000000 };
+    static const char json_path[] = "bench_snapshot.json", snap_path[] = "bench_snapshot.snap";
+    int k;
+    printf("\n# records to the last \"path\": json and snapshot bytes, startup in ms\n");
+    printf("%-8s %11s %11s %12s %12s %12s\n", "records", "json", "snapshot", "parse_file", "snapshot_map", "map+verify");
+    for(k = 0; k < 3; k++){
+        size_t len, n;
+        char* json = bench_records_json(records[k], &len);
+        const lept_compact_node* e;
+        lept_compact d;
+        lept_value v;
+        double t, t_parse, t_map, t_verify;
+        FILE* fp = fopen(json_path, "wb");
+        fwrite(json, 1, len, fp);
+        fclose(fp);
+        lept_parse_n(&v, json, len);
+        fp = fopen(snap_path, "wb");
+        lept_snapshot_write(&v, lept_write_file, fp);
+        fclose(fp);
+        lept_free(&v);
+
+        t = bench_now();
+        lept_parse_file(&v, json_path);
+        n = lept_get_string_length(lept_find_object_value(lept_get_array_element(&v, records[k] - 1), "path", 4));
+        t_parse = bench_now() - t;
+        lept_free(&v);
+
+        t = bench_now();
+        lept_snapshot_map(&d, snap_path);
+        e = lept_compact_get_array_element(&d, lept_compact_root(&d), records[k] - 1);
+        if(lept_compact_get_string_length(lept_compact_find_object_value(&d, e, "path", 4)) != n)
+            printf("snapshot mismatch\n");
+        t_map = bench_now() - t;
+        lept_compact_free(&d);
+
+        t = bench_now();
+        lept_snapshot_map(&d, snap_path);
+        if(!lept_snapshot_verify(&d))
+            printf("snapshot does not verify\n");
+        t_verify = bench_now() - t;
+
+        printf("%-8lu %11lu %11lu %12.3f %12.3f %12.3f\n", (unsigned long)records[k], (unsigned long)len,
+            (unsigned long)d.mapped, t_parse * 1e3, t_map * 1e3, t_verify * 1e3);
+        lept_compact_free(&d);
+        remove(json_path);
+        remove(snap_path);
+        free(json);
+    }
+}
+
+//ndjson
+#define BENCH_NDJSON_LINES 1000000
+
+static int bench_ndjson_count(void* ud, size_t offset, int ret, lept_value* v){
+    (void)offset;
+    (void)v;
+    if(ret != LEPT_PARSE_OK)
+        ++*(volatile size_t*)ud;    /* only errors are counted, and there are none */
+    return 1;
+}
+
+static void bench_parse_ndjson(){
+    static const int threads[] = { 1, 2, 4, 8 };
+    size_t i, len = 0, errors = 0;
+    char* json = (char*)malloc((size_t)BENCH_NDJSON_LINES * 128);
+    double t, t_loop;
+    int k;
+    for(i = 0; i < BENCH_NDJSON_LINES; i++)
+        len += sprintf(json + len, "{\"id\":%lu,\"host\":\"web-%02d\",\"path\":\"/api/v1/items/%lu\",\"status\":%d,\"latency\":%d.%02d}\n",
+            (unsigned long)i, (int)(bench_rand() % 64), (unsigned long)(bench_rand() % 100000),
+            bench_rand() % 10 ? 200 : 404, (int)(bench_rand() % 100), (int)(bench_rand() % 100));
+
+    /* what callers did before: find each line, lept_parse_n() it on one core */
+    t = bench_now();
+    for(i = 0; i < len; ){
+        const char* eol = (const char*)memchr(json + i, '\n', len - i);
+        lept_value v;
+        lept_init(&v);
+        errors += lept_parse_n(&v, json + i, eol - (json + i)) != LEPT_PARSE_OK;
+        lept_free(&v);
+        i = eol + 1 - json;
+    }
+    t_loop = bench_now() - t;
+
+    printf("\n# ndjson, %d lines, %lu bytes, MB per second\n", BENCH_NDJSON_LINES, (unsigned long)len);
+    printf("%-10s %10s %10s\n", "threads", "ordered", "unordered");
+    printf("%-10s %10.1f\n", "line loop", len / t_loop / 1e6);
+    for(k = 0; k < 4; k++){
+        double t_ordered, t_unordered;
+        t = bench_now();
+        lept_parse_ndjson(json, len, threads[k], LEPT_NDJSON_ORDERED, bench_ndjson_count, &errors);
+        t_ordered = bench_now() - t;
+        t = bench_now();
+        lept_parse_ndjson(json, len, threads[k], 0, bench_ndjson_count, &errors);
+        t_unordered = bench_now() - t;
+        printf("%-10d %10.1f %10.1f\n", threads[k], len / t_ordered / 1e6, len / t_unordered / 1e6);
+    }
+    if(errors != 0)
+        printf("%lu parse errors\n", (unsigned long)errors);
+    free(json);
+}
+
+//one large array
+#define BENCH_PARALLEL_RECORDS 500000
+
+static void bench_parse_parallel(){
+    static const int threads[] = { 1, 2, 4, 8 };
+    size_t len;
+    char* json = bench_records_json(BENCH_PARALLEL_RECORDS, &len);
+    lept_value v;
+    double t;
+    int k;
+
+    printf("\n# one %lu byte array, MB per second\n", (unsigned long)len);
+    lept_init(&v);
+    t = bench_now();
+    lept_parse_n(&v, json, len);
+    t = bench_now() - t;
+    lept_free(&v);
+    printf("%-12s %10.1f\n", "lept_parse_n", len / t / 1e6);
+    for(k = 0; k < 4; k++){
+        lept_init(&v);
+        t = bench_now();
+        if(lept_parse_parallel(&v, json, len, threads[k]) != LEPT_PARSE_OK)
+            printf("parse error\n");
+        t = bench_now() - t;
+        lept_free(&v);
+        printf("%-2d threads  %10.1f\n", threads[k], len / t / 1e6);
+    }
+    free(json);
+}
+
+//suite
+/*
+ * Every operation over deterministic corpora, repeated, one csv row per corpus
+ * and operation on stdout so runs of different versions can be diffed:
+ *
+ *   label,corpus,op,docs,bytes,ops,reps,min_ms,p50_ms,p90_ms,p99_ms,max_ms,mb_per_s,docs_per_s,ops_per_s
+ *
+ * Times are for the whole corpus, rates are taken at the median. ops is docs,
+ * except for lookup where it counts the keys looked up. One untimed round runs
+ * first to warm the caches and the allocator.
+ */
+#define BENCH_SUITE_BYTES (8 << 20)     /* json per corpus */
+#define BENCH_SUITE_DOC_MAX (1 << 16)   /* the most a generator writes for one document */
+#define BENCH_SUITE_REPEAT 10
+
+typedef struct{
+    const char* name;
+    size_t (*generate)(char* p);
+}bench_suite_corpus;
+
+static size_t bench_gen_numbers(char* p){
+    char* start = p;
+    int i;
+    *p++ = '[';
+    for(i = 0; i < 800; i++)
+        p += sprintf(p, i ? ",%.17g" : "%.17g", bench_number(i % 4));
+    *p++ = ']';
+    return p - start;
+}
+
+/* ascii with escapes, two and three byte utf-8 mixed in */
+static size_t bench_gen_strings(char* p){
+    static const char* pieces[] = { "\\n", "\\\"", "\\u00e9", "\xC3\xA9", "\xE2\x82\xAC", "\\\\" };
+    char* start = p;
+    int i, j, n;
+    *p++ = '[';
+    for(i = 0; i < 150; i++){
+        if(i)
+            *p++ = ',';
+        *p++ = '"';
+        for(j = 0, n = 8 + (int)(bench_rand() % 56); j < n; j++){
+            unsigned r = (unsigned)(bench_rand() % 40);
+            p += r < 6 ? sprintf(p, "%s", pieces[r]) : sprintf(p, "%c", 'a' + (r - 6) % 26);
+        }
+        *p++ = '"';
+    }
+    *p++ = ']';
+    return p - start;
+}
+
+static char* bench_gen_level(char* p, int depth){
+    if(depth == 64)
+        return p + sprintf(p, "null");
+    p += sprintf(p, "{\"id\":%d,\"name\":\"level-%d\",\"items\":[%d,%d,true],\"child\":",
+        depth, depth, (int)(bench_rand() % 1000), (int)(bench_rand() % 1000));
+    p = bench_gen_level(p, depth + 1);
+    *p++ = '}';
+    return p;
+}
+
+/* three chains of 64 objects, each inside the last */
+static size_t bench_gen_nested(char* p){
+    char* start = p;
+    int i;
+    *p++ = '[';
+    for(i = 0; i < 3; i++){
+        if(i)
+            *p++ = ',';
+        p = bench_gen_level(p, 0);
+    }
+    *p++ = ']';
+    return p - start;
+}
+
+static size_t bench_gen_wide(char* p){
+    char* start = p;
+    int i;
+    *p++ = '{';
+    for(i = 0; i < 400; i++){
+        p += sprintf(p, "%s\"field_%03d_%04x\":", i ? "," : "", i, (unsigned)(bench_rand() % 0x10000));
+        switch(i % 4){
+            case 0:  p += sprintf(p, "%lu", (unsigned long)(bench_rand() % 100000)); break;
+            case 1:  p += sprintf(p, "\"value-%lu\"", (unsigned long)(bench_rand() % 100000)); break;
+            case 2:  p += sprintf(p, bench_rand() % 2 ? "true" : "false"); break;
+            default: p += sprintf(p, "null"); break;
+        }
+    }
+    *p++ = '}';
+    return p - start;
+}
+
+static char* bench_gen_record(char* p){
+    return p + sprintf(p, "{\"id\":%lu,\"host\":\"web-%02d\",\"path\":\"/api/v1/items/%lu/details\","
+        "\"status\":%d,\"latency\":%d.%02d,\"tags\":[\"edge\",\"cache-%s\"],\"error\":null}",
+        (unsigned long)(bench_rand() % 1000000), (int)(bench_rand() % 64), (unsigned long)(bench_rand() % 100000),
+        bench_rand() % 10 ? 200 : 404, (int)(bench_rand() % 100), (int)(bench_rand() % 100),
+        bench_rand() % 2 ? "hit" : "miss");
+}
+
+static size_t bench_gen_records(char* p){
+    char* start = p;
+    int i;
+    *p++ = '[';
+    for(i = 0; i < 64; i++){
+        if(i)
+            *p++ = ',';
+        p = bench_gen_record(p);
+    }
+    *p++ = ']';
+    return p - start;
+}
+
+/* one line of a log, every line its own document */
+static size_t bench_gen_ndjson(char* p){
+    return bench_gen_record(p) - p;
+}
+
+/* looks every member of every object up by its key, returns how many were found */
+static size_t bench_lookup_all(const lept_value* v){
+    size_t i, n = 0;
+    if(lept_get_type(v) == LEPT_ARRAY)
+        for(i = 0; i < lept_get_array_size(v); i++)
+            n += bench_lookup_all(lept_get_array_element(v, i));
+    else if(lept_get_type(v) == LEPT_OBJECT)
+        for(i = 0; i < lept_get_object_size(v); i++){
+            const lept_value* m = lept_find_object_value(v, lept_get_object_key(v, i), lept_get_object_key_length(v, i));
+            n += (m != NULL) + bench_lookup_all(m);
+        }
+    return n;
+}
+
+static int bench_compare_double(const void* a, const void* b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* nearest rank */
+static double bench_percentile(const double* sorted, int n, int p){
+    int rank = (p * n + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+enum { BENCH_PARSE, BENCH_STRINGIFY, BENCH_COPY, BENCH_IS_EQUAL, BENCH_LOOKUP, BENCH_FREE, BENCH_OPS };
+
+static void bench_suite(int repeat, const char* label){
+    static const bench_suite_corpus corpora[] = {
+        { "numbers", bench_gen_numbers }, { "strings", bench_gen_strings }, { "nested", bench_gen_nested },
+        { "wide", bench_gen_wide }, { "records", bench_gen_records }, { "ndjson", bench_gen_ndjson }
+    };
+    static const char* names[BENCH_OPS] = { "parse", "stringify", "copy", "is_equal", "lookup", "free" };
+    double* times[BENCH_OPS];
+    int k, op, r;
+    printf("label,corpus,op,docs,bytes,ops,reps,min_ms,p50_ms,p90_ms,p99_ms,max_ms,mb_per_s,docs_per_s,ops_per_s\n");
+    for(op = 0; op < BENCH_OPS; op++)
+        times[op] = (double*)malloc(repeat * sizeof(double));
+    for(k = 0; k < (int)(sizeof(corpora) / sizeof(corpora[0])); k++){
+        size_t docs = 0, bytes = 0, size = BENCH_SUITE_BYTES + 2 * BENCH_SUITE_DOC_MAX, i, lookups = 0, errors = 0;
+        char* json = (char*)malloc(size);
+        size_t* offsets = (size_t*)malloc(BENCH_SUITE_BYTES / 16 * sizeof(size_t));   /* no document is that short */
+        lept_value *v, *w;
+        char** text;
+        double t;
+
+        bench_seed = 88172645463325252ULL;     /* each corpus is the same whatever ran before it */
+        while(bytes < BENCH_SUITE_BYTES){
+            size_t len = corpora[k].generate(json + bytes);
+            offsets[docs++] = bytes;
+            json[bytes + len] = '\0';
+            bytes += len + 1;
+        }
+        bytes -= docs;      /* the terminators are not json */
+        v = (lept_value*)malloc(docs * sizeof(lept_value));
+        w = (lept_value*)malloc(docs * sizeof(lept_value));
+        text = (char**)malloc(docs * sizeof(char*));
+
+        for(r = -1; r < repeat; r++){
+            double lap[BENCH_OPS];
+            t = bench_now();
+            for(i = 0; i < docs; i++){
+                lept_init(&v[i]);
+                errors += lept_parse(&v[i], json + offsets[i]) != LEPT_PARSE_OK;
+            }
+            lap[BENCH_PARSE] = bench_now() - t;
+
+            t = bench_now();
+            for(i = 0; i < docs; i++)
+                text[i] = lept_stringify(&v[i], NULL);
+            lap[BENCH_STRINGIFY] = bench_now() - t;
+            for(i = 0; i < docs; i++)
+                free(text[i]);
+
+            t = bench_now();
+            for(i = 0; i < docs; i++){
+                lept_init(&w[i]);
+                lept_copy(&w[i], &v[i]);
+            }
+            lap[BENCH_COPY] = bench_now() - t;
+
+            t = bench_now();
+            for(i = 0; i < docs; i++)
+                errors += !lept_is_equal(&v[i], &w[i]);
+            lap[BENCH_IS_EQUAL] = bench_now() - t;
+            for(i = 0; i < docs; i++)
+                lept_free(&w[i]);
+
+            lookups = 0;
+            t = bench_now();
+            for(i = 0; i < docs; i++)
+                lookups += bench_lookup_all(&v[i]);
+            lap[BENCH_LOOKUP] = bench_now() - t;
+
+            t = bench_now();
+            for(i = 0; i < docs; i++)
+                lept_free(&v[i]);
+            lap[BENCH_FREE] = bench_now() - t;
+
+            if(r >= 0)
+                for(op = 0; op < BENCH_OPS; op++)
+                    times[op][r] = lap[op];
+        }
+        if(errors != 0)
+            fprintf(stderr, "%s: %lu documents failed to parse or compare\n", corpora[k].name, (unsigned long)errors);
+
+        for(op = 0; op < BENCH_OPS; op++){
+            size_t ops = op == BENCH_LOOKUP ? lookups : docs;
+            double p50;
+            if(ops == 0)
+                continue;   /* no objects to look into */
+            qsort(times[op], repeat, sizeof(double), bench_compare_double);
+            p50 = bench_percentile(times[op], repeat, 50);
+            printf("%s,%s,%s,%lu,%lu,%lu,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.0f,%.0f\n", label, corpora[k].name, names[op],
+                (unsigned long)docs, (unsigned long)bytes, (unsigned long)ops, repeat,
+                times[op][0] * 1e3, p50 * 1e3, bench_percentile(times[op], repeat, 90) * 1e3,
+                bench_percentile(times[op], repeat, 99) * 1e3, times[op][repeat - 1] * 1e3,
+                bytes / p50 / 1e6, docs / p50, ops / p50);
+        }
+        free(text);
+        free(w);
+        free(v);
+        free(offsets);
+        free(json);
+    }
+    for(op = 0; op < BENCH_OPS; op++)
+        free(times[op]);
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && strcmp(argv[1], "suite") == 0){
+        int repeat = argc > 2 ? atoi(argv[2]) : BENCH_SUITE_REPEAT;
+        bench_suite(repeat > 0 ? repeat : BENCH_SUITE_REPEAT, argc > 3 ? argv[3] : "-");
+        return 0;
+    }
+    bench_stringify_number();
+    bench_object_lookup();
+    bench_parse_records();
+    bench_node_memory();
+    bench_stringify_into();
+    bench_stringify_strings();
+    bench_iterative();
+    bench_parse_ndjson();
+    bench_parse_parallel();
+    bench_lazy();
+    bench_extract();
+    bench_parse_projected();
+    bench_msgpack();
+    bench_snapshot();
+    return 0;
+}
@@ -1,40 +1,177 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L     /* mmap, posix_madvise */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
-#include <error.h>
 #include <math.h>
+#include <float.h>
+#include <stdint.h>
 #include "leptjson.h"
+#include "leptjson_tables.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef LEPT_NO_THREADS
+#include <pthread.h>    /* lept_parse_ndjson(), link with -pthread */
+#endif
+#endif
+
+#if !defined(LEPT_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__))
+#define LEPT_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define LEPT_TARGET_AVX2
+#else
+#define LEPT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 #define EXPECT(c, ch) do { assert( *c->json == (ch)); c->json++; } while(0)
 #define ISDIGIT(ch)     ((ch) >= '0' && (ch) <= '9')
 #define ISDIGIT1TO9(ch) ((ch) >= '1' && (ch) <= '9')
 #define PUTC(c, ch) do{ *(char*)lept_context_push(c, sizeof(char)) = (ch); }while(0)
 #define STRING_ERROR(ret) do{ c->top = head; return ret; }while(0)
+#define ISWS(ch)        ((ch) == ' ' || (ch) == '\t' || (ch) == '\n' || (ch) == '\r')
+#define ISSTRSTOP(ch)   ((ch) == '"' || (ch) == '\\' || (unsigned char)(ch) < 0x20)
+#define PUTS(c, s, len) memcpy(lept_context_push(c, len), s, len)
+#define PEEK(p, end)    ((p) != (end) ? *(p) : '\0')   /* the byte at p, '\0' past the end of input */
 
-int lept_parse(lept_value* v, const char* json){
-    lept_context c;
+/* internal helpers used above their definitions */
+static int lept_parse_string_insitu(lept_context* c, char** str, size_t* len);
+static int lept_sax_value(lept_context* c, const lept_handler* h, void* ud);
+static int lept_sax_array(lept_context* c, const lept_handler* h, void* ud);
+static int lept_sax_object(lept_context* c, const lept_handler* h, void* ud);
+static void* lept_context_alloc(lept_context* c, size_t size);
+static void lept_compact_reset(lept_compact* d);
+static int lept_project_enter(lept_projection* pr, const char* key, size_t klen);
+static void lept_project_leave(lept_projection* pr);
+static int lept_msgpack_value(lept_context* c, lept_value* v, size_t depth);
+static void lept_stringify_flush(lept_context* c);
+
+/* parses [c->json, c->end) and leaves the stack to the caller, who may parse more with it */
+static int lept_parse_in(lept_context* c, lept_value* v){
     int ret;
-    assert(v != NULL);
-    c.json = json;
-    c.stack = NULL;
-    c.size = c.top = 0;
-    v->type = LEPT_NULL;
     lept_init(v);
-    lept_parse_whitespace(&c);
+    lept_parse_whitespace(c);
     // return lept_parse_value(&c, v);
-    if((ret = lept_parse_value(&c, v)) == LEPT_PARSE_OK){
-        lept_parse_whitespace(&c);
-        if(*c.json != '\0'){
-            v->type = LEPT_NULL;
+    if((ret = lept_parse_value(c, v)) == LEPT_PARSE_OK){
+        lept_parse_whitespace(c);
+        if(c->json != c->end){
+            lept_free(v);
             ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
         }
     }
-    assert(c.top == 0);
-    free(c.stack);
+    assert(c->top == 0);
+    return ret;
+}
+
+static int lept_parse_root(lept_context* c, lept_value* v){
+    int ret = lept_parse_in(c, v);
+    free(c->stack);
+    return ret;
+}
+
+static void lept_context_init(lept_context* c, const char* json, size_t len){
+    c->json = json;
+    c->end = json + len;
+    c->stack = NULL;
+    c->size = c->top = 0;
+    c->doc = NULL;
+    c->insitu = 0;
+    c->keys = NULL;
+    c->write = NULL;
+    c->ud = NULL;
+    c->write_error = 0;
+    c->project = NULL;
+}
+
+int lept_parse(lept_value* v, const char* json){
+    assert(json != NULL);
+    return lept_parse_n(v, json, strlen(json));
+}
+
+int lept_parse_n(lept_value* v, const char* json, size_t len){
+    lept_context c;
+    assert(v != NULL && (json != NULL || len == 0));
+    lept_context_init(&c, json, len);
+    return lept_parse_root(&c, v);
+}
+
+/* the file is mapped read-only and parsed straight from the page cache, it is never copied to the heap */
+int lept_parse_file(lept_value* v, const char* path){
+    int ret;
+#if defined(_WIN32)
+    HANDLE file, map;
+    LARGE_INTEGER size;
+    const char* json;
+    assert(v != NULL && path != NULL);
+    lept_init(v);
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return LEPT_PARSE_FILE_ERROR;
+    if(!GetFileSizeEx(file, &size) || (unsigned long long)size.QuadPart > (size_t)-1){
+        CloseHandle(file);
+        return LEPT_PARSE_FILE_ERROR;
+    }
+    if(size.QuadPart == 0){     /* an empty file cannot be mapped */
+        CloseHandle(file);
+        return lept_parse_n(v, "", 0);
+    }
+    map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(map == NULL)
+        return LEPT_PARSE_FILE_ERROR;
+    json = (const char*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(map);
+    if(json == NULL)
+        return LEPT_PARSE_FILE_ERROR;
+    ret = lept_parse_n(v, json, (size_t)size.QuadPart);
+    UnmapViewOfFile(json);
+#else
+    int fd;
+    struct stat st;
+    void* json;
+    assert(v != NULL && path != NULL);
+    lept_init(v);
+    if((fd = open(path, O_RDONLY)) < 0)
+        return LEPT_PARSE_FILE_ERROR;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (unsigned long long)st.st_size > (size_t)-1){
+        close(fd);
+        return LEPT_PARSE_FILE_ERROR;
+    }
+    if(st.st_size == 0){        /* an empty file cannot be mapped */
+        close(fd);
+        return lept_parse_n(v, "", 0);
+    }
+    json = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(json == MAP_FAILED)
+        return LEPT_PARSE_FILE_ERROR;
+    posix_madvise(json, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    ret = lept_parse_n(v, (const char*)json, (size_t)st.st_size);
+    munmap(json, (size_t)st.st_size);
+#endif
     return ret;
 }
 
+int lept_parse_insitu(lept_value* v, char* json){
+    lept_context c;
+    assert(v != NULL && json != NULL);
+    lept_context_init(&c, json, strlen(json));
+    c.insitu = 1;
+    return lept_parse_root(&c, v);
+}
+
 lept_type lept_get_type(const lept_value* v){
     assert(v != NULL);
     return v->type;
@@ -60,12 +197,169 @@ static void* lept_context_pop(lept_context* c, size_t size){
     return c->stack + (c->top -= size);
 }
 
+// simd
+/* the vector loops only load whole 16/32-byte blocks before end, the tail is done one byte at a time */
+#ifdef LEPT_SIMD_X86
+static int lept_ctz(unsigned x){
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+static const char* lept_skip_whitespace_sse2(const char* p, const char* end){
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i nl = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+    for(;;){
+        __m128i s, x;
+        unsigned mask;
+        if(end - p < 16){
+            while(p != end && ISWS(*p))
+                p++;
+            return p;
+        }
+        s = _mm_loadu_si128((const __m128i*)p);
+        x = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(s, sp), _mm_cmpeq_epi8(s, tab)),
+                         _mm_or_si128(_mm_cmpeq_epi8(s, nl), _mm_cmpeq_epi8(s, cr)));
+        mask = (unsigned)_mm_movemask_epi8(x) ^ 0xFFFFu;
+        if(mask)
+            return p + lept_ctz(mask);
+        p += 16;
+    }
+}
+
+LEPT_TARGET_AVX2
+static const char* lept_skip_whitespace_avx2(const char* p, const char* end){
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i nl = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+    for(;;){
+        __m256i s, x;
+        unsigned mask;
+        if(end - p < 32)
+            return lept_skip_whitespace_sse2(p, end);
+        s = _mm256_loadu_si256((const __m256i*)p);
+        x = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(s, sp), _mm256_cmpeq_epi8(s, tab)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(s, nl), _mm256_cmpeq_epi8(s, cr)));
+        mask = ~(unsigned)_mm256_movemask_epi8(x);
+        if(mask)
+            return p + lept_ctz(mask);
+        p += 32;
+    }
+}
+
+/* stops at the first '"', '\\' or control character (NUL included), or at end */
+static const char* lept_scan_string_sse2(const char* p, const char* end){
+    const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\'), ctrl = _mm_set1_epi8(0x1F);
+    for(;;){
+        __m128i s, x;
+        unsigned mask;
+        if(end - p < 16){
+            while(p != end && !ISSTRSTOP(*p))
+                p++;
+            return p;
+        }
+        s = _mm_loadu_si128((const __m128i*)p);
+        x = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(s, quote), _mm_cmpeq_epi8(s, bslash)),
+                         _mm_cmpeq_epi8(_mm_max_epu8(s, ctrl), ctrl));  /* unsigned s <= 0x1F */
+        mask = (unsigned)_mm_movemask_epi8(x);
+        if(mask)
+            return p + lept_ctz(mask);
+        p += 16;
+    }
+}
+
+LEPT_TARGET_AVX2
+static const char* lept_scan_string_avx2(const char* p, const char* end){
+    const __m256i quote = _mm256_set1_epi8('"'), bslash = _mm256_set1_epi8('\\'), ctrl = _mm256_set1_epi8(0x1F);
+    for(;;){
+        __m256i s, x;
+        unsigned mask;
+        if(end - p < 32)
+            return lept_scan_string_sse2(p, end);
+        s = _mm256_loadu_si256((const __m256i*)p);
+        x = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(s, quote), _mm256_cmpeq_epi8(s, bslash)),
+                            _mm256_cmpeq_epi8(_mm256_max_epu8(s, ctrl), ctrl));
+        mask = (unsigned)_mm256_movemask_epi8(x);
+        if(mask)
+            return p + lept_ctz(mask);
+        p += 32;
+    }
+}
+
+static int lept_cpu_has_avx2(void){
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    if((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)  /* OSXSAVE, AVX */
+        return 0;
+    if((_xgetbv(0) & 6) != 6)                                       /* XMM and YMM state enabled by the OS */
+        return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#else
+static const char* lept_skip_whitespace_scalar(const char* p, const char* end){
+    while (p != end && ISWS(*p))
+        p++;
+    return p;
+}
+
+static const char* lept_scan_string_scalar(const char* p, const char* end){
+    while (p != end && !ISSTRSTOP(*p))
+        p++;
+    return p;
+}
+#endif /* LEPT_SIMD_X86 */
+
+/* picked once on first use; every candidate gives the same answer, so a racy first call is harmless */
+static const char* lept_skip_whitespace_detect(const char* p, const char* end);
+static const char* lept_scan_string_detect(const char* p, const char* end);
+static const char* (*lept_skip_whitespace)(const char* p, const char* end) = lept_skip_whitespace_detect;
+static const char* (*lept_scan_string)(const char* p, const char* end) = lept_scan_string_detect;
+
+static void lept_simd_select(void){
+#ifdef LEPT_SIMD_X86
+    if(lept_cpu_has_avx2()){
+        lept_skip_whitespace = lept_skip_whitespace_avx2;
+        lept_scan_string = lept_scan_string_avx2;
+    }
+    else{
+        lept_skip_whitespace = lept_skip_whitespace_sse2;
+        lept_scan_string = lept_scan_string_sse2;
+    }
+#else
+    lept_skip_whitespace = lept_skip_whitespace_scalar;
+    lept_scan_string = lept_scan_string_scalar;
+#endif
+}
+
+static const char* lept_skip_whitespace_detect(const char* p, const char* end){
+    lept_simd_select();
+    return lept_skip_whitespace(p, end);
+}
+
+static const char* lept_scan_string_detect(const char* p, const char* end){
+    lept_simd_select();
+    return lept_scan_string(p, end);
+}
+
 // parse ws
 static void lept_parse_whitespace(lept_context* c){
     const char* p = c->json;
-    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+    /* compact json has no whitespace at all and pretty json mostly one byte, keep that path scalar */
+    if(ISWS(PEEK(p, c->end))){
         p++;
-    c->json = p; 
+        if(ISWS(PEEK(p, c->end)))
+            p = lept_skip_whitespace(p + 1, c->end);
+    }
+    c->json = p;
 }
 
 // parse literals(true\false\null)
@@ -73,7 +367,7 @@ static int lept_parse_literal(lept_context*c, lept_value* v, const char* literal
     size_t i;
     EXPECT(c, literal[0]);
     for(i = 0; literal[i + 1]; i++)
-        if(c->json[i] != literal[i + 1])
+        if(PEEK(c->json + i, c->end) != literal[i + 1])
             return LEPT_PARSE_INVALID_VALUE;
     c->json += i;
     v->type = type;
@@ -81,29 +375,391 @@ static int lept_parse_literal(lept_context*c, lept_value* v, const char* literal
 }
 
 //parse number
+/*
+ * The digits are read once: the validation pass below also collects the first
+ * 19 significant digits into a uint64 mantissa and the decimal exponent, which
+ * lept_decimal_to_double() then rounds to the nearest double. It gives the same
+ * bits as a correctly rounded strtod(), without the locale and errno.
+ */
+#define LEPT_DECIMAL_DIGITS 800    /* digits kept by the exact fallback */
+
+typedef struct {
+    char d[LEPT_DECIMAL_DIGITS];   /* significant digits, '0'..'9', no leading zeros */
+    int nd;                        /* number of digits used */
+    int dp;                        /* position of the decimal point */
+    int trunc;                     /* nonzero digits were dropped past d[LEPT_DECIMAL_DIGITS - 1] */
+}lept_decimal;
+
+static const double lept_pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static uint64_t lept_umul128(uint64_t a, uint64_t b, uint64_t* hi){
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *hi = (uint64_t)(r >> 64);
+    return (uint64_t)r;
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return _umul128(a, b, hi);
+#else
+    uint64_t a0 = (uint32_t)a, a1 = a >> 32, b0 = (uint32_t)b, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+    *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+    return (mid << 32) | (uint32_t)p00;
+#endif
+}
+
+static int lept_clz64(uint64_t x){
+    int n = 0;
+    assert(x != 0);
+#if defined(__GNUC__)
+    n = __builtin_clzll(x);
+#else
+    while(!(x & ((uint64_t)1 << 63))){
+        x <<= 1;
+        n++;
+    }
+#endif
+    return n;
+}
+
+/*
+ * Eisel-Lemire: w * 10^q rounded to a double, as raw bits without the sign.
+ * Returns 0 and leaves *bits untouched when the 128-bit product is too close
+ * to a rounding boundary to decide.
+ */
+static int lept_eisel_lemire(uint64_t w, int64_t q, uint64_t* bits){
+    uint64_t lo, hi, lo2, hi2, mant;
+    int lz, upper, shift;
+    int64_t e2;
+    size_t index;
+    if(w == 0 || q < LEPT_POW5_MIN){
+        *bits = 0;
+        return 1;
+    }
+    if(q > LEPT_POW5_MAX){
+        *bits = (uint64_t)0x7FF << 52;
+        return 1;
+    }
+    lz = lept_clz64(w);
+    w <<= lz;
+    index = 2 * (size_t)(q - LEPT_POW5_MIN);
+    lo = lept_umul128(w, lept_pow5_128[index], &hi);
+    if((hi & 0x1FF) == 0x1FF){  /* the low 9 bits are discarded below, refine with the next 64 bits of 5^q */
+        lept_umul128(w, lept_pow5_128[index + 1], &hi2);
+        lo2 = lo + hi2;
+        if(lo2 < lo)
+            hi++;
+        lo = lo2;
+    }
+    if(lo == 0xFFFFFFFFFFFFFFFFULL && (q < -27 || q > 55))
+        return 0;
+    upper = (int)(hi >> 63);
+    shift = upper + 64 - 52 - 3;
+    mant = hi >> shift;
+    e2 = (((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023;  /* biased binary exponent */
+    if(e2 <= 0){
+        /* subnormal */
+        if(-e2 + 1 >= 64){
+            *bits = 0;
+            return 1;
+        }
+        mant >>= -e2 + 1;
+        mant += mant & 1;
+        mant >>= 1;
+        *bits = mant;   /* a carry into bit 52 is exactly the smallest normal */
+        return 1;
+    }
+    /* exactly halfway between two doubles: round to even instead of up */
+    if(lo <= 1 && q >= -4 && q <= 23 && (mant & 3) == 1 && (mant << shift) == hi)
+        mant &= ~(uint64_t)1;
+    mant += mant & 1;
+    mant >>= 1;
+    if(mant >= (uint64_t)2 << 52){
+        mant = (uint64_t)1 << 52;
+        e2++;
+    }
+    mant &= ~((uint64_t)1 << 52);
+    if(e2 >= 0x7FF){
+        *bits = (uint64_t)0x7FF << 52;
+        return 1;
+    }
+    *bits = mant | ((uint64_t)e2 << 52);
+    return 1;
+}
+
+/* exact fallback: multiply/divide a big decimal by powers of two (the classic "simple decimal conversion") */
+static void lept_decimal_trim(lept_decimal* a){
+    while(a->nd > 0 && a->d[a->nd - 1] == '0')
+        a->nd--;
+    if(a->nd == 0)
+        a->dp = 0;
+}
+
+static void lept_decimal_rshift(lept_decimal* a, unsigned k){
+    int r = 0, w = 0;
+    uint64_t n = 0, dig, mask = ((uint64_t)1 << k) - 1;
+    for(; (n >> k) == 0; r++){
+        if(r >= a->nd){
+            if(n == 0){
+                a->nd = 0;
+                return;
+            }
+            while((n >> k) == 0){
+                n *= 10;
+                r++;
+            }
+            break;
+        }
+        n = n * 10 + (a->d[r] - '0');
+    }
+    a->dp -= r - 1;
+    for(; r < a->nd; r++){
+        dig = n >> k;
+        n &= mask;
+        a->d[w++] = (char)('0' + dig);
+        n = n * 10 + (a->d[r] - '0');
+    }
+    while(n > 0){
+        dig = n >> k;
+        n &= mask;
+        if(w < LEPT_DECIMAL_DIGITS)
+            a->d[w++] = (char)('0' + dig);
+        else if(dig > 0)
+            a->trunc = 1;
+        n *= 10;
+    }
+    a->nd = w;
+    lept_decimal_trim(a);
+}
+
+static void lept_decimal_lshift(lept_decimal* a, unsigned k){
+    char buf[LEPT_DECIMAL_DIGITS + 24];
+    int r, w = (int)sizeof(buf), count;
+    uint64_t n = 0, quo;
+    for(r = a->nd - 1; r >= 0; r--){
+        n += (uint64_t)(a->d[r] - '0') << k;
+        quo = n / 10;
+        buf[--w] = (char)('0' + (n - quo * 10));
+        n = quo;
+    }
+    while(n > 0){
+        quo = n / 10;
+        buf[--w] = (char)('0' + (n - quo * 10));
+        n = quo;
+    }
+    count = (int)sizeof(buf) - w;
+    a->dp += count - a->nd;
+    if(count > LEPT_DECIMAL_DIGITS){
+        for(r = w + LEPT_DECIMAL_DIGITS; r < (int)sizeof(buf); r++)
+            if(buf[r] != '0')
+                a->trunc = 1;
+        count = LEPT_DECIMAL_DIGITS;
+    }
+    memcpy(a->d, buf + w, count);
+    a->nd = count;
+    lept_decimal_trim(a);
+}
+
+static void lept_decimal_shift(lept_decimal* a, int k){
+    if(a->nd == 0)
+        return;
+    for(; k > 60; k -= 60)
+        lept_decimal_lshift(a, 60);
+    for(; k < -60; k += 60)
+        lept_decimal_rshift(a, 60);
+    if(k > 0)
+        lept_decimal_lshift(a, (unsigned)k);
+    else if(k < 0)
+        lept_decimal_rshift(a, (unsigned)-k);
+}
+
+static uint64_t lept_decimal_rounded_integer(const lept_decimal* a){
+    uint64_t n = 0;
+    int i, up;
+    assert(a->dp <= 20);
+    for(i = 0; i < a->dp && i < a->nd; i++)
+        n = n * 10 + (a->d[i] - '0');
+    for(; i < a->dp; i++)
+        n *= 10;
+    if(a->dp < 0 || a->dp >= a->nd)
+        up = 0;
+    else if(a->d[a->dp] == '5' && a->dp + 1 == a->nd)  /* exactly halfway, round to even */
+        up = a->trunc || (a->dp > 0 && (a->d[a->dp - 1] - '0') % 2 == 1);
+    else
+        up = a->d[a->dp] >= '5';
+    return n + up;
+}
+
+static uint64_t lept_decimal_to_bits(lept_decimal* a){
+    static const int powtab[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+    int exp = 0, n;
+    uint64_t mant;
+    if(a->nd == 0 || a->dp < -330)
+        return 0;
+    if(a->dp > 310)
+        return (uint64_t)0x7FF << 52;
+    /* scale by powers of two into [0.5, 1) */
+    while(a->dp > 0){
+        n = a->dp >= 9 ? 27 : powtab[a->dp];
+        lept_decimal_shift(a, -n);
+        exp += n;
+    }
+    while(a->dp < 0 || (a->dp == 0 && a->d[0] < '5')){
+        n = -a->dp >= 9 ? 27 : powtab[-a->dp];
+        lept_decimal_shift(a, n);
+        exp -= n;
+    }
+    exp--;  /* now in [1, 2) */
+    if(exp < -1022){
+        lept_decimal_shift(a, -(-1022 - exp));
+        exp = -1022;
+    }
+    if(exp + 1023 >= 0x7FF)
+        return (uint64_t)0x7FF << 52;
+    lept_decimal_shift(a, 53);
+    mant = lept_decimal_rounded_integer(a);
+    if(mant == (uint64_t)2 << 52){
+        mant >>= 1;
+        exp++;
+        if(exp + 1023 >= 0x7FF)
+            return (uint64_t)0x7FF << 52;
+    }
+    if(!(mant & ((uint64_t)1 << 52)))
+        return mant;    /* subnormal */
+    return (mant & (((uint64_t)1 << 52) - 1)) | ((uint64_t)(exp + 1023) << 52);
+}
+
+/* reads the already validated number text [p, end) digit by digit */
+static uint64_t lept_decimal_parse(const char* p, const char* end){
+    lept_decimal a;
+    int sawdot = 0;
+    int digits = 0;     /* significant digits read, the dropped ones too: they still move the point */
+    int64_t e = 0;
+    int esign = 1;
+    a.nd = a.dp = a.trunc = 0;
+    if(*p == '-')
+        p++;
+    for(; p < end && (ISDIGIT(*p) || *p == '.'); p++){
+        if(*p == '.'){
+            sawdot = 1;
+            a.dp = digits;
+        }
+        else if(*p == '0' && a.nd == 0)
+            a.dp--;     /* leading zero */
+        else{
+            if(a.nd < LEPT_DECIMAL_DIGITS)
+                a.d[a.nd++] = *p;
+            else if(*p != '0')
+                a.trunc = 1;
+            digits++;
+        }
+    }
+    if(!sawdot)
+        a.dp = digits;
+    if(p < end){    /* 'e' or 'E' */
+        p++;
+        if(*p == '+' || *p == '-')
+            esign = *p++ == '-' ? -1 : 1;
+        for(; p < end; p++)
+            if(e < 100000)
+                e = e * 10 + (*p - '0');
+        a.dp += (int)(esign * e);
+    }
+    return lept_decimal_to_bits(&a);
+}
+
+static double lept_decimal_to_double(const char* start, const char* end, uint64_t m, int64_t e10, int trunc, int neg){
+    uint64_t bits, bits2;
+    double d;
+    if(m == 0)
+        return neg ? -0.0 : 0.0;
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0
+    /* Clinger: both m and 10^|e10| are exact doubles, so one IEEE operation rounds correctly */
+    if(!trunc && m <= ((uint64_t)1 << 53) && e10 >= -22 && e10 <= 22 + 15){
+        if(e10 > 22){
+            uint64_t scaled = m;
+            int64_t i;
+            for(i = 22; i < e10 && scaled <= ((uint64_t)1 << 53); i++)
+                scaled *= 10;
+            if(scaled <= ((uint64_t)1 << 53))
+                return neg ? -((double)scaled * 1e22) : (double)scaled * 1e22;
+        }
+        else{
+            d = (double)m;
+            d = e10 < 0 ? d / lept_pow10_exact[-e10] : d * lept_pow10_exact[e10];
+            return neg ? -d : d;
+        }
+    }
+#endif
+    if(lept_eisel_lemire(m, e10, &bits)){
+        /* with dropped digits the value lies in [m, m + 1) * 10^e10; both ends must agree */
+        if(!trunc || (lept_eisel_lemire(m + 1, e10, &bits2) && bits == bits2))
+            goto done;
+    }
+    bits = lept_decimal_parse(start, end);
+done:
+    if(neg)
+        bits |= (uint64_t)1 << 63;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
 static int lept_parse_number(lept_context*c, lept_value* v){
-    const char* p = c->json;
-    /* \TODO validate number */
-    if (*p == '-') p++;
-    if (*p == '0') p++;
+    const char* p = c->json, *end = c->end;
+    uint64_t m = 0;     /* first 19 significant digits */
+    int nd = 0;         /* significant digits in m */
+    int64_t e10 = 0;    /* the value is m * 10^e10, give or take dropped digits */
+    int neg = 0, trunc = 0;
+    if (PEEK(p, end) == '-') {
+        neg = 1;
+        p++;
+    }
+    if (PEEK(p, end) == '0') p++;
     else {
-        if (!ISDIGIT1TO9(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
+        if (!ISDIGIT1TO9(PEEK(p, end))) return LEPT_PARSE_INVALID_VALUE;
+        for (; ISDIGIT(PEEK(p, end)); p++) {
+            if (nd < 19) {
+                m = m * 10 + (*p - '0');
+                nd++;
+            }
+            else {
+                e10++;
+                trunc |= *p != '0';
+            }
+        }
     }
-    if (*p == '.') {
+    if (PEEK(p, end) == '.') {
         p++;
-        if (!ISDIGIT(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
+        if (!ISDIGIT(PEEK(p, end))) return LEPT_PARSE_INVALID_VALUE;
+        for (; ISDIGIT(PEEK(p, end)); p++) {
+            if (nd == 0 && *p == '0')
+                e10--;
+            else if (nd < 19) {
+                m = m * 10 + (*p - '0');
+                nd++;
+                e10--;
+            }
+            else
+                trunc |= *p != '0';
+        }
     }
-    if (*p == 'e' || *p == 'E') {
+    if (PEEK(p, end) == 'e' || PEEK(p, end) == 'E') {
+        int64_t x = 0;
+        int esign = 1;
         p++;
-        if (*p == '+' || *p == '-') p++;
-        if (!ISDIGIT(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
+        if (PEEK(p, end) == '+' || PEEK(p, end) == '-')
+            esign = *p++ == '-' ? -1 : 1;
+        if (!ISDIGIT(PEEK(p, end))) return LEPT_PARSE_INVALID_VALUE;
+        for (; ISDIGIT(PEEK(p, end)); p++)
+            if (x < 100000)     /* far past any double, the result is 0 or inf anyway */
+                x = x * 10 + (*p - '0');
+        e10 += esign * x;
     }
-    errno = 0;
-    v->u.n = strtod(c->json, NULL);
-    if (errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL))
+    v->u.n = lept_decimal_to_double(c->json, p, m, e10, trunc, neg);
+    if (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL)
         return LEPT_PARSE_NUMBER_TOO_BIG;
     c->json = p;
     v->type = LEPT_NUMBER;
@@ -112,13 +768,14 @@ static int lept_parse_number(lept_context*c, lept_value* v){
 
 //value = false/true/null
 static int lept_parse_value(lept_context*c, lept_value* v){
+    if (c->json == c->end)
+        return LEPT_PARSE_EXPECT_VALUE;
     switch (*c->json)
     {
     case 'n': return lept_parse_literal(c, v, "null", LEPT_NULL);
     case 't': return lept_parse_literal(c, v, "true", LEPT_TRUE);
     case 'f': return lept_parse_literal(c, v, "false", LEPT_FALSE);
     case '"': return lept_parse_string(c, v);
-    case '\0': return LEPT_PARSE_EXPECT_VALUE;
     case '[': return lept_parse_array(c, v);
     case '{': return lept_parse_object(c, v);
     default: return lept_parse_number(c, v);
@@ -129,27 +786,34 @@ static int lept_parse_value(lept_context*c, lept_value* v){
 void lept_free(lept_value* v){
     assert( v != NULL);
     size_t i;
+    /* borrowed storage is left to its owner, but children may still own theirs */
+    int owned = !(v->flags & LEPT_FLAG_BORROWED);
     switch (v->type)
     {
     case LEPT_STRING:
-        free(v->u.s.s);
+        if(owned && !(v->flags & LEPT_FLAG_SHORT))
+            free(v->u.s.s);
         break;
     case LEPT_ARRAY:
         for(i = 0; i < v->u.a.size; i++)
             lept_free(&v->u.a.e[i]);
-        free(v->u.a.e);
+        if(owned)
+            free(v->u.a.e);
         break;
     case LEPT_OBJECT:
         for(i =0; i < v->u.o.size; i++){
-            free(v->u.o.m[i].k);
+            if(!(v->flags & LEPT_FLAG_BORROWED_KEYS))
+                free(v->u.o.m[i].k);
             lept_free(&v->u.o.m[i].v);
         }
-        free(v->u.o.m);
+        if(owned)
+            free(v->u.o.m);
         break;
     default:
         break;
     }
     v->type = LEPT_NULL;
+    v->flags = 0;
 }
 
 //number
@@ -178,24 +842,33 @@ void lept_set_boolean(lept_value* v, int b){
 }
 
 //string
+/* up to LEPT_SHORT_STRING_MAX bytes are kept inside the value, with the length in its flags */
 void lept_set_string(lept_value* v, const char* s, size_t len){
     assert(v != NULL && (s != NULL || len == 0) );
     lept_free(v);
-    v->u.s.s = (char*)malloc(len + 1);
-    memcpy(v->u.s.s, s, len);
-    v->u.s.s[len] = '\0';
-    v->u.s.len = len;
+    if(len <= LEPT_SHORT_STRING_MAX){
+        if(len > 0)
+            memcpy(v->u.ss, s, len);
+        v->u.ss[len] = '\0';
+        v->flags = LEPT_FLAG_SHORT | (unsigned)len << LEPT_SHORT_SHIFT;
+    }
+    else{
+        v->u.s.s = (char*)malloc(len + 1);
+        memcpy(v->u.s.s, s, len);
+        v->u.s.s[len] = '\0';
+        v->u.s.len = len;
+    }
     v->type = LEPT_STRING;
 }
 
 const char* lept_get_string(const lept_value* v){
     assert(v != NULL && v->type == LEPT_STRING);
-    return v->u.s.s;
+    return v->flags & LEPT_FLAG_SHORT ? v->u.ss : v->u.s.s;
 }
 
 size_t lept_get_string_length(const lept_value* v){
     assert(v != NULL && v->type == LEPT_STRING);
-    return v->u.s.len;
+    return v->flags & LEPT_FLAG_SHORT ? v->flags >> LEPT_SHORT_SHIFT : v->u.s.len;
 }
 
 //array
@@ -215,20 +888,30 @@ size_t lept_get_array_capacity(const lept_value* v) {
     return v->u.a.capacity;
 }
 
+/* a borrowed element buffer cannot be realloc'ed, it moves to the heap instead */
+static void lept_realloc_array(lept_value* v, size_t capacity) {
+    if (v->flags & LEPT_FLAG_BORROWED) {
+        lept_value* e = capacity > 0 ? (lept_value*)malloc(capacity * sizeof(lept_value)) : NULL;
+        if (v->u.a.size > 0)
+            memcpy(e, v->u.a.e, v->u.a.size * sizeof(lept_value));
+        v->u.a.e = e;
+        v->flags &= ~LEPT_FLAG_BORROWED;
+    }
+    else
+        v->u.a.e = (lept_value*)realloc(v->u.a.e, capacity * sizeof(lept_value));
+    v->u.a.capacity = capacity;
+}
+
 void lept_reserve_array(lept_value* v, size_t capacity) {
     assert(v != NULL && v->type == LEPT_ARRAY);
-    if (v->u.a.capacity < capacity) {
-        v->u.a.capacity = capacity;
-        v->u.a.e = (lept_value*)realloc(v->u.a.e, capacity * sizeof(lept_value));
-    }
+    if (v->u.a.capacity < capacity)
+        lept_realloc_array(v, capacity);
 }
 
 void lept_shrink_array(lept_value* v) {
     assert(v != NULL && v->type == LEPT_ARRAY);
-    if (v->u.a.capacity > v->u.a.size) {
-        v->u.a.capacity = v->u.a.size;
-        v->u.a.e = (lept_value*)realloc(v->u.a.e, v->u.a.capacity * sizeof(lept_value));
-    }
+    if (v->u.a.capacity > v->u.a.size)
+        lept_realloc_array(v, v->u.a.size);
 }
 
 void lept_set_array(lept_value* v, size_t capacity){
@@ -279,13 +962,185 @@ lept_value* lept_get_object_value(const lept_value* v, size_t index){
 }
 
 //dynamic obect part
+/*
+ * An object with a capacity of LEPT_OBJECT_INDEX_THRESHOLD or more keeps a hash
+ * index of its keys in the same block, right after the member array. Its size
+ * follows from the capacity, so it needs no pointer of its own; it is built when
+ * the block is allocated and rebuilt when members move.
+ */
+#ifndef LEPT_OBJECT_INDEX_THRESHOLD
+#define LEPT_OBJECT_INDEX_THRESHOLD 16
+#endif
+
+typedef struct {
+    uint32_t hash;
+    uint32_t index;     /* member index + 1, 0 for a free slot */
+}lept_index_slot;
+
+#define LEPT_OBJECT_INDEX(v) ((lept_index_slot*)((v)->u.o.m + (v)->u.o.capacity))
+
+/* power of two, at most half full */
+static size_t lept_index_slots(size_t capacity){
+    size_t n = LEPT_OBJECT_INDEX_THRESHOLD;
+    if(capacity < LEPT_OBJECT_INDEX_THRESHOLD || capacity > 0x7FFFFFFF)
+        return 0;
+    while(n < capacity * 2)
+        n <<= 1;
+    return n;
+}
+
+static size_t lept_object_bytes(size_t capacity){
+    return capacity * sizeof(lept_member) + lept_index_slots(capacity) * sizeof(lept_index_slot);
+}
+
+/* FNV-1a */
+static uint32_t lept_hash_key(const char* k, size_t klen){
+    uint32_t h = 2166136261u;
+    size_t i;
+    for(i = 0; i < klen; i++)
+        h = (h ^ (unsigned char)k[i]) * 16777619u;
+    return h;
+}
+
+static void lept_index_insert(lept_value* v, size_t index){
+    lept_index_slot* slot = LEPT_OBJECT_INDEX(v);
+    size_t mask = lept_index_slots(v->u.o.capacity) - 1;
+    uint32_t h = lept_hash_key(v->u.o.m[index].k, v->u.o.m[index].klen);
+    size_t i = h & mask;
+    while(slot[i].index != 0)
+        i = (i + 1) & mask;
+    slot[i].hash = h;
+    slot[i].index = (uint32_t)index + 1;
+}
+
+static void lept_index_build(lept_value* v){
+    size_t i, slots = lept_index_slots(v->u.o.capacity);
+    if(slots == 0)
+        return;
+    memset(LEPT_OBJECT_INDEX(v), 0, slots * sizeof(lept_index_slot));
+    for(i = 0; i < v->u.o.size; i++)
+        lept_index_insert(v, i);
+}
+
+static size_t lept_index_find(const lept_value* v, const char* key, size_t klen){
+    const lept_index_slot* slot = LEPT_OBJECT_INDEX(v);
+    size_t mask = lept_index_slots(v->u.o.capacity) - 1;
+    uint32_t h = lept_hash_key(key, klen);
+    size_t i;
+    for(i = h & mask; slot[i].index != 0; i = (i + 1) & mask)
+        if(slot[i].hash == h){
+            const lept_member* m = &v->u.o.m[slot[i].index - 1];
+            if(m->klen == klen && (m->k == key || memcmp(m->k, key, klen) == 0))
+                return slot[i].index - 1;
+        }
+    return LEPT_KEY_NOT_EXIST;
+}
+
+/* a borrowed member buffer cannot be realloc'ed, it moves to the heap instead */
+static void lept_realloc_object(lept_value* v, size_t capacity){
+    if(v->flags & LEPT_FLAG_BORROWED){
+        lept_member* m = capacity > 0 ? (lept_member*)malloc(lept_object_bytes(capacity)) : NULL;
+        if(v->u.o.size > 0)
+            memcpy(m, v->u.o.m, v->u.o.size * sizeof(lept_member));
+        v->u.o.m = m;
+        v->flags &= ~LEPT_FLAG_BORROWED;
+    }
+    else
+        v->u.o.m = (lept_member*)realloc(v->u.o.m, lept_object_bytes(capacity));
+    v->u.o.capacity = capacity;
+    lept_index_build(v);
+}
+
+/* copies borrowed keys to the heap, so that keys added next can be freed along with them */
+static void lept_own_object_keys(lept_value* v){
+    size_t i;
+    if(!(v->flags & LEPT_FLAG_BORROWED_KEYS))
+        return;
+    for(i = 0; i < v->u.o.size; i++){
+        lept_member* m = &v->u.o.m[i];
+        char* k = (char*)malloc(m->klen + 1);
+        memcpy(k, m->k, m->klen);
+        k[m->klen] = '\0';
+        m->k = k;
+    }
+    v->flags &= ~LEPT_FLAG_BORROWED_KEYS;
+}
+
+void lept_set_object(lept_value* v, size_t capacity){
+    assert(v != NULL);
+    lept_free(v);
+    v->type = LEPT_OBJECT;
+    v->u.o.size = 0;
+    v->u.o.capacity = capacity;
+    v->u.o.m = capacity > 0 ? (lept_member*)malloc(lept_object_bytes(capacity)) : NULL;
+    lept_index_build(v);
+}
+
+size_t lept_get_object_capacity(const lept_value* v){
+    assert(v != NULL && v->type == LEPT_OBJECT);
+    return v->u.o.capacity;
+}
+
+void lept_reserve_object(lept_value* v, size_t capacity){
+    assert(v != NULL && v->type == LEPT_OBJECT);
+    if(v->u.o.capacity < capacity)
+        lept_realloc_object(v, capacity);
+}
+
+void lept_shrink_object(lept_value* v){
+    assert(v != NULL && v->type == LEPT_OBJECT);
+    if(v->u.o.capacity > v->u.o.size)
+        lept_realloc_object(v, v->u.o.size);
+}
+
+void lept_clear_object(lept_value* v){
+    size_t i;
+    assert(v != NULL && v->type == LEPT_OBJECT);
+    for(i = 0; i < v->u.o.size; i++){
+        if(!(v->flags & LEPT_FLAG_BORROWED_KEYS))
+            free(v->u.o.m[i].k);
+        lept_free(&v->u.o.m[i].v);
+    }
+    v->u.o.size = 0;
+    lept_index_build(v);
+}
+
+lept_value* lept_set_object_value(lept_value* v, const char* key, size_t klen){
+    size_t index;
+    lept_member* m;
+    assert(v != NULL && v->type == LEPT_OBJECT && key != NULL);
+    if((index = lept_find_object_index(v, key, klen)) != LEPT_KEY_NOT_EXIST)
+        return &v->u.o.m[index].v;
+    lept_own_object_keys(v);
+    if(v->u.o.size == v->u.o.capacity)
+        lept_reserve_object(v, v->u.o.capacity == 0 ? 1 : v->u.o.capacity * 2);
+    m = &v->u.o.m[v->u.o.size];
+    memcpy(m->k = (char*)malloc(klen + 1), key, klen);
+    m->k[klen] = '\0';
+    m->klen = klen;
+    lept_init(&m->v);
+    if(lept_index_slots(v->u.o.capacity) > 0)
+        lept_index_insert(v, v->u.o.size);
+    return &v->u.o.m[v->u.o.size++].v;
+}
+
+void lept_remove_object_value(lept_value* v, size_t index){
+    assert(v != NULL && v->type == LEPT_OBJECT && index < v->u.o.size);
+    if(!(v->flags & LEPT_FLAG_BORROWED_KEYS))
+        free(v->u.o.m[index].k);
+    lept_free(&v->u.o.m[index].v);
+    memmove(v->u.o.m + index, v->u.o.m + index + 1, (v->u.o.size - index - 1) * sizeof(lept_member));
+    v->u.o.size--;
+    lept_index_build(v);
+}
 
 // unicode
-static const char* lept_parse_hex4(const char* p, unsigned *u){
+static const char* lept_parse_hex4(const char* p, const char* end, unsigned *u){
     int i;
     *u = 0;
     for(i = 0; i < 4; ++i){
-        char ch = *p++;
+        char ch = PEEK(p, end);
+        p++;
         *u <<= 4;
         if ( ch >= '0' && ch <= '9' ) *u |= ch - '0';
         else if ( ch >= 'A' && ch <= 'F') *u |= ch - ('A' - 10);
@@ -303,44 +1158,117 @@ static const char* lept_parse_hex4(const char* p, unsigned *u){
     // return end == p + 4 ? end : NULL;
 }
 
-void lept_encode_utf8(lept_context* c, unsigned u){
-    if( u <= 0x7F )
-        PUTC(c, u & 0xFF);
+static size_t lept_encode_utf8(char* out, unsigned u){
+    if( u <= 0x7F ){
+        out[0] = u & 0xFF;
+        return 1;
+    }
     else if ( u <= 0x7FF ){
-        PUTC(c, 0xC0 | ((u >> 6) & 0xFF) );
-        PUTC(c, 0x80 | (u        & 0x3F));
+        out[0] = 0xC0 | ((u >> 6) & 0xFF);
+        out[1] = 0x80 | (u        & 0x3F);
+        return 2;
     }
     else if ( u <= 0xFFFF ){
-        PUTC(c, 0xE0 | ((u >> 12) & 0xFF) );
-        PUTC(c, 0x80 | ((u >> 6 ) & 0x3F) );
-        PUTC(c, 0x80 | (u         & 0x3F) );
+        out[0] = 0xE0 | ((u >> 12) & 0xFF);
+        out[1] = 0x80 | ((u >> 6 ) & 0x3F);
+        out[2] = 0x80 | (u         & 0x3F);
+        return 3;
     }
     else{
         assert( u <= 0x10FFFF );
-        PUTC(c, 0xF0 | ((u >> 18) & 0xFF));
-        PUTC(c, 0x80 | ((u >> 12) & 0x3F));
-        PUTC(c, 0x80 | ((u >>  6) & 0x3F));
-        PUTC(c, 0x80 | ( u        & 0x3F));
+        out[0] = 0xF0 | ((u >> 18) & 0xFF);
+        out[1] = 0x80 | ((u >> 12) & 0x3F);
+        out[2] = 0x80 | ((u >>  6) & 0x3F);
+        out[3] = 0x80 | ( u        & 0x3F);
+        return 4;
+    }
+}
+
+/*
+ * decodes the escape after a backslash at *pp into at most 4 bytes at out and moves *pp past it;
+ * never writes more bytes than it reads, so out may point into the input behind *pp
+ */
+static int lept_parse_escape(const char** pp, const char* end, char* out, size_t* n){
+    const char* p = *pp;
+    unsigned u, u2;
+    if(p == end)
+        return LEPT_PARSE_INVALID_STRING_ESCAPE;
+    switch(*p++){
+        case '\"' : *out = '\"';  break;
+        case '\\' : *out = '\\';  break;
+        case '/' : *out = '/';    break;
+        case 'b' : *out = '\b';  break;
+        case 'f' : *out = '\f';  break;
+        case 'n' : *out = '\n';  break;
+        case 'r' : *out = '\r';  break;
+        case 't' : *out = '\t';  break;
+
+        case 'u':
+            if( !(p = lept_parse_hex4(p, end, &u)) )
+                return LEPT_PARSE_INVALID_UNICODE_HEX;
+            if( u>= 0xD800 && u <= 0xDBFF ){
+                if(PEEK(p, end) != '\\' || PEEK(p + 1, end) != 'u')
+                    return LEPT_PARSE_INVALID_UNICODE_SURROGATE;
+                if( !(p = lept_parse_hex4(p + 2, end, &u2)) )
+                    return LEPT_PARSE_INVALID_UNICODE_HEX;
+                if( u2 < 0xDC00 || u2 > 0xDFFF )
+                    return LEPT_PARSE_INVALID_UNICODE_SURROGATE;
+                u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
+            }
+            *n = lept_encode_utf8(out, u);
+            *pp = p;
+            return LEPT_PARSE_OK;
+
+        default:
+            return LEPT_PARSE_INVALID_STRING_ESCAPE;
     }
+    *n = 1;
+    *pp = p;
+    return LEPT_PARSE_OK;
 }
 
 static int lept_parse_string(lept_context* c, lept_value* v) {
     int ret;
     char* s;
     size_t len;
-    if ((ret = lept_parse_string_raw(c, &s, &len)) == LEPT_PARSE_OK)
-        lept_set_string(v, s, len);
+    if (c->insitu) {
+        if ((ret = lept_parse_string_insitu(c, &s, &len)) == LEPT_PARSE_OK) {
+            v->u.s.s = s;
+            v->u.s.len = len;
+            v->type = LEPT_STRING;
+            v->flags = LEPT_FLAG_BORROWED;
+        }
+    }
+    else if ((ret = lept_parse_string_raw(c, &s, &len)) == LEPT_PARSE_OK) {
+        if (c->doc && len > LEPT_SHORT_STRING_MAX) {
+            memcpy(v->u.s.s = (char*)lept_context_alloc(c, len + 1), s, len);
+            v->u.s.s[len] = '\0';
+            v->u.s.len = len;
+            v->type = LEPT_STRING;
+            v->flags = LEPT_FLAG_BORROWED;
+        }
+        else
+            lept_set_string(v, s, len);
+    }
     return ret;
 }
 
 static int lept_parse_string_raw(lept_context* c, char** str, size_t* len){
     size_t head = c->top;
     const char* p;
-    unsigned u, u2;
     EXPECT(c, '\"');
     p = c->json;
     for(;;){
-        char ch = *p++;
+        /* copy the run up to the next quote, backslash or control char in one push */
+        const char* q = lept_scan_string(p, c->end);
+        char ch;
+        if(q != p){
+            PUTS(c, p, q - p);
+            p = q;
+        }
+        if(p == c->end)
+            STRING_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK);
+        ch = *p++;
         switch(ch){
             case '\"':
                 *len = c->top - head;
@@ -348,71 +1276,82 @@ static int lept_parse_string_raw(lept_context* c, char** str, size_t* len){
                 *str = lept_context_pop(c, *len);
                 c->json = p;
                 return LEPT_PARSE_OK;
-            case '\0':
-                c->top = head;
-                return LEPT_PARSE_MISS_QUOTATION_MARK;
-            case '\\':
-                switch(*p++){
-                    case '\"' : PUTC(c, '\"');  break;
-                    case '\\' : PUTC(c, '\\');  break;
-                    case '/' : PUTC(c, '/');    break;
-                    case 'b' : PUTC(c, '\b');  break;
-                    case 'f' : PUTC(c, '\f');  break;
-                    case 'n' : PUTC(c, '\n');  break;
-                    case 'r' : PUTC(c, '\r');  break;
-                    case 't' : PUTC(c, '\t');  break;
-
-                    case 'u':
-                        if( !(p = lept_parse_hex4(p, &u)) )
-                            STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_HEX);
-                        if( u>= 0xD800 && u <= 0xDBFF ){
-                            if(*p++ != '\\')
-                                STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE);
-                            if(*p++ != 'u')
-                                STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE);
-                            if( !(p = lept_parse_hex4(p, &u2)) )
-                                STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_HEX);
-                            if( u2 < 0xDC00 || u2 > 0xDFFF )
-                                STRING_ERROR(LEPT_PARSE_INVALID_UNICODE_SURROGATE);
-                            u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
-                        }
-                        lept_encode_utf8(c, u);
-                        break;
-
-                    default:
-                        // c->top = head;
-                        // return LEPT_PARSE_INVALID_STRING_ESCAPE;
-                        STRING_ERROR(LEPT_PARSE_INVALID_STRING_ESCAPE);
-                }
+            case '\\': {
+                char buf[4];
+                size_t n;
+                int ret;
+                if((ret = lept_parse_escape(&p, c->end, buf, &n)) != LEPT_PARSE_OK)
+                    STRING_ERROR(ret);
+                PUTS(c, buf, n);
                 break;
+            }
             default:
-                if( (unsigned char)ch < 0x20 ){
-                    c->top = head;
-                    return LEPT_PARSE_INVALID_STRING_CHAR;
-                }
-                PUTC(c, ch);
+                /* the scanner only stops at other bytes for control characters, an embedded NUL included */
+                assert( (unsigned char)ch < 0x20 );
+                c->top = head;
+                return LEPT_PARSE_INVALID_STRING_CHAR;
         }
     }
 }
 
-//parse array
-static int lept_parse_array(lept_context*c, lept_value* v){
-    size_t size = 0;
-    size_t i;
+/* same as lept_parse_string_raw(), but decodes into the input buffer itself and leaves the result there */
+static int lept_parse_string_insitu(lept_context* c, char** str, size_t* len){
+    char* head, *dst;
+    const char* p;
     int ret;
-    EXPECT(c, '[');
-    lept_parse_whitespace(c);
-    if(*c->json == ']'){
+    size_t n;
+    EXPECT(c, '\"');
+    p = c->json;
+    head = dst = (char*)c->json;
+    for(;;){
+        const char* q = lept_scan_string(p, c->end);
+        char ch;
+        if(q != p){
+            if(dst != p)
+                memmove(dst, p, q - p);
+            dst += q - p;
+            p = q;
+        }
+        if(p == c->end)
+            return LEPT_PARSE_MISS_QUOTATION_MARK;
+        ch = *p++;
+        switch(ch){
+            case '\"':
+                *dst = '\0';     /* lands at or before the closing quote */
+                *str = head;
+                *len = dst - head;
+                c->json = p;
+                return LEPT_PARSE_OK;
+            case '\\':
+                if((ret = lept_parse_escape(&p, c->end, dst, &n)) != LEPT_PARSE_OK)
+                    return ret;
+                dst += n;
+                break;
+            default:
+                assert( (unsigned char)ch < 0x20 );
+                return LEPT_PARSE_INVALID_STRING_CHAR;
+        }
+    }
+}
+
+//parse array
+static int lept_parse_array(lept_context*c, lept_value* v){
+    size_t size = 0;
+    size_t i;
+    int ret;
+    EXPECT(c, '[');
+    lept_parse_whitespace(c);
+    if(PEEK(c->json, c->end) == ']'){
         c->json++;
         v->type = LEPT_ARRAY;
-        v->u.a.size = 0;
+        v->u.a.size = v->u.a.capacity = 0;
         v->u.a.e = NULL;
         return LEPT_PARSE_OK;
     }
     for(;;){
         lept_value e;
         lept_init(&e);
-        if( (ret = lept_parse_value(c, &e) != LEPT_PARSE_OK) ){
+        if( (ret = lept_parse_value(c, &e)) != LEPT_PARSE_OK ){
             // lept_context_pop(c, size);
             // return ret;
             break;
@@ -420,17 +1359,17 @@ static int lept_parse_array(lept_context*c, lept_value* v){
         memcpy(lept_context_push(c, sizeof(lept_value)), &e, sizeof(lept_value));
         size++;
         lept_parse_whitespace(c);
-        if(*c->json == ','){
+        if(PEEK(c->json, c->end) == ','){
             c->json++;
             lept_parse_whitespace(c);
         }
-        else if(*c->json == ']'){
+        else if(PEEK(c->json, c->end) == ']'){
             c->json++;
-            // v->type = LEPT_ARRAY;
-            lept_set_array(v, size);
-            v->u.a.size = size;
+            v->type = LEPT_ARRAY;
+            v->flags = c->doc ? LEPT_FLAG_BORROWED : 0;
+            v->u.a.size = v->u.a.capacity = size;
             size *= sizeof(lept_value);
-            memcpy(v->u.a.e = (lept_value*)malloc(size), lept_context_pop(c, size), size);
+            memcpy(v->u.a.e = (lept_value*)lept_context_alloc(c, size), lept_context_pop(c, size), size);
             return LEPT_PARSE_OK;
         }
         else{
@@ -452,11 +1391,11 @@ static int lept_parse_object(lept_context* c, lept_value* v){
     int ret;
     EXPECT(c, '{');
     lept_parse_whitespace(c);
-    if(*c->json == '}'){
+    if(PEEK(c->json, c->end) == '}'){
         c->json++;
         v->type = LEPT_OBJECT;
         v->u.o.m = 0;
-        v->u.o.size = 0;
+        v->u.o.size = v->u.o.capacity = 0;
         return LEPT_PARSE_OK;
     }
     m.k = NULL;
@@ -464,109 +1403,2728 @@ static int lept_parse_object(lept_context* c, lept_value* v){
     for(;;){
         lept_init(&m.v);
         char* str;
+        int keep = LEPT_PROJECT_ALL;
         /* 1. parse k&klen */
-        if(*c->json != '"'){
+        if(PEEK(c->json, c->end) != '"'){
             ret = LEPT_PARSE_MISS_KEY;
             break;
         }
-        if( (ret = lept_parse_string_raw(c, &str, &m.klen)) != LEPT_PARSE_OK )
-            break;
-        memcpy( m.k = (char*)malloc(m.klen+1), str, m.klen );
-        m.k[m.klen] = '\0';
+        if(c->insitu){
+            if( (ret = lept_parse_string_insitu(c, &m.k, &m.klen)) != LEPT_PARSE_OK )
+                break;
+            if(c->project && (keep = lept_project_enter(c->project, m.k, m.klen)) == LEPT_PROJECT_NONE)
+                m.k = NULL;
+        }
+        else{
+            if( (ret = lept_parse_string_raw(c, &str, &m.klen)) != LEPT_PARSE_OK )
+                break;
+            if(c->project)
+                keep = lept_project_enter(c->project, str, m.klen);
+            /* a member left out of a projection never gets its key copied */
+            if(keep == LEPT_PROJECT_NONE)
+                m.k = NULL;
+            else if(c->keys)
+                m.k = (char*)lept_intern(c->keys, str, m.klen);
+            else{
+                memcpy( m.k = (char*)lept_context_alloc(c, m.klen+1), str, m.klen );
+                m.k[m.klen] = '\0';
+            }
+        }
         /* 2. parse ws colon ws */
         lept_parse_whitespace(c);
-        if(*c->json != ':'){
+        if(PEEK(c->json, c->end) != ':'){
             ret = LEPT_PARSE_MISS_COLON;
             break;
         }
         c->json++;
         lept_parse_whitespace(c);
-        /* 3. parse value */
-        if(ret = lept_parse_value(c, &m.v) != LEPT_PARSE_OK)
-            break;
-        memcpy(lept_context_push(c, sizeof(lept_member)), &m, sizeof(lept_member));
-        size++;
+        /* 3. parse value, or only check one left out of the projection */
+        if(keep == LEPT_PROJECT_NONE){
+            static const lept_handler check_only = { NULL };    /* no callbacks, the sax parser just checks the value */
+            if((ret = lept_sax_value(c, &check_only, NULL)) != LEPT_PARSE_OK)
+                break;
+        }
+        else if(keep == LEPT_PROJECT_SOME){
+            ret = lept_parse_value(c, &m.v);
+            lept_project_leave(c->project);
+            if(ret != LEPT_PARSE_OK)
+                break;
+        }
+        else{
+            lept_projection* project = c->project;
+            c->project = NULL;
+            ret = lept_parse_value(c, &m.v);
+            if((c->project = project) != NULL)
+                lept_project_leave(project);
+            if(ret != LEPT_PARSE_OK)
+                break;
+        }
+        if(keep != LEPT_PROJECT_NONE){
+            memcpy(lept_context_push(c, sizeof(lept_member)), &m, sizeof(lept_member));
+            size++;
+        }
         m.k = NULL; /* ownership is transferred to member on stack */
         /* 4. parse ws [comma | right-curly-brace] ws */
         lept_parse_whitespace(c);
-        if(*c->json == ','){
+        if(PEEK(c->json, c->end) == ','){
             c->json++;
             lept_parse_whitespace(c);
         }
-        else if(*c->json == '}'){
+        else if(PEEK(c->json, c->end) == '}'){
             size_t s = size * sizeof(lept_member);
             c->json++;
             v->type = LEPT_OBJECT;
-            v->u.o.size= size;
+            v->flags = c->doc ? LEPT_FLAG_BORROWED | LEPT_FLAG_BORROWED_KEYS : c->insitu || c->keys ? LEPT_FLAG_BORROWED_KEYS : 0;
+            v->u.o.size = v->u.o.capacity = size;
             // size *= sizeof(lept_member);
-            memcpy(v->u.o.m = (lept_member*)malloc(s), lept_context_pop(c, s), s);
+            memcpy(v->u.o.m = (lept_member*)lept_context_alloc(c, lept_object_bytes(size)), lept_context_pop(c, s), s);
+            lept_index_build(v);
             return LEPT_PARSE_OK;
         }
         else{
-            ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
-            break;
+            ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        }
+    }
+    if(!c->doc && !c->insitu && !c->keys)
+        free(m.k);      //free(NULL) is ok here
+    for (i = 0; i < size; i++){
+        lept_member* m = (lept_member*)lept_context_pop(c, sizeof(lept_member));
+        if(!c->doc && !c->insitu && !c->keys)
+            free(m->k);
+        lept_free(&m->v);
+    }
+    v->type = LEPT_NULL;
+    return ret;
+}
+
+//sax
+#define SAX_CALL(call) do{ if(!(call)) return LEPT_PARSE_HANDLER_STOP; }while(0)
+
+/* the same grammar as lept_parse_value() and friends, with events instead of nodes */
+static int lept_sax_value(lept_context* c, const lept_handler* h, void* ud){
+    lept_value v;
+    char* s;
+    size_t len;
+    int ret;
+    if (c->json == c->end)
+        return LEPT_PARSE_EXPECT_VALUE;
+    lept_init(&v);
+    switch (*c->json)
+    {
+    case 'n':
+        if ((ret = lept_parse_literal(c, &v, "null", LEPT_NULL)) == LEPT_PARSE_OK && h->null)
+            SAX_CALL(h->null(ud));
+        return ret;
+    case 't':
+        if ((ret = lept_parse_literal(c, &v, "true", LEPT_TRUE)) == LEPT_PARSE_OK && h->boolean)
+            SAX_CALL(h->boolean(ud, 1));
+        return ret;
+    case 'f':
+        if ((ret = lept_parse_literal(c, &v, "false", LEPT_FALSE)) == LEPT_PARSE_OK && h->boolean)
+            SAX_CALL(h->boolean(ud, 0));
+        return ret;
+    case '"':
+        if ((ret = lept_parse_string_raw(c, &s, &len)) == LEPT_PARSE_OK && h->string)
+            SAX_CALL(h->string(ud, s, len));
+        return ret;
+    case '[': return lept_sax_array(c, h, ud);
+    case '{': return lept_sax_object(c, h, ud);
+    default:
+        if ((ret = lept_parse_number(c, &v)) == LEPT_PARSE_OK && h->number)
+            SAX_CALL(h->number(ud, v.u.n));
+        return ret;
+    }
+}
+
+static int lept_sax_array(lept_context* c, const lept_handler* h, void* ud){
+    size_t size = 0;
+    int ret;
+    EXPECT(c, '[');
+    if(h->start_array)
+        SAX_CALL(h->start_array(ud));
+    lept_parse_whitespace(c);
+    if(PEEK(c->json, c->end) != ']'){
+        for(;;){
+            if((ret = lept_sax_value(c, h, ud)) != LEPT_PARSE_OK)
+                return ret;
+            size++;
+            lept_parse_whitespace(c);
+            if(PEEK(c->json, c->end) == ','){
+                c->json++;
+                lept_parse_whitespace(c);
+            }
+            else if(PEEK(c->json, c->end) == ']')
+                break;
+            else
+                return LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+    }
+    c->json++;
+    if(h->end_array)
+        SAX_CALL(h->end_array(ud, size));
+    return LEPT_PARSE_OK;
+}
+
+static int lept_sax_object(lept_context* c, const lept_handler* h, void* ud){
+    size_t size = 0, klen;
+    char* k;
+    int ret;
+    EXPECT(c, '{');
+    if(h->start_object)
+        SAX_CALL(h->start_object(ud));
+    lept_parse_whitespace(c);
+    if(PEEK(c->json, c->end) != '}'){
+        for(;;){
+            if(PEEK(c->json, c->end) != '"')
+                return LEPT_PARSE_MISS_KEY;
+            if((ret = lept_parse_string_raw(c, &k, &klen)) != LEPT_PARSE_OK)
+                return ret;
+            if(h->key)
+                SAX_CALL(h->key(ud, k, klen));
+            lept_parse_whitespace(c);
+            if(PEEK(c->json, c->end) != ':')
+                return LEPT_PARSE_MISS_COLON;
+            c->json++;
+            lept_parse_whitespace(c);
+            if((ret = lept_sax_value(c, h, ud)) != LEPT_PARSE_OK)
+                return ret;
+            size++;
+            lept_parse_whitespace(c);
+            if(PEEK(c->json, c->end) == ','){
+                c->json++;
+                lept_parse_whitespace(c);
+            }
+            else if(PEEK(c->json, c->end) == '}')
+                break;
+            else
+                return LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        }
+    }
+    c->json++;
+    if(h->end_object)
+        SAX_CALL(h->end_object(ud, size));
+    return LEPT_PARSE_OK;
+}
+
+int lept_parse_sax(const char* json, const lept_handler* h, void* ud){
+    lept_context c;
+    int ret;
+    assert(json != NULL && h != NULL);
+    lept_context_init(&c, json, strlen(json));
+    lept_parse_whitespace(&c);
+    if((ret = lept_sax_value(&c, h, ud)) == LEPT_PARSE_OK){
+        lept_parse_whitespace(&c);
+        if(c.json != c.end)
+            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    free(c.stack);
+    return ret;
+}
+
+//push
+#define LEPT_PUSH_ROOT ((size_t)-1)
+#define ISDELIM(ch)     (ISWS(ch) || (ch) == '[' || (ch) == ']' || (ch) == '{' || (ch) == '}' || (ch) == ',' || (ch) == ':' || (ch) == '"')
+
+/* what the parser waits for next, the LEPT_PUSH_IN_* states are inside a token */
+enum {
+    LEPT_PUSH_VALUE,
+    LEPT_PUSH_ARRAY_FIRST,          /* a value or ']' */
+    LEPT_PUSH_OBJECT_FIRST,         /* a key or '}' */
+    LEPT_PUSH_KEY,
+    LEPT_PUSH_COLON,
+    LEPT_PUSH_AFTER_VALUE,          /* ',' or the closing bracket, only whitespace at the top level */
+    LEPT_PUSH_IN_STRING,
+    LEPT_PUSH_IN_KEY,
+    LEPT_PUSH_IN_SCALAR             /* a number or a literal, up to the next delimiter */
+};
+
+/* pushed on the stack when a container opens, its elements and members follow it */
+struct lept_push_frame{
+    size_t parent;                  /* offset of the enclosing frame, LEPT_PUSH_ROOT at the top level */
+    size_t size;                    /* elements or members pushed so far */
+    char* k; size_t klen;           /* object: the key waiting for its value */
+    lept_type type;
+};
+
+#define PUSH_FRAME(p) ((lept_push_frame*)((p)->c.stack + (p)->frame))
+
+void lept_push_parser_init(lept_push_parser* p){
+    assert(p != NULL);
+    lept_context_init(&p->c, NULL, 0);
+    lept_init(&p->root);
+    p->carry = NULL;
+    p->carry_len = p->carry_size = 0;
+    p->frame = LEPT_PUSH_ROOT;
+    p->depth = p->max_depth = 0;
+    p->state = LEPT_PUSH_VALUE;
+    p->escape = 0;
+    p->ret = LEPT_PARSE_OK;
+}
+
+static int lept_push_open(lept_push_parser* p, lept_type type){
+    lept_push_frame f;
+    if(p->max_depth != 0 && p->depth == p->max_depth)
+        return LEPT_PARSE_DEPTH_EXCEEDED;
+    p->depth++;
+    f.parent = p->frame;
+    f.size = 0;
+    f.k = NULL;
+    f.klen = 0;
+    f.type = type;
+    p->frame = p->c.top;
+    memcpy(lept_context_push(&p->c, sizeof(lept_push_frame)), &f, sizeof(lept_push_frame));
+    p->state = type == LEPT_ARRAY ? LEPT_PUSH_ARRAY_FIRST : LEPT_PUSH_OBJECT_FIRST;
+    return LEPT_PARSE_OK;
+}
+
+/* v becomes the next element of the innermost frame, or the root */
+static void lept_push_value(lept_push_parser* p, lept_value* v){
+    p->state = LEPT_PUSH_AFTER_VALUE;
+    if(p->frame == LEPT_PUSH_ROOT){
+        memcpy(&p->root, v, sizeof(lept_value));
+        return;
+    }
+    if(PUSH_FRAME(p)->type == LEPT_ARRAY)
+        memcpy(lept_context_push(&p->c, sizeof(lept_value)), v, sizeof(lept_value));
+    else{
+        lept_member m;
+        m.k = PUSH_FRAME(p)->k;
+        m.klen = PUSH_FRAME(p)->klen;
+        memcpy(&m.v, v, sizeof(lept_value));
+        PUSH_FRAME(p)->k = NULL;   /* ownership is transferred to member on stack */
+        memcpy(lept_context_push(&p->c, sizeof(lept_member)), &m, sizeof(lept_member));
+    }
+    PUSH_FRAME(p)->size++;      /* the push may have moved the stack */
+}
+
+/* builds the innermost container the way lept_parse_array() and lept_parse_object() do */
+static void lept_push_close(lept_push_parser* p){
+    lept_push_frame f;
+    lept_value v;
+    size_t s;
+    memcpy(&f, PUSH_FRAME(p), sizeof(lept_push_frame));
+    lept_init(&v);
+    v.type = f.type;
+    if(f.type == LEPT_ARRAY){
+        s = f.size * sizeof(lept_value);
+        v.u.a.size = v.u.a.capacity = f.size;
+        v.u.a.e = NULL;
+        if(s > 0)
+            memcpy(v.u.a.e = (lept_value*)malloc(s), lept_context_pop(&p->c, s), s);
+    }
+    else{
+        s = f.size * sizeof(lept_member);
+        v.u.o.size = v.u.o.capacity = f.size;
+        v.u.o.m = NULL;
+        if(s > 0)
+            memcpy(v.u.o.m = (lept_member*)malloc(lept_object_bytes(f.size)), lept_context_pop(&p->c, s), s);
+        lept_index_build(&v);
+    }
+    lept_context_pop(&p->c, sizeof(lept_push_frame));
+    p->frame = f.parent;
+    p->depth--;
+    lept_push_value(p, &v);
+}
+
+/* frees every open frame with what has been parsed into it */
+static void lept_push_unwind(lept_push_parser* p){
+    size_t i;
+    while(p->frame != LEPT_PUSH_ROOT){
+        lept_push_frame f;
+        memcpy(&f, PUSH_FRAME(p), sizeof(lept_push_frame));
+        for(i = 0; i < f.size; i++){
+            if(f.type == LEPT_ARRAY)
+                lept_free((lept_value*)lept_context_pop(&p->c, sizeof(lept_value)));
+            else{
+                lept_member* m = (lept_member*)lept_context_pop(&p->c, sizeof(lept_member));
+                free(m->k);
+                lept_free(&m->v);
+            }
+        }
+        free(f.k);
+        lept_context_pop(&p->c, sizeof(lept_push_frame));
+        p->frame = f.parent;
+    }
+    p->depth = 0;
+    assert(p->c.top == 0);
+    lept_free(&p->root);
+}
+
+/* error for anything but ',' or a closing bracket after a value, as the recursive parser reports it */
+static int lept_push_after_value_error(lept_push_parser* p){
+    if(p->frame == LEPT_PUSH_ROOT)
+        return LEPT_PARSE_ROOT_NOT_SINGULAR;
+    return PUSH_FRAME(p)->type == LEPT_ARRAY ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+}
+
+/* a whole token, with the existing tokenizers bounded to its bytes */
+static int lept_push_token(lept_push_parser* p, const char* tok, size_t len){
+    lept_context* c = &p->c;
+    lept_value v;
+    int ret;
+    c->json = tok;
+    c->end = tok + len;
+    if(p->state == LEPT_PUSH_IN_KEY){
+        char* str;
+        size_t klen;
+        if((ret = lept_parse_string_raw(c, &str, &klen)) != LEPT_PARSE_OK)
+            return ret;
+        memcpy(PUSH_FRAME(p)->k = (char*)malloc(klen + 1), str, klen);
+        PUSH_FRAME(p)->k[klen] = '\0';
+        PUSH_FRAME(p)->klen = klen;
+        p->state = LEPT_PUSH_COLON;
+        return LEPT_PARSE_OK;
+    }
+    lept_init(&v);
+    if((ret = lept_parse_value(c, &v)) != LEPT_PARSE_OK)
+        return ret;
+    if(c->json != c->end){      /* "0x", "truex": the tokenizer stopped early, like before any other stray byte */
+        lept_free(&v);
+        return lept_push_after_value_error(p);
+    }
+    lept_push_value(p, &v);
+    return LEPT_PARSE_OK;
+}
+
+/* keeps [tok, end) of an unfinished token for the next chunk */
+static void lept_push_carry(lept_push_parser* p, const char* tok, const char* end){
+    size_t len = end - tok;
+    if(p->carry_len + len > p->carry_size){
+        if(p->carry_size == 0)
+            p->carry_size = LEPT_PARSE_STACK_INIT_SIZE;
+        while(p->carry_len + len > p->carry_size)
+            p->carry_size += p->carry_size >> 1;
+        p->carry = (char*)realloc(p->carry, p->carry_size);
+    }
+    memcpy(p->carry + p->carry_len, tok, len);
+    p->carry_len += len;
+}
+
+/* ends a token at end; it is parsed from the chunk if it began there, else from the carry buffer */
+static int lept_push_end_token(lept_push_parser* p, const char* tok, const char* end){
+    int ret;
+    if(p->carry_len == 0)
+        return lept_push_token(p, tok, end - tok);
+    lept_push_carry(p, tok, end);
+    ret = lept_push_token(p, p->carry, p->carry_len);
+    p->carry_len = 0;
+    return ret;
+}
+
+/* the closing quote of a string token, or NULL if it is not in [s, end) */
+static const char* lept_push_string_end(lept_push_parser* p, const char* s, const char* end){
+    while(s != end){
+        if(p->escape){
+            p->escape = 0;
+            s++;
+            continue;
+        }
+        if((s = lept_scan_string(s, end)) == end)
+            break;
+        if(*s == '"')
+            return s;
+        if(*s == '\\')
+            p->escape = 1;
+        s++;    /* a control character is left for the tokenizer to report */
+    }
+    return NULL;
+}
+
+static int lept_push_step(lept_push_parser* p, const char* s, const char* end){
+    const char* tok = s;    /* where the current token's bytes in this chunk start */
+    const char* q;
+    int ret;
+    while(s != end){
+        char ch;
+        switch(p->state){
+            case LEPT_PUSH_IN_STRING:
+            case LEPT_PUSH_IN_KEY:
+                if((q = lept_push_string_end(p, s, end)) == NULL){
+                    s = end;
+                    continue;
+                }
+                if((ret = lept_push_end_token(p, tok, s = q + 1)) != LEPT_PARSE_OK)
+                    return ret;
+                continue;
+            case LEPT_PUSH_IN_SCALAR:
+                while(s != end && !ISDELIM(*s))
+                    s++;
+                if(s == end)
+                    continue;
+                if((ret = lept_push_end_token(p, tok, s)) != LEPT_PARSE_OK)
+                    return ret;
+                continue;
+        }
+        if(ISWS(*s)){
+            s = lept_skip_whitespace(s + 1, end);
+            continue;
+        }
+        tok = s;
+        ch = *s++;
+        switch(p->state){
+            case LEPT_PUSH_ARRAY_FIRST:
+                if(ch == ']'){
+                    lept_push_close(p);
+                    break;
+                }
+                /* fall through */
+            case LEPT_PUSH_VALUE:
+                if(ch == '[' || ch == '{'){
+                    if((ret = lept_push_open(p, ch == '[' ? LEPT_ARRAY : LEPT_OBJECT)) != LEPT_PARSE_OK)
+                        return ret;
+                }
+                else if(ch == '"'){
+                    p->state = LEPT_PUSH_IN_STRING;
+                    p->escape = 0;
+                }
+                else if(ISDELIM(ch))
+                    return LEPT_PARSE_INVALID_VALUE;
+                else
+                    p->state = LEPT_PUSH_IN_SCALAR;
+                break;
+            case LEPT_PUSH_OBJECT_FIRST:
+                if(ch == '}'){
+                    lept_push_close(p);
+                    break;
+                }
+                /* fall through */
+            case LEPT_PUSH_KEY:
+                if(ch != '"')
+                    return LEPT_PARSE_MISS_KEY;
+                p->state = LEPT_PUSH_IN_KEY;
+                p->escape = 0;
+                break;
+            case LEPT_PUSH_COLON:
+                if(ch != ':')
+                    return LEPT_PARSE_MISS_COLON;
+                p->state = LEPT_PUSH_VALUE;
+                break;
+            case LEPT_PUSH_AFTER_VALUE:
+                if(p->frame == LEPT_PUSH_ROOT)
+                    return LEPT_PARSE_ROOT_NOT_SINGULAR;
+                if(ch == ',')
+                    p->state = PUSH_FRAME(p)->type == LEPT_ARRAY ? LEPT_PUSH_VALUE : LEPT_PUSH_KEY;
+                else if(ch == (PUSH_FRAME(p)->type == LEPT_ARRAY ? ']' : '}'))
+                    lept_push_close(p);
+                else
+                    return lept_push_after_value_error(p);
+                break;
+        }
+    }
+    if(p->state >= LEPT_PUSH_IN_STRING)
+        lept_push_carry(p, tok, end);
+    return LEPT_PARSE_OK;
+}
+
+int lept_push_parser_feed(lept_push_parser* p, const char* chunk, size_t len){
+    assert(p != NULL && (chunk != NULL || len == 0));
+    if(p->ret == LEPT_PARSE_OK && (p->ret = lept_push_step(p, chunk, chunk + len)) != LEPT_PARSE_OK){
+        p->carry_len = 0;
+        lept_push_unwind(p);
+    }
+    return p->ret;
+}
+
+int lept_push_parser_finish(lept_push_parser* p, lept_value* v){
+    int ret;
+    assert(p != NULL && v != NULL);
+    lept_init(v);
+    if((ret = p->ret) == LEPT_PARSE_OK){
+        /* the end of input ends a pending token, then stands for the '\0' lept_parse() would see */
+        if(p->state >= LEPT_PUSH_IN_STRING)
+            ret = lept_push_token(p, p->carry, p->carry_len);
+        if(ret == LEPT_PARSE_OK){
+            switch(p->state){
+                case LEPT_PUSH_VALUE:
+                case LEPT_PUSH_ARRAY_FIRST:  ret = LEPT_PARSE_EXPECT_VALUE; break;
+                case LEPT_PUSH_OBJECT_FIRST:
+                case LEPT_PUSH_KEY:          ret = LEPT_PARSE_MISS_KEY; break;
+                case LEPT_PUSH_COLON:        ret = LEPT_PARSE_MISS_COLON; break;
+                default:
+                    if(p->frame != LEPT_PUSH_ROOT)
+                        ret = lept_push_after_value_error(p);
+                    break;
+            }
+        }
+        if(ret == LEPT_PARSE_OK)
+            memcpy(v, &p->root, sizeof(lept_value));
+        else
+            lept_push_unwind(p);
+    }
+    /* ready for the next document, the buffers are kept */
+    p->c.top = 0;
+    lept_init(&p->root);
+    p->carry_len = 0;
+    p->frame = LEPT_PUSH_ROOT;
+    p->depth = 0;
+    p->state = LEPT_PUSH_VALUE;
+    p->escape = 0;
+    p->ret = LEPT_PARSE_OK;
+    return ret;
+}
+
+void lept_push_parser_free(lept_push_parser* p){
+    assert(p != NULL);
+    if(p->ret == LEPT_PARSE_OK)
+        lept_push_unwind(p);
+    free(p->c.stack);
+    free(p->carry);
+    lept_push_parser_init(p);
+}
+
+//document
+#ifndef LEPT_ARENA_BLOCK_SIZE
+#define LEPT_ARENA_BLOCK_SIZE 65536
+#endif
+
+struct lept_arena_block{
+    lept_arena_block* next;
+    size_t size, top;
+};
+
+/* block data starts after the header, aligned for doubles and pointers */
+#define LEPT_ARENA_HEADER ((sizeof(lept_arena_block) + 7) & ~(size_t)7)
+
+static void* lept_arena_alloc(lept_arena_block** blocks, size_t size){
+    lept_arena_block* b = *blocks;
+    void* ret;
+    size = (size + 7) & ~(size_t)7;
+    if(b == NULL || b->top + size > b->size){
+        size_t bsize = size > LEPT_ARENA_BLOCK_SIZE / 4 ? size : LEPT_ARENA_BLOCK_SIZE;
+        lept_arena_block* nb = (lept_arena_block*)malloc(LEPT_ARENA_HEADER + bsize);
+        nb->size = bsize;
+        nb->top = 0;
+        if(b != NULL && bsize != LEPT_ARENA_BLOCK_SIZE){
+            /* a large string or buffer gets a block of its own; keep filling the current one */
+            nb->next = b->next;
+            b->next = nb;
+        }
+        else{
+            nb->next = b;
+            *blocks = nb;
+        }
+        b = nb;
+    }
+    ret = (char*)b + LEPT_ARENA_HEADER + b->top;
+    b->top += size;
+    return ret;
+}
+
+static void* lept_context_alloc(lept_context* c, size_t size){
+    return c->doc ? lept_arena_alloc(&c->doc->blocks, size) : malloc(size);
+}
+
+void lept_document_init(lept_document* doc){
+    assert(doc != NULL);
+    lept_init(&doc->root);
+    doc->blocks = NULL;
+}
+
+lept_value* lept_document_root(lept_document* doc){
+    assert(doc != NULL);
+    return &doc->root;
+}
+
+/* drops the previous tree but keeps the newest block, so a document reused per request stops calling malloc */
+int lept_parse_into_document(lept_document* doc, const char* json){
+    lept_context c;
+    lept_arena_block* b;
+    assert(doc != NULL);
+    if((b = doc->blocks) != NULL){
+        while(b->next != NULL){
+            lept_arena_block* next = b->next->next;
+            free(b->next);
+            b->next = next;
+        }
+        b->top = 0;
+    }
+    lept_context_init(&c, json, strlen(json));
+    c.doc = doc;
+    return lept_parse_root(&c, &doc->root);
+}
+
+void lept_document_free(lept_document* doc){
+    lept_arena_block* b;
+    assert(doc != NULL);
+    while((b = doc->blocks) != NULL){
+        doc->blocks = b->next;
+        free(b);
+    }
+    lept_init(&doc->root);
+}
+
+//intern
+struct lept_intern_slot{
+    const char* k;      /* NULL for a free slot */
+    size_t klen;
+    uint32_t hash;
+};
+
+void lept_intern_init(lept_intern_table* t){
+    assert(t != NULL);
+    t->slots = NULL;
+    t->size = t->count = 0;
+    t->blocks = NULL;
+}
+
+static void lept_intern_grow(lept_intern_table* t){
+    lept_intern_slot* old = t->slots;
+    size_t i, j, size = t->size;
+    t->size = size == 0 ? 64 : size * 2;
+    t->slots = (lept_intern_slot*)calloc(t->size, sizeof(lept_intern_slot));
+    for(i = 0; i < size; i++)
+        if(old[i].k != NULL){
+            for(j = old[i].hash & (t->size - 1); t->slots[j].k != NULL; j = (j + 1) & (t->size - 1))
+                ;
+            t->slots[j] = old[i];
+        }
+    free(old);
+}
+
+/* the table's copy of key, added on first sight; it is NUL-terminated and lives until lept_intern_free() */
+const char* lept_intern(lept_intern_table* t, const char* key, size_t klen){
+    uint32_t h;
+    size_t i;
+    char* k;
+    assert(t != NULL && (key != NULL || klen == 0));
+    if(t->count * 2 >= t->size)
+        lept_intern_grow(t);
+    h = lept_hash_key(key, klen);
+    for(i = h & (t->size - 1); t->slots[i].k != NULL; i = (i + 1) & (t->size - 1))
+        if(t->slots[i].hash == h && t->slots[i].klen == klen && memcmp(t->slots[i].k, key, klen) == 0)
+            return t->slots[i].k;
+    k = (char*)lept_arena_alloc(&t->blocks, klen + 1);
+    if(klen > 0)
+        memcpy(k, key, klen);
+    k[klen] = '\0';
+    t->slots[i].k = k;
+    t->slots[i].klen = klen;
+    t->slots[i].hash = h;
+    t->count++;
+    return k;
+}
+
+void lept_intern_free(lept_intern_table* t){
+    lept_arena_block* b;
+    assert(t != NULL);
+    while((b = t->blocks) != NULL){
+        t->blocks = b->next;
+        free(b);
+    }
+    free(t->slots);
+    lept_intern_init(t);
+}
+
+int lept_parse_interned(lept_value* v, const char* json, lept_intern_table* keys){
+    lept_context c;
+    assert(v != NULL && json != NULL && keys != NULL);
+    lept_context_init(&c, json, strlen(json));
+    c.keys = keys;
+    return lept_parse_root(&c, v);
+}
+
+//compact
+/* non-number nodes are the NaNs 0xFFF9... up, which a parsed number never is */
+#define LEPT_COMPACT_TAG(type) ((uint64_t)(0xFFF9 + (type)) << 48)
+#define LEPT_COMPACT_OFFSET(n) ((size_t)((n)->word & 0xFFFFFFFFFFFFull))
+
+typedef struct{
+    lept_context pending;   /* finished nodes whose container is still open */
+    lept_context nodes;     /* closed containers' children, the root slot first */
+    lept_context strings;
+    int too_big;
+}lept_compact_builder;
+
+static int lept_compact_push(lept_compact_builder* b, uint64_t word, uint32_t len, uint32_t hash){
+    lept_compact_node* n = (lept_compact_node*)lept_context_push(&b->pending, sizeof(lept_compact_node));
+    n->word = word;
+    n->len = len;
+    n->hash = hash;
+    return 1;
+}
+
+static int lept_compact_null(void* ud){
+    return lept_compact_push((lept_compact_builder*)ud, LEPT_COMPACT_TAG(LEPT_NULL), 0, 0);
+}
+
+static int lept_compact_boolean(void* ud, int b){
+    return lept_compact_push((lept_compact_builder*)ud, LEPT_COMPACT_TAG(b ? LEPT_TRUE : LEPT_FALSE), 0, 0);
+}
+
+static int lept_compact_number(void* ud, double n){
+    uint64_t word;
+    memcpy(&word, &n, sizeof(word));
+    return lept_compact_push((lept_compact_builder*)ud, word, 0, 0);
+}
+
+static int lept_compact_string(void* ud, const char* s, size_t len){
+    lept_compact_builder* b = (lept_compact_builder*)ud;
+    size_t offset = b->strings.top;
+    char* p;
+    if(len > UINT32_MAX)
+        return !(b->too_big = 1);
+    p = (char*)lept_context_push(&b->strings, len + 1);
+    if(len > 0)     /* s may be NULL for "" */
+        memcpy(p, s, len);
+    p[len] = '\0';
+    return lept_compact_push(b, LEPT_COMPACT_TAG(LEPT_STRING) | offset, (uint32_t)len, lept_hash_key(s, len));
+}
+
+/* moves the count children on top of pending to the node array, behind their container */
+static int lept_compact_close(lept_compact_builder* b, lept_type type, size_t size, size_t count){
+    size_t first = b->nodes.top / sizeof(lept_compact_node);
+    if(size > UINT32_MAX)
+        return !(b->too_big = 1);
+    if(count > 0)
+        memcpy(lept_context_push(&b->nodes, count * sizeof(lept_compact_node)),
+            lept_context_pop(&b->pending, count * sizeof(lept_compact_node)), count * sizeof(lept_compact_node));
+    return lept_compact_push(b, LEPT_COMPACT_TAG(type) | first, (uint32_t)size, 0);
+}
+
+static int lept_compact_end_array(void* ud, size_t size){
+    return lept_compact_close((lept_compact_builder*)ud, LEPT_ARRAY, size, size);
+}
+
+static int lept_compact_end_object(void* ud, size_t size){
+    return lept_compact_close((lept_compact_builder*)ud, LEPT_OBJECT, size, size * 2);
+}
+
+static const lept_handler lept_compact_handler = {
+    lept_compact_null, lept_compact_boolean, lept_compact_number, lept_compact_string,
+    NULL, lept_compact_end_array, NULL, lept_compact_string, lept_compact_end_object
+};
+
+int lept_compact_parse(lept_compact* d, const char* json){
+    lept_compact_builder b;
+    int ret;
+    assert(d != NULL && json != NULL);
+    lept_context_init(&b.pending, "", 0);
+    lept_context_init(&b.nodes, "", 0);
+    lept_context_init(&b.strings, "", 0);
+    b.too_big = 0;
+    lept_context_push(&b.nodes, sizeof(lept_compact_node));
+    if((ret = lept_parse_sax(json, &lept_compact_handler, &b)) == LEPT_PARSE_OK){
+        assert(b.pending.top == sizeof(lept_compact_node));
+        memcpy(b.nodes.stack, b.pending.stack, sizeof(lept_compact_node));
+        d->nodes = (lept_compact_node*)realloc(b.nodes.stack, b.nodes.top);
+        d->size = b.nodes.top / sizeof(lept_compact_node);
+        d->strings = b.strings.top > 0 ? (char*)realloc(b.strings.stack, b.strings.top) : b.strings.stack;
+        d->strings_size = b.strings.top;
+    }
+    else{
+        if(b.too_big)
+            ret = LEPT_PARSE_COMPACT_TOO_BIG;
+        free(b.nodes.stack);
+        free(b.strings.stack);
+        lept_compact_reset(d);
+    }
+    d->image = NULL;
+    d->mapped = 0;
+    free(b.pending.stack);
+    return ret;
+}
+
+void lept_compact_free(lept_compact* d){
+    assert(d != NULL);
+    if(d->image == NULL){
+        free(d->nodes);
+        free(d->strings);
+    }
+    else if(d->mapped > 0){
+#if defined(_WIN32)
+        UnmapViewOfFile(d->image);
+#else
+        munmap((void*)d->image, d->mapped);
+#endif
+    }
+    lept_compact_reset(d);
+}
+
+static void lept_compact_reset(lept_compact* d){
+    d->nodes = NULL;
+    d->strings = NULL;
+    d->size = d->strings_size = 0;
+    d->image = NULL;
+    d->mapped = 0;
+}
+
+const lept_compact_node* lept_compact_root(const lept_compact* d){
+    assert(d != NULL && d->size > 0);
+    return d->nodes;
+}
+
+lept_type lept_compact_get_type(const lept_compact_node* n){
+    unsigned top;
+    assert(n != NULL);
+    top = (unsigned)(n->word >> 48);
+    return top >= 0xFFF9 ? (lept_type)(top - 0xFFF9) : LEPT_NUMBER;
+}
+
+int lept_compact_get_boolean(const lept_compact_node* n){
+    assert(n != NULL && (lept_compact_get_type(n) == LEPT_TRUE || lept_compact_get_type(n) == LEPT_FALSE));
+    return lept_compact_get_type(n) == LEPT_TRUE;
+}
+
+double lept_compact_get_number(const lept_compact_node* n){
+    double d;
+    assert(n != NULL && lept_compact_get_type(n) == LEPT_NUMBER);
+    memcpy(&d, &n->word, sizeof(d));
+    return d;
+}
+
+const char* lept_compact_get_string(const lept_compact* d, const lept_compact_node* n){
+    assert(d != NULL && n != NULL && lept_compact_get_type(n) == LEPT_STRING);
+    return d->strings + LEPT_COMPACT_OFFSET(n);
+}
+
+size_t lept_compact_get_string_length(const lept_compact_node* n){
+    assert(n != NULL && lept_compact_get_type(n) == LEPT_STRING);
+    return n->len;
+}
+
+size_t lept_compact_get_array_size(const lept_compact_node* n){
+    assert(n != NULL && lept_compact_get_type(n) == LEPT_ARRAY);
+    return n->len;
+}
+
+const lept_compact_node* lept_compact_get_array_element(const lept_compact* d, const lept_compact_node* n, size_t index){
+    assert(d != NULL && n != NULL && lept_compact_get_type(n) == LEPT_ARRAY);
+    assert(index < n->len);
+    return d->nodes + LEPT_COMPACT_OFFSET(n) + index;
+}
+
+size_t lept_compact_get_object_size(const lept_compact_node* n){
+    assert(n != NULL && lept_compact_get_type(n) == LEPT_OBJECT);
+    return n->len;
+}
+
+const lept_compact_node* lept_compact_get_object_key(const lept_compact* d, const lept_compact_node* n, size_t index){
+    assert(d != NULL && n != NULL && lept_compact_get_type(n) == LEPT_OBJECT);
+    assert(index < n->len);
+    return d->nodes + LEPT_COMPACT_OFFSET(n) + index * 2;
+}
+
+const lept_compact_node* lept_compact_get_object_value(const lept_compact* d, const lept_compact_node* n, size_t index){
+    return lept_compact_get_object_key(d, n, index) + 1;
+}
+
+const lept_compact_node* lept_compact_find_object_value(const lept_compact* d, const lept_compact_node* n, const char* key, size_t klen){
+    const lept_compact_node* k;
+    uint32_t h;
+    size_t i;
+    assert(d != NULL && n != NULL && lept_compact_get_type(n) == LEPT_OBJECT);
+    assert(key != NULL || klen == 0);
+    h = lept_hash_key(key, klen);
+    for(i = 0, k = d->nodes + LEPT_COMPACT_OFFSET(n); i < n->len; i++, k += 2)
+        if(k->hash == h && k->len == klen && memcmp(d->strings + LEPT_COMPACT_OFFSET(k), key, klen) == 0)
+            return k + 1;
+    return NULL;
+}
+
+void lept_compact_copy(lept_value* dst, const lept_compact* d, const lept_compact_node* n){
+    size_t i;
+    assert(dst != NULL && d != NULL && n != NULL);
+    switch(lept_compact_get_type(n)){
+        case LEPT_NULL:   lept_set_null(dst); break;
+        case LEPT_FALSE:  lept_set_boolean(dst, 0); break;
+        case LEPT_TRUE:   lept_set_boolean(dst, 1); break;
+        case LEPT_NUMBER: lept_set_number(dst, lept_compact_get_number(n)); break;
+        case LEPT_STRING: lept_set_string(dst, lept_compact_get_string(d, n), n->len); break;
+        case LEPT_ARRAY:
+            lept_set_array(dst, n->len);
+            for(i = 0; i < n->len; i++)
+                lept_compact_copy(lept_pushback_array_element(dst), d, lept_compact_get_array_element(d, n, i));
+            break;
+        case LEPT_OBJECT:
+            lept_set_object(dst, n->len);
+            for(i = 0; i < n->len; i++){
+                const lept_compact_node* k = lept_compact_get_object_key(d, n, i);
+                lept_member* m = &dst->u.o.m[i];
+                memcpy(m->k = (char*)malloc(k->len + 1), d->strings + LEPT_COMPACT_OFFSET(k), k->len + 1);
+                m->klen = k->len;
+                lept_init(&m->v);
+                lept_compact_copy(&m->v, d, k + 1);
+            }
+            dst->u.o.size = n->len;
+            lept_index_build(dst);
+            break;
+    }
+}
+
+//ndjson
+#ifndef LEPT_NDJSON_CHUNK_SIZE
+#define LEPT_NDJSON_CHUNK_SIZE (1 << 18)     /* input bytes per unit of work, cut at the next line end */
+#endif
+
+#if defined(_WIN32)
+typedef HANDLE lept_thread;
+typedef CRITICAL_SECTION lept_mutex;
+typedef CONDITION_VARIABLE lept_cond;
+#define lept_mutex_init(m)      InitializeCriticalSection(m)
+#define lept_mutex_destroy(m)   DeleteCriticalSection(m)
+#define lept_mutex_lock(m)      EnterCriticalSection(m)
+#define lept_mutex_unlock(m)    LeaveCriticalSection(m)
+#define lept_cond_init(cv)      InitializeConditionVariable(cv)
+#define lept_cond_destroy(cv)   ((void)0)
+#define lept_cond_wait(cv, m)   SleepConditionVariableCS(cv, m, INFINITE)
+#define lept_cond_broadcast(cv) WakeAllConditionVariable(cv)
+#elif !defined(LEPT_NO_THREADS)
+typedef pthread_t lept_thread;
+typedef pthread_mutex_t lept_mutex;
+typedef pthread_cond_t lept_cond;
+#define lept_mutex_init(m)      pthread_mutex_init(m, NULL)
+#define lept_mutex_destroy(m)   pthread_mutex_destroy(m)
+#define lept_mutex_lock(m)      pthread_mutex_lock(m)
+#define lept_mutex_unlock(m)    pthread_mutex_unlock(m)
+#define lept_cond_init(cv)      pthread_cond_init(cv, NULL)
+#define lept_cond_destroy(cv)   pthread_cond_destroy(cv)
+#define lept_cond_wait(cv, m)   pthread_cond_wait(cv, m)
+#define lept_cond_broadcast(cv) pthread_cond_broadcast(cv)
+#else
+typedef int lept_mutex, lept_cond;     /* everything runs on the calling thread */
+#define lept_mutex_init(m)      ((void)0)
+#define lept_mutex_destroy(m)   ((void)0)
+#define lept_mutex_lock(m)      ((void)0)
+#define lept_mutex_unlock(m)    ((void)0)
+#define lept_cond_init(cv)      ((void)0)
+#define lept_cond_destroy(cv)   ((void)0)
+#define lept_cond_wait(cv, m)   assert(0 && "nothing to wait for")
+#define lept_cond_broadcast(cv) ((void)0)
+#endif
+
+typedef struct{
+    size_t offset;
+    int ret;
+    lept_value v;
+}lept_ndjson_line;
+
+typedef struct{
+    lept_context lines;     /* ordered: the chunk's lept_ndjson_line results */
+    int done;
+}lept_ndjson_chunk;
+
+typedef struct{
+    const char* json;
+    size_t* bounds;             /* chunk i is [bounds[i], bounds[i + 1]) */
+    lept_ndjson_chunk* chunks;  /* ordered only */
+    size_t count, next, delivered, window;
+    int ordered, stop;
+    lept_ndjson_fn callback;
+    void* ud;
+    lept_mutex lock;
+    lept_cond changed;
+}lept_ndjson;
+
+static void lept_ndjson_stop(lept_ndjson* n){
+    lept_mutex_lock(&n->lock);
+    n->stop = 1;
+    lept_cond_broadcast(&n->changed);
+    lept_mutex_unlock(&n->lock);
+}
+
+/* parses the lines of chunk i with c, a context the worker keeps for all its lines */
+static void lept_ndjson_chunk_parse(lept_ndjson* n, lept_context* c, size_t i){
+    const char* p = n->json + n->bounds[i], *end = n->json + n->bounds[i + 1];
+    while(p != end){
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        const char* next = eol != NULL ? eol + 1 : end;
+        const char* q = p;
+        lept_ndjson_line line;
+        if(eol == NULL)
+            eol = end;
+        if(eol != p && eol[-1] == '\r')
+            eol--;
+        while(q != eol && ISWS(*q))
+            q++;
+        if(q == eol){     /* blank line, empty or only whitespace */
+            p = next;
+            continue;
+        }
+        line.offset = p - n->json;
+        c->json = p;
+        c->end = eol;
+        line.ret = lept_parse_in(c, &line.v);
+        if(n->ordered)
+            memcpy(lept_context_push(&n->chunks[i].lines, sizeof(line)), &line, sizeof(line));
+        else{
+            int go = n->callback(n->ud, line.offset, line.ret, &line.v);
+            lept_free(&line.v);
+            if(!go){
+                lept_ndjson_stop(n);
+                return;
+            }
+        }
+        p = next;
+    }
+}
+
+/* takes chunks in input order until there are none left; ordered, it stays within window chunks of delivery */
+static void lept_ndjson_work(lept_ndjson* n){
+    lept_context c;
+    lept_context_init(&c, "", 0);
+    lept_mutex_lock(&n->lock);
+    for(;;){
+        size_t i;
+        while(n->ordered && !n->stop && n->next < n->count && n->next >= n->delivered + n->window)
+            lept_cond_wait(&n->changed, &n->lock);
+        if(n->stop || n->next == n->count)
+            break;
+        i = n->next++;
+        lept_mutex_unlock(&n->lock);
+        lept_ndjson_chunk_parse(n, &c, i);
+        lept_mutex_lock(&n->lock);
+        if(n->ordered){
+            n->chunks[i].done = 1;
+            lept_cond_broadcast(&n->changed);
+        }
+    }
+    lept_mutex_unlock(&n->lock);
+    free(c.stack);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI lept_ndjson_thread(LPVOID n){
+    lept_ndjson_work((lept_ndjson*)n);
+    return 0;
+}
+#elif !defined(LEPT_NO_THREADS)
+static void* lept_ndjson_thread(void* n){
+    lept_ndjson_work((lept_ndjson*)n);
+    return NULL;
+}
+#endif
+
+/* nthreads, or one per online cpu when it is 0 or less; always 1 with LEPT_NO_THREADS */
+static int lept_thread_count(int nthreads){
+#if defined(LEPT_NO_THREADS)
+    (void)nthreads;
+    return 1;
+#else
+    if(nthreads <= 0){
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        nthreads = (int)info.dwNumberOfProcessors;
+#else
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus > 0 ? (int)cpus : 1;
+#endif
+    }
+    return nthreads;
+#endif
+}
+
+/* hands the chunks' lines to the callback in input order as they finish; the caller's thread does this */
+static void lept_ndjson_deliver(lept_ndjson* n){
+    size_t i, j;
+    for(i = 0; i < n->count; i++){
+        lept_ndjson_chunk* chunk = &n->chunks[i];
+        lept_ndjson_line* lines;
+        lept_mutex_lock(&n->lock);
+        while(!chunk->done)
+            lept_cond_wait(&n->changed, &n->lock);
+        lept_mutex_unlock(&n->lock);
+        lines = (lept_ndjson_line*)chunk->lines.stack;
+        for(j = 0; j < chunk->lines.top / sizeof(lept_ndjson_line); j++){
+            if(!n->callback(n->ud, lines[j].offset, lines[j].ret, &lines[j].v)){
+                lept_ndjson_stop(n);
+                return;     /* the rest is freed with the chunks */
+            }
+            lept_free(&lines[j].v);
+        }
+        free(chunk->lines.stack);
+        chunk->lines.stack = NULL;
+        lept_mutex_lock(&n->lock);
+        n->delivered++;
+        lept_cond_broadcast(&n->changed);
+        lept_mutex_unlock(&n->lock);
+    }
+}
+
+int lept_parse_ndjson(const char* json, size_t len, int nthreads, int flags, lept_ndjson_fn callback, void* ud){
+    lept_ndjson n;
+    size_t i;
+    assert((json != NULL || len == 0) && callback != NULL);
+    nthreads = lept_thread_count(nthreads);
+    /* every chunk but the last is at least LEPT_NDJSON_CHUNK_SIZE bytes, up to the end of a line */
+    n.bounds = (size_t*)malloc((len / LEPT_NDJSON_CHUNK_SIZE + 2) * sizeof(size_t));
+    n.bounds[0] = 0;
+    for(n.count = 0; n.bounds[n.count] < len; n.count++){
+        size_t b = n.bounds[n.count] + LEPT_NDJSON_CHUNK_SIZE;
+        const char* eol;
+        if(b >= len || (eol = (const char*)memchr(json + b, '\n', len - b)) == NULL)
+            b = len;
+        else
+            b = eol + 1 - json;
+        n.bounds[n.count + 1] = b;
+    }
+    n.json = json;
+    n.next = n.delivered = 0;
+    n.window = (size_t)nthreads * 2;
+    n.ordered = (flags & LEPT_NDJSON_ORDERED) != 0;
+    n.stop = 0;
+    n.callback = callback;
+    n.ud = ud;
+    n.chunks = NULL;
+    if(n.ordered){
+        n.chunks = (lept_ndjson_chunk*)malloc(n.count * sizeof(lept_ndjson_chunk) + 1);
+        for(i = 0; i < n.count; i++){
+            lept_context_init(&n.chunks[i].lines, "", 0);
+            n.chunks[i].done = 0;
+        }
+    }
+    lept_mutex_init(&n.lock);
+    lept_cond_init(&n.changed);
+#if defined(LEPT_NO_THREADS)
+    n.window = n.count;
+    lept_ndjson_work(&n);
+    if(n.ordered)
+        lept_ndjson_deliver(&n);
+#else
+    if(nthreads == 1 && !n.ordered)
+        lept_ndjson_work(&n);
+    else{
+        lept_thread* threads = (lept_thread*)malloc(nthreads * sizeof(lept_thread));
+        int t;
+        for(t = 0; t < nthreads; t++){
+#if defined(_WIN32)
+            if((threads[t] = CreateThread(NULL, 0, lept_ndjson_thread, &n, 0, NULL)) == NULL)
+                break;
+#else
+            if(pthread_create(&threads[t], NULL, lept_ndjson_thread, &n) != 0)
+                break;
+#endif
+        }
+        /* with no worker at all, the caller's thread parses */
+        if(t == 0){
+            n.window = n.count;
+            lept_ndjson_work(&n);
+        }
+        if(n.ordered)
+            lept_ndjson_deliver(&n);
+        while(t > 0){
+#if defined(_WIN32)
+            WaitForSingleObject(threads[--t], INFINITE);
+            CloseHandle(threads[t]);
+#else
+            pthread_join(threads[--t], NULL);
+#endif
+        }
+        free(threads);
+    }
+#endif
+    /* after a stop, results that were not delivered are still here; lept_free() of a delivered value is a no-op */
+    if(n.ordered){
+        for(i = 0; i < n.count; i++)
+            if(n.chunks[i].lines.stack != NULL){
+                lept_ndjson_line* lines = (lept_ndjson_line*)n.chunks[i].lines.stack;
+                size_t j;
+                for(j = 0; j < n.chunks[i].lines.top / sizeof(lept_ndjson_line); j++)
+                    lept_free(&lines[j].v);
+                free(n.chunks[i].lines.stack);
+            }
+        free(n.chunks);
+    }
+    lept_cond_destroy(&n.changed);
+    lept_mutex_destroy(&n.lock);
+    free(n.bounds);
+    return n.stop ? LEPT_PARSE_HANDLER_STOP : LEPT_PARSE_OK;
+}
+
+//parallel
+#ifndef LEPT_PARALLEL_MIN_SIZE
+#define LEPT_PARALLEL_MIN_SIZE (1 << 20)    /* smaller input is parsed on the calling thread */
+#endif
+
+/* 64-byte block masks, bit i for byte i */
+typedef struct{
+    uint64_t quote, backslash, open, close, comma;
+}lept_block_masks;
+
+static int lept_ctz64(uint64_t x){
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#elif defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while(!(x & 1)){
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+#ifdef LEPT_SIMD_X86
+static void lept_block_classify(const char* p, lept_block_masks* m){
+    const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\'), comma = _mm_set1_epi8(',');
+    const __m128i lower = _mm_set1_epi8(0x20), open = _mm_set1_epi8('{'), close = _mm_set1_epi8('}');
+    int i;
+    memset(m, 0, sizeof(*m));
+    for(i = 0; i < 4; i++){
+        __m128i s = _mm_loadu_si128((const __m128i*)(p + i * 16));
+        __m128i l = _mm_or_si128(s, lower);    /* '[' and ']' become '{' and '}' */
+        m->quote     |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(s, quote)) << (i * 16);
+        m->backslash |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(s, bslash)) << (i * 16);
+        m->comma     |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(s, comma)) << (i * 16);
+        m->open      |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(l, open)) << (i * 16);
+        m->close     |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(l, close)) << (i * 16);
+    }
+}
+#else
+static void lept_block_classify(const char* p, lept_block_masks* m){
+    int i;
+    memset(m, 0, sizeof(*m));
+    for(i = 0; i < 64; i++){
+        uint64_t bit = (uint64_t)1 << i;
+        switch(p[i]){
+            case '"':  m->quote |= bit; break;
+            case '\\': m->backslash |= bit; break;
+            case ',':  m->comma |= bit; break;
+            case '[':
+            case '{':  m->open |= bit; break;
+            case ']':
+            case '}':  m->close |= bit; break;
+        }
+    }
+}
+#endif
+
+/* bit i set when byte i is inside a string: a running xor of the quote bits */
+static uint64_t lept_prefix_xor(uint64_t x){
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/* lept_block_classify() of the n bytes at p, spaces past them if n < 64 */
+static void lept_block_classify_at(const char* p, size_t n, lept_block_masks* m){
+    char tail[64];
+    if(n >= 64){
+        lept_block_classify(p, m);
+        return;
+    }
+    memset(tail, ' ', sizeof(tail));
+    memcpy(tail, p, n);
+    lept_block_classify(tail, m);
+}
+
+/*
+ * the bytes escaped by a backslash, carry is set when the block's last byte
+ * escapes the first of the next one; a backslash escapes the next byte unless
+ * it is escaped itself, and they are rare, so one at a time
+ */
+static uint64_t lept_block_escaped(uint64_t backslash, uint64_t* carry){
+    uint64_t escaped = *carry;
+    *carry = 0;
+    for(; backslash != 0; backslash &= backslash - 1){
+        int i = lept_ctz64(backslash);
+        if((escaped >> i) & 1)
+            continue;
+        if(i == 63)
+            *carry = 1;
+        else
+            escaped |= (uint64_t)1 << (i + 1);
+    }
+    return escaped;
+}
+
+/*
+ * Stage one: finds the top-level array's own commas, outside strings and nested
+ * containers, from per-block bitmaps of quotes, backslashes and brackets. It counts
+ * the elements and, for each of runs equal byte ranges, records the index and
+ * offset of the first element starting in it. Returns 0 for anything not shaped
+ * like a closed array; the element parse checks the rest.
+ */
+static int lept_index_array(const char* json, size_t len, size_t begin, size_t runs,
+    size_t* first, size_t* offset, size_t* size, size_t* close){
+    size_t pos, depth = 0, count = 1, run = 1;
+    uint64_t in_string = 0, escaped_carry = 0;
+    first[0] = 0;
+    offset[0] = begin + 1;
+    for(pos = begin; pos < len; pos += 64){
+        lept_block_masks m;
+        uint64_t escaped, structural;
+        lept_block_classify_at(json + pos, len - pos, &m);
+        escaped = lept_block_escaped(m.backslash, &escaped_carry);
+        in_string = lept_prefix_xor(m.quote & ~escaped) ^ in_string;
+        structural = (m.open | m.close | m.comma) & ~in_string;
+        in_string = (uint64_t)0 - (in_string >> 63);     /* all ones if the block ends inside a string */
+        for(; structural != 0; structural &= structural - 1){
+            size_t p = pos + lept_ctz64(structural);
+            if((m.open >> (p - pos)) & 1)
+                depth++;
+            else if((m.close >> (p - pos)) & 1){
+                if(--depth == 0){
+                    *size = count;
+                    *close = p;
+                    for(; run <= runs; run++){
+                        first[run] = count;
+                        offset[run] = p;
+                    }
+                    return 1;
+                }
+            }
+            else if(depth == 1){
+                /* an element starts after p; the runs it is past begin with it */
+                for(; run < runs && p + 1 >= begin + (len - begin) / runs * run; run++){
+                    first[run] = count;
+                    offset[run] = p + 1;
+                }
+                count++;
+            }
+        }
+    }
+    return 0;
+}
+
+/* elements [first, last) of an array of size elements, from json to just past the separator at stop */
+typedef struct{
+    const char* json, *stop, *end;
+    lept_value* e;
+    size_t first, last, size;
+    int ret;
+}lept_parallel_run;
+
+static void lept_parallel_parse(lept_parallel_run* r){
+    lept_context c;
+    size_t i;
+    lept_context_init(&c, r->json, r->end - r->json);
+    r->ret = LEPT_PARSE_OK;
+    for(i = r->first; i < r->last; i++){
+        lept_parse_whitespace(&c);
+        if((r->ret = lept_parse_value(&c, &r->e[i])) != LEPT_PARSE_OK)
+            break;
+        lept_parse_whitespace(&c);
+        if(PEEK(c.json, c.end) != (i + 1 == r->size ? ']' : ',')){
+            r->ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        }
+        c.json++;
+    }
+    /* runs must meet exactly, or the index was wrong about this input */
+    if(r->ret == LEPT_PARSE_OK && c.json != r->stop)
+        r->ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+    free(c.stack);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI lept_parallel_thread(LPVOID r){
+    lept_parallel_parse((lept_parallel_run*)r);
+    return 0;
+}
+#elif !defined(LEPT_NO_THREADS)
+static void* lept_parallel_thread(void* r){
+    lept_parallel_parse((lept_parallel_run*)r);
+    return NULL;
+}
+#endif
+
+int lept_parse_parallel(lept_value* v, const char* json, size_t len, int nthreads){
+    size_t begin = 0, runs, i, size, close, *first, *offset;
+    lept_parallel_run* r;
+    lept_value* e;
+    int ok;
+    assert(v != NULL && (json != NULL || len == 0));
+    nthreads = lept_thread_count(nthreads);
+    while(begin < len && ISWS(json[begin]))
+        begin++;
+    if(nthreads == 1 || len < LEPT_PARALLEL_MIN_SIZE || begin == len || json[begin] != '[')
+        return lept_parse_n(v, json, len);
+    runs = (size_t)nthreads;
+    first = (size_t*)malloc((runs + 1) * 2 * sizeof(size_t));
+    offset = first + runs + 1;
+    ok = lept_index_array(json, len, begin, runs, first, offset, &size, &close);
+    if(ok){
+        /* "[ ]" has no comma and no element, and only whitespace may follow the array */
+        const char* p = json + begin + 1;
+        while(ISWS(*p))
+            p++;
+        ok = *p != ']';
+        for(p = json + close + 1; ok && p != json + len; p++)
+            ok = ISWS(*p);
+    }
+    if(!ok){
+        free(first);
+        return lept_parse_n(v, json, len);
+    }
+
+    e = (lept_value*)malloc(size * sizeof(lept_value));
+    r = (lept_parallel_run*)malloc(runs * sizeof(lept_parallel_run));
+    for(i = 0; i < size; i++)
+        lept_init(&e[i]);
+    for(i = 0; i < runs; i++){
+        r[i].json = json + offset[i];
+        r[i].stop = json + (first[i + 1] == size ? close + 1 : offset[i + 1]);
+        r[i].end = json + len;
+        r[i].e = e;
+        r[i].first = first[i];
+        r[i].last = first[i + 1];
+        r[i].size = size;
+        r[i].ret = LEPT_PARSE_OK;
+    }
+#if defined(LEPT_NO_THREADS)
+    for(i = 0; i < runs; i++)
+        lept_parallel_parse(&r[i]);
+#else
+    {
+        /* the caller's thread takes run 0, and any run a thread could not be started for */
+        lept_thread* threads = (lept_thread*)malloc(runs * sizeof(lept_thread));
+        int* started = (int*)calloc(runs, sizeof(int));
+        for(i = 1; i < runs; i++){
+            if(r[i].first == r[i].last)
+                continue;
+#if defined(_WIN32)
+            started[i] = (threads[i] = CreateThread(NULL, 0, lept_parallel_thread, &r[i], 0, NULL)) != NULL;
+#else
+            started[i] = pthread_create(&threads[i], NULL, lept_parallel_thread, &r[i]) == 0;
+#endif
+        }
+        for(i = 0; i < runs; i++)
+            if(!started[i] && r[i].first != r[i].last)
+                lept_parallel_parse(&r[i]);
+        for(i = 1; i < runs; i++)
+            if(started[i]){
+#if defined(_WIN32)
+                WaitForSingleObject(threads[i], INFINITE);
+                CloseHandle(threads[i]);
+#else
+                pthread_join(threads[i], NULL);
+#endif
+            }
+        free(started);
+        free(threads);
+    }
+#endif
+    for(i = 0; i < runs; i++)
+        ok &= r[i].ret == LEPT_PARSE_OK;
+    free(r);
+    free(first);
+    if(!ok){
+        /* the sequential parse finds the error lept_parse_n() reports */
+        for(i = 0; i < size; i++)
+            lept_free(&e[i]);
+        free(e);
+        return lept_parse_n(v, json, len);
+    }
+    lept_init(v);
+    v->type = LEPT_ARRAY;
+    v->u.a.e = e;
+    v->u.a.size = v->u.a.capacity = size;
+    return LEPT_PARSE_OK;
+}
+
+//lazy
+/* values are mostly packed, so the common case does not go through the pointer */
+static const char* lept_lazy_whitespace(const char* p, const char* end){
+    return p != end && ISWS(*p) ? lept_skip_whitespace(p, end) : p;
+}
+
+/* a byte that can start a value; lept_lazy values always start with one */
+static int lept_lazy_starts_value(const char* p, const char* end){
+    if(p == end)
+        return 0;
+    switch(*p){
+        case 'n': case 't': case 'f': case '"': case '[': case '{': case '-':
+            return 1;
+        default:
+            return ISDIGIT(*p);
+    }
+}
+
+static const char* lept_lazy_skip_string(const char* p, const char* end){
+    for(p++; ; p++){
+        p = lept_scan_string(p, end);
+        if(p == end)
+            return NULL;
+        if(*p == '"')
+            return p + 1;
+        if(*p == '\\' && ++p == end)
+            return NULL;
+    }
+}
+
+/*
+ * one past the close bracket that ends the depth containers p is in, or the one
+ * p opens if depth is 0; from the block masks, ignoring brackets in strings
+ */
+static const char* lept_lazy_skip_container(const char* p, const char* end, size_t depth){
+    uint64_t in_string = 0, escaped_carry = 0;
+    for(; p < end; p += 64){
+        lept_block_masks m;
+        uint64_t escaped, structural;
+        lept_block_classify_at(p, end - p, &m);
+        escaped = lept_block_escaped(m.backslash, &escaped_carry);
+        in_string = lept_prefix_xor(m.quote & ~escaped) ^ in_string;
+        structural = (m.open | m.close) & ~in_string;
+        in_string = (uint64_t)0 - (in_string >> 63);
+        for(; structural != 0; structural &= structural - 1){
+            int i = lept_ctz64(structural);
+            if((m.open >> i) & 1)
+                depth++;
+            else if(--depth == 0)
+                return p + i + 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * one past the value at p, NULL if the input ends first. Only string and bracket
+ * bounds are looked at; lept_lazy_get_value() checks the rest.
+ */
+static const char* lept_lazy_skip(const char* p, const char* end){
+    switch(*p){
+        case '"':
+            return lept_lazy_skip_string(p, end);
+        case '[':
+        case '{':
+            return lept_lazy_skip_container(p, end, 0);
+        default:
+            while(p != end && !ISWS(*p) && *p != ',' && *p != ']' && *p != '}')
+                p++;
+            return p;
+    }
+}
+
+/* the value of the member whose key starts at p */
+static const char* lept_lazy_member_value(const char* p, const char* end){
+    if(p == end || *p != '"' || (p = lept_lazy_skip_string(p, end)) == NULL)
+        return NULL;
+    p = lept_lazy_whitespace(p, end);
+    if(p == end || *p != ':')
+        return NULL;
+    p = lept_lazy_whitespace(p + 1, end);
+    return lept_lazy_starts_value(p, end) ? p : NULL;
+}
+
+/* the first element, or the first member's key, of container v; NULL if it is empty or malformed */
+static const char* lept_lazy_first(const lept_lazy* v){
+    const char* p = lept_lazy_whitespace(v->json + 1, v->end);
+    if(*v->json == '[')
+        return lept_lazy_starts_value(p, v->end) ? p : NULL;
+    return p != v->end && *p == '"' ? p : NULL;
+}
+
+/* from an element or member of container v to the next one, NULL after the last one or on malformed input */
+static const char* lept_lazy_next(const lept_lazy* v, const char* p){
+    if(*v->json == '{' && (p = lept_lazy_member_value(p, v->end)) == NULL)
+        return NULL;
+    if((p = lept_lazy_skip(p, v->end)) == NULL)
+        return NULL;
+    p = lept_lazy_whitespace(p, v->end);
+    if(p == v->end || *p != ',')
+        return NULL;
+    p = lept_lazy_whitespace(p + 1, v->end);
+    if(*v->json == '[')
+        return lept_lazy_starts_value(p, v->end) ? p : NULL;
+    return p != v->end && *p == '"' ? p : NULL;
+}
+
+int lept_lazy_init(lept_lazy* v, const char* json, size_t len){
+    const char* p;
+    assert(v != NULL && (json != NULL || len == 0));
+    if(len == 0)
+        return LEPT_PARSE_EXPECT_VALUE;
+    p = lept_skip_whitespace(json, json + len);
+    if(p == json + len)
+        return LEPT_PARSE_EXPECT_VALUE;
+    if(!lept_lazy_starts_value(p, json + len))
+        return LEPT_PARSE_INVALID_VALUE;
+    v->json = p;
+    v->end = json + len;
+    return LEPT_PARSE_OK;
+}
+
+lept_type lept_lazy_get_type(const lept_lazy* v){
+    assert(v != NULL);
+    switch(*v->json){
+        case 'n': return LEPT_NULL;
+        case 't': return LEPT_TRUE;
+        case 'f': return LEPT_FALSE;
+        case '"': return LEPT_STRING;
+        case '[': return LEPT_ARRAY;
+        case '{': return LEPT_OBJECT;
+        default:  return LEPT_NUMBER;
+    }
+}
+
+int lept_lazy_get_boolean(const lept_lazy* v){
+    assert(v != NULL && (*v->json == 't' || *v->json == 'f'));
+    return *v->json == 't';
+}
+
+double lept_lazy_get_number(const lept_lazy* v){
+    lept_context c;
+    lept_value n;
+    assert(v != NULL && lept_lazy_get_type(v) == LEPT_NUMBER);
+    lept_context_init(&c, v->json, v->end - v->json);
+    return lept_parse_number(&c, &n) == LEPT_PARSE_OK ? n.u.n : 0.0;
+}
+
+const char* lept_lazy_get_raw(const lept_lazy* v, size_t* len){
+    const char* end;
+    assert(v != NULL && len != NULL);
+    if((end = lept_lazy_skip(v->json, v->end)) == NULL)
+        return NULL;
+    *len = end - v->json;
+    return v->json;
+}
+
+int lept_lazy_get_value(const lept_lazy* v, lept_value* out){
+    lept_context c;
+    int ret;
+    assert(v != NULL && out != NULL);
+    lept_init(out);
+    lept_context_init(&c, v->json, v->end - v->json);
+    ret = lept_parse_value(&c, out);
+    free(c.stack);
+    return ret;
+}
+
+size_t lept_lazy_get_array_size(const lept_lazy* v){
+    const char* p;
+    size_t size = 0;
+    assert(v != NULL && *v->json == '[');
+    for(p = lept_lazy_first(v); p != NULL; p = lept_lazy_next(v, p))
+        size++;
+    return size;
+}
+
+int lept_lazy_get_array_element(const lept_lazy* v, size_t index, lept_lazy* e){
+    const char* p;
+    assert(v != NULL && *v->json == '[' && e != NULL);
+    for(p = lept_lazy_first(v); p != NULL && index != 0; index--)
+        p = lept_lazy_next(v, p);
+    if(p == NULL)
+        return 0;
+    e->json = p;
+    e->end = v->end;
+    return 1;
+}
+
+size_t lept_lazy_get_object_size(const lept_lazy* v){
+    const char* p;
+    size_t size = 0;
+    assert(v != NULL && *v->json == '{');
+    for(p = lept_lazy_first(v); p != NULL; p = lept_lazy_next(v, p))
+        size++;
+    return size;
+}
+
+int lept_lazy_get_object_key(const lept_lazy* v, size_t index, lept_lazy* k){
+    const char* p;
+    assert(v != NULL && *v->json == '{' && k != NULL);
+    for(p = lept_lazy_first(v); p != NULL && index != 0; index--)
+        p = lept_lazy_next(v, p);
+    if(p == NULL)
+        return 0;
+    k->json = p;
+    k->end = v->end;
+    return 1;
+}
+
+int lept_lazy_get_object_value(const lept_lazy* v, size_t index, lept_lazy* m){
+    lept_lazy k;
+    if(!lept_lazy_get_object_key(v, index, &k) || (m->json = lept_lazy_member_value(k.json, v->end)) == NULL)
+        return 0;
+    m->end = v->end;
+    return 1;
+}
+
+int lept_lazy_find_object_value(const lept_lazy* v, const char* key, size_t klen, lept_lazy* m){
+    const char* p;
+    assert(v != NULL && *v->json == '{' && (key != NULL || klen == 0) && m != NULL);
+    for(p = lept_lazy_first(v); p != NULL; p = lept_lazy_next(v, p)){
+        const char* q = lept_lazy_skip_string(p, v->end);
+        size_t raw;
+        int match;
+        if(q == NULL)
+            return 0;
+        /* escapes only make a key shorter */
+        if((raw = q - p - 2) < klen)
+            continue;
+        if(memchr(p + 1, '\\', raw) == NULL)
+            match = raw == klen && memcmp(p + 1, key, klen) == 0;
+        else{
+            /* an escaped key is compared unescaped */
+            lept_context c;
+            char* s;
+            size_t len;
+            lept_context_init(&c, p, v->end - p);
+            match = lept_parse_string_raw(&c, &s, &len) == LEPT_PARSE_OK && len == klen && memcmp(s, key, klen) == 0;
+            free(c.stack);
+        }
+        if(match){
+            if((m->json = lept_lazy_member_value(p, v->end)) == NULL)
+                return 0;
+            m->end = v->end;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//pointer
+/* the array index a reference token names, LEPT_POINTER_NOT_INDEX unless it is 0 or has no leading zero */
+static size_t lept_pointer_index(const char* s, size_t len){
+    size_t i, index = 0;
+    if(len == 0 || (len > 1 && s[0] == '0'))
+        return LEPT_POINTER_NOT_INDEX;
+    for(i = 0; i < len; i++){
+        if(!ISDIGIT(s[i]) || index > (LEPT_POINTER_NOT_INDEX - 1 - (s[i] - '0')) / 10)
+            return LEPT_POINTER_NOT_INDEX;
+        index = index * 10 + (s[i] - '0');
+    }
+    return index;
+}
+
+int lept_pointer_compile(lept_pointer* p, const char* pointer, size_t len){
+    size_t i, n = 0;
+    char* s;
+    assert(p != NULL && (pointer != NULL || len == 0));
+    p->tokens = NULL;
+    p->count = 0;
+    if(len != 0 && pointer[0] != '/')
+        return 0;
+    for(i = 0; i < len; i++){
+        if(pointer[i] == '/')
+            n++;
+        else if(pointer[i] == '~' && (i + 1 == len || (pointer[i + 1] != '0' && pointer[i + 1] != '1')))
+            return 0;
+    }
+    if(n == 0)
+        return 1;
+    /* the tokens, then their unescaped bytes: no longer than the pointer once each '/' is a terminator */
+    p->tokens = (lept_pointer_token*)malloc(n * sizeof(lept_pointer_token) + len);
+    s = (char*)(p->tokens + n);
+    for(i = 0; i < len; ){
+        lept_pointer_token* t = &p->tokens[p->count++];
+        t->s = s;
+        for(i++; i < len && pointer[i] != '/'; i++){
+            if(pointer[i] == '~')
+                *s++ = pointer[++i] == '0' ? '~' : '/';
+            else
+                *s++ = pointer[i];
+        }
+        t->len = s - t->s;
+        *s++ = '\0';
+        t->index = lept_pointer_index(t->s, t->len);
+    }
+    return 1;
+}
+
+void lept_pointer_free(lept_pointer* p){
+    assert(p != NULL);
+    free(p->tokens);
+    p->tokens = NULL;
+    p->count = 0;
+}
+
+lept_value* lept_pointer_find(const lept_value* v, const lept_pointer* p){
+    size_t i;
+    assert(v != NULL && p != NULL);
+    for(i = 0; i < p->count && v != NULL; i++){
+        const lept_pointer_token* t = &p->tokens[i];
+        if(v->type == LEPT_OBJECT)
+            v = lept_find_object_value(v, t->s, t->len);
+        else if(v->type == LEPT_ARRAY)
+            v = t->index < v->u.a.size ? &v->u.a.e[t->index] : NULL;
+        else
+            v = NULL;
+    }
+    return (lept_value*)v;
+}
+
+lept_value* lept_pointer_get(const lept_value* v, const char* pointer){
+    lept_pointer p;
+    lept_value* found;
+    assert(v != NULL && pointer != NULL);
+    if(!lept_pointer_compile(&p, pointer, strlen(pointer)))
+        return NULL;
+    found = lept_pointer_find(v, &p);
+    lept_pointer_free(&p);
+    return found;
+}
+
+/* lept_extract() state; a pointer is found, dead once the path it named is passed, or still open */
+#define LEPT_EXTRACT_DEAD ((size_t)-1)
+
+typedef struct{
+    const lept_pointer* pointers;
+    lept_lazy* values;          /* json is NULL until found */
+    size_t* depth;              /* tokens matched by the current path, or LEPT_EXTRACT_DEAD */
+    size_t count, left;         /* pointers neither found nor dead */
+    const char* end;
+    lept_context c;             /* unescapes keys */
+}lept_extract_context;
+
+/* the pointers open at depth d: matched so far and not found */
+#define EXTRACT_OPEN(x, i, d) ((x)->depth[i] == (d) && (x)->values[i].json == NULL)
+
+/* after the value at depth d + 1 under the current path: the pointers that went into it and did not find it never will */
+static void lept_extract_close(lept_extract_context* x, size_t d){
+    size_t i;
+    for(i = 0; i < x->count; i++)
+        if(EXTRACT_OPEN(x, i, d + 1)){
+            x->depth[i] = LEPT_EXTRACT_DEAD;
+            x->left--;
+        }
+}
+
+/* whether a pointer open at depth d may still match element index on, or any member for LEPT_POINTER_NOT_INDEX */
+static int lept_extract_waiting(const lept_extract_context* x, size_t d, size_t index){
+    size_t i;
+    for(i = 0; i < x->count; i++)
+        if(EXTRACT_OPEN(x, i, d) && (index == LEPT_POINTER_NOT_INDEX ||
+            (x->pointers[i].tokens[d].index != LEPT_POINTER_NOT_INDEX && x->pointers[i].tokens[d].index >= index)))
+            return 1;
+    return 0;
+}
+
+static int lept_extract_skip_error(char ch){
+    return ch == '"' ? LEPT_PARSE_MISS_QUOTATION_MARK :
+        ch == '[' ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+}
+
+/*
+ * the value at p, at depth d of the current path; returns one past it, or p once
+ * every pointer is settled, or NULL with *ret set. Values no open pointer goes
+ * into are skipped, not parsed.
+ */
+static const char* lept_extract_value(lept_extract_context* x, const char* p, size_t d, int* ret){
+    const char* end = x->end, *q;
+    size_t i, k;
+    int descend = 0;
+    for(i = 0; i < x->count; i++){
+        if(!EXTRACT_OPEN(x, i, d))
+            continue;
+        if(x->pointers[i].count == d){
+            x->values[i].json = p;
+            x->values[i].end = end;
+            x->left--;
+        }
+        else
+            descend = 1;
+    }
+    if(x->left == 0)
+        return p;
+    if(!descend || (*p != '[' && *p != '{')){
+        if((q = lept_lazy_skip(p, end)) == NULL)
+            *ret = lept_extract_skip_error(*p);
+        return q;
+    }
+
+    if(*p == '['){
+        p = lept_lazy_whitespace(p + 1, end);
+        if(p != end && *p == ']')
+            return p + 1;
+        for(k = 0; ; k++){
+            if(!lept_lazy_starts_value(p, end)){
+                *ret = p == end ? LEPT_PARSE_EXPECT_VALUE : LEPT_PARSE_INVALID_VALUE;
+                return NULL;
+            }
+            for(i = 0; i < x->count; i++)
+                if(EXTRACT_OPEN(x, i, d) && x->pointers[i].tokens[d].index == k)
+                    x->depth[i] = d + 1;
+            q = lept_extract_value(x, p, d + 1, ret);
+            lept_extract_close(x, d);
+            if(q == NULL || x->left == 0)
+                return q;
+            p = lept_lazy_whitespace(q, end);
+            if(p != end && *p == ']')
+                return p + 1;
+            if(p == end || *p != ','){
+                *ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                return NULL;
+            }
+            p = lept_lazy_whitespace(p + 1, end);
+            /* no pointer wants a later element: skip to the close bracket */
+            if(!lept_extract_waiting(x, d, k + 1)){
+                if((q = lept_lazy_skip_container(p, end, 1)) == NULL)
+                    *ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+                return q;
+            }
+        }
+    }
+
+    p = lept_lazy_whitespace(p + 1, end);
+    if(p != end && *p == '}')
+        return p + 1;
+    for(;;){
+        const char* key;
+        size_t klen;
+        if(p == end || *p != '"'){
+            *ret = LEPT_PARSE_MISS_KEY;
+            return NULL;
+        }
+        if((q = lept_lazy_skip_string(p, end)) == NULL){
+            *ret = LEPT_PARSE_MISS_QUOTATION_MARK;
+            return NULL;
+        }
+        key = p + 1;
+        klen = q - p - 2;
+        if(memchr(key, '\\', klen) != NULL){
+            char* s;
+            x->c.json = p;
+            x->c.end = end;
+            if((*ret = lept_parse_string_raw(&x->c, &s, &klen)) != LEPT_PARSE_OK)
+                return NULL;
+            key = s;
+        }
+        for(i = 0; i < x->count; i++)
+            if(EXTRACT_OPEN(x, i, d) && x->pointers[i].tokens[d].len == klen && memcmp(x->pointers[i].tokens[d].s, key, klen) == 0)
+                x->depth[i] = d + 1;
+        p = lept_lazy_whitespace(q, end);
+        if(p == end || *p != ':'){
+            *ret = LEPT_PARSE_MISS_COLON;
+            return NULL;
+        }
+        p = lept_lazy_whitespace(p + 1, end);
+        if(!lept_lazy_starts_value(p, end)){
+            *ret = p == end ? LEPT_PARSE_EXPECT_VALUE : LEPT_PARSE_INVALID_VALUE;
+            return NULL;
+        }
+        q = lept_extract_value(x, p, d + 1, ret);
+        lept_extract_close(x, d);
+        if(q == NULL || x->left == 0)
+            return q;
+        p = lept_lazy_whitespace(q, end);
+        if(p != end && *p == '}')
+            return p + 1;
+        if(p == end || *p != ','){
+            *ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            return NULL;
+        }
+        p = lept_lazy_whitespace(p + 1, end);
+        if(!lept_extract_waiting(x, d, LEPT_POINTER_NOT_INDEX)){
+            if((q = lept_lazy_skip_container(p, end, 1)) == NULL)
+                *ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            return q;
+        }
+    }
+}
+
+int lept_extract(const char* json, size_t len, const lept_pointer* pointers, size_t count, lept_lazy* values){
+    lept_extract_context x;
+    lept_lazy root;
+    size_t i;
+    int ret;
+    assert((json != NULL || len == 0) && (pointers != NULL || count == 0) && (values != NULL || count == 0));
+    for(i = 0; i < count; i++)
+        values[i].json = values[i].end = NULL;
+    if((ret = lept_lazy_init(&root, json, len)) != LEPT_PARSE_OK || count == 0)
+        return ret;
+    x.pointers = pointers;
+    x.values = values;
+    x.depth = (size_t*)calloc(count, sizeof(size_t));
+    x.count = x.left = count;
+    x.end = root.end;
+    lept_context_init(&x.c, json, len);
+    ret = LEPT_PARSE_OK;
+    lept_extract_value(&x, root.json, 0, &ret);
+    free(x.c.stack);
+    free(x.depth);
+    return ret;
+}
+
+//projection
+/* lept_parse_projected() state */
+struct lept_projection{
+    const lept_pointer* paths;
+    size_t count;
+    size_t* depth;      /* keys of each path matched by the members the parse is in */
+    size_t level;       /* projected members the parse is in */
+};
+
+static int lept_project_enter(lept_projection* pr, const char* key, size_t klen){
+    size_t i, d = pr->level;
+    int keep = LEPT_PROJECT_NONE;
+    for(i = 0; i < pr->count; i++){
+        const lept_pointer_token* t;
+        if(pr->depth[i] != d)
+            continue;
+        t = &pr->paths[i].tokens[d];
+        if(t->len == klen && memcmp(t->s, key, klen) == 0){
+            pr->depth[i] = d + 1;
+            if(pr->paths[i].count == d + 1)
+                keep = LEPT_PROJECT_ALL;
+            else if(keep == LEPT_PROJECT_NONE)
+                keep = LEPT_PROJECT_SOME;
+        }
+    }
+    if(keep != LEPT_PROJECT_NONE)
+        pr->level++;
+    return keep;
+}
+
+static void lept_project_leave(lept_projection* pr){
+    size_t i, d = pr->level--;
+    for(i = 0; i < pr->count; i++)
+        if(pr->depth[i] == d)
+            pr->depth[i] = d - 1;
+}
+
+int lept_parse_projected(lept_value* v, const char* json, size_t len, const lept_pointer* paths, size_t count){
+    lept_context c;
+    lept_projection pr;
+    size_t i;
+    int ret;
+    assert(v != NULL && (json != NULL || len == 0) && (paths != NULL || count == 0));
+    for(i = 0; i < count; i++)
+        if(paths[i].count == 0)
+            return lept_parse_n(v, json, len);
+    lept_context_init(&c, json, len);
+    pr.paths = paths;
+    pr.count = count;
+    pr.depth = (size_t*)calloc(count ? count : 1, sizeof(size_t));
+    pr.level = 0;
+    c.project = &pr;
+    ret = lept_parse_root(&c, v);
+    free(pr.depth);
+    return ret;
+}
+
+//msgpack
+/* big-endian n-byte x at p */
+static char* lept_msgpack_put(char* p, uint64_t x, int n){
+    int i;
+    for(i = n - 1; i >= 0; i--){
+        p[i] = (char)(x & 0xFF);
+        x >>= 8;
+    }
+    return p + n;
+}
+
+static uint64_t lept_msgpack_get(const char* p, int n){
+    uint64_t x = 0;
+    int i;
+    for(i = 0; i < n; i++)
+        x = x << 8 | (unsigned char)p[i];
+    return x;
+}
+
+/*
+ * the header of a string, array or map of n: fix | n below fix_max, else the
+ * tag for 8, 16 or 32-bit lengths in tags (arrays and maps have no 8-bit form, 0)
+ */
+static char* lept_msgpack_header(char* p, size_t n, unsigned fix, size_t fix_max, const unsigned char tags[3]){
+    if(n < fix_max)
+        *p++ = (char)(fix | n);
+    else if(n <= 0xFF && tags[0] != 0){
+        *p++ = (char)tags[0];
+        p = lept_msgpack_put(p, n, 1);
+    }
+    else if(n <= 0xFFFF){
+        *p++ = (char)tags[1];
+        p = lept_msgpack_put(p, n, 2);
+    }
+    else{
+        assert((uint64_t)n <= 0xFFFFFFFFu);
+        *p++ = (char)tags[2];
+        p = lept_msgpack_put(p, n, 4);
+    }
+    return p;
+}
+
+static const unsigned char lept_msgpack_str_tags[3] = { 0xd9, 0xda, 0xdb };
+static const unsigned char lept_msgpack_array_tags[3] = { 0, 0xdc, 0xdd };
+static const unsigned char lept_msgpack_map_tags[3] = { 0, 0xde, 0xdf };
+
+/* integral numbers in the smallest int form, others as float32 when that is exact, -0.0 included */
+static char* lept_msgpack_number(char* p, double n){
+    if(n >= 0.0 && n < 18446744073709551616.0 && (double)(uint64_t)n == n && !signbit(n)){
+        uint64_t u = (uint64_t)n;
+        if(u < 0x80)
+            *p++ = (char)u;
+        else if(u <= 0xFF){
+            *p++ = (char)0xcc;
+            p = lept_msgpack_put(p, u, 1);
+        }
+        else if(u <= 0xFFFF){
+            *p++ = (char)0xcd;
+            p = lept_msgpack_put(p, u, 2);
+        }
+        else if(u <= 0xFFFFFFFFu){
+            *p++ = (char)0xce;
+            p = lept_msgpack_put(p, u, 4);
+        }
+        else{
+            *p++ = (char)0xcf;
+            p = lept_msgpack_put(p, u, 8);
+        }
+    }
+    else if(n < 0.0 && n >= -9223372036854775808.0 && (double)(int64_t)n == n){
+        int64_t i = (int64_t)n;
+        if(i >= -32)
+            *p++ = (char)(0xe0 | (i & 0x1f));
+        else if(i >= INT8_MIN){
+            *p++ = (char)0xd0;
+            p = lept_msgpack_put(p, (uint64_t)i, 1);
+        }
+        else if(i >= INT16_MIN){
+            *p++ = (char)0xd1;
+            p = lept_msgpack_put(p, (uint64_t)i, 2);
+        }
+        else if(i >= INT32_MIN){
+            *p++ = (char)0xd2;
+            p = lept_msgpack_put(p, (uint64_t)i, 4);
+        }
+        else{
+            *p++ = (char)0xd3;
+            p = lept_msgpack_put(p, (uint64_t)i, 8);
+        }
+    }
+    else if((double)(float)n == n){
+        float f = (float)n;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        *p++ = (char)0xca;
+        p = lept_msgpack_put(p, bits, 4);
+    }
+    else{
+        uint64_t bits;
+        memcpy(&bits, &n, sizeof(bits));
+        *p++ = (char)0xcb;
+        p = lept_msgpack_put(p, bits, 8);
+    }
+    return p;
+}
+
+size_t lept_msgpack_size(const lept_value* v){
+    char scratch[9];
+    size_t i, size;
+    assert(v != NULL);
+    switch(v->type){
+        case LEPT_NUMBER:
+            return lept_msgpack_number(scratch, v->u.n) - scratch;
+        case LEPT_STRING:
+            return lept_msgpack_header(scratch, lept_get_string_length(v), 0xa0, 32, lept_msgpack_str_tags) - scratch +
+                lept_get_string_length(v);
+        case LEPT_ARRAY:
+            size = lept_msgpack_header(scratch, v->u.a.size, 0x90, 16, lept_msgpack_array_tags) - scratch;
+            for(i = 0; i < v->u.a.size; i++)
+                size += lept_msgpack_size(&v->u.a.e[i]);
+            return size;
+        case LEPT_OBJECT:
+            size = lept_msgpack_header(scratch, v->u.o.size, 0x80, 16, lept_msgpack_map_tags) - scratch;
+            for(i = 0; i < v->u.o.size; i++)
+                size += lept_msgpack_header(scratch, v->u.o.m[i].klen, 0xa0, 32, lept_msgpack_str_tags) - scratch +
+                    v->u.o.m[i].klen + lept_msgpack_size(&v->u.o.m[i].v);
+            return size;
+        default:
+            return 1;
+    }
+}
+
+static char* lept_msgpack_write(char* p, const lept_value* v){
+    size_t i;
+    switch(v->type){
+        case LEPT_NULL:  *p++ = (char)0xc0; break;
+        case LEPT_FALSE: *p++ = (char)0xc2; break;
+        case LEPT_TRUE:  *p++ = (char)0xc3; break;
+        case LEPT_NUMBER:
+            p = lept_msgpack_number(p, v->u.n);
+            break;
+        case LEPT_STRING:
+            p = lept_msgpack_header(p, lept_get_string_length(v), 0xa0, 32, lept_msgpack_str_tags);
+            memcpy(p, lept_get_string(v), lept_get_string_length(v));
+            p += lept_get_string_length(v);
+            break;
+        case LEPT_ARRAY:
+            p = lept_msgpack_header(p, v->u.a.size, 0x90, 16, lept_msgpack_array_tags);
+            for(i = 0; i < v->u.a.size; i++)
+                p = lept_msgpack_write(p, &v->u.a.e[i]);
+            break;
+        case LEPT_OBJECT:
+            p = lept_msgpack_header(p, v->u.o.size, 0x80, 16, lept_msgpack_map_tags);
+            for(i = 0; i < v->u.o.size; i++){
+                p = lept_msgpack_header(p, v->u.o.m[i].klen, 0xa0, 32, lept_msgpack_str_tags);
+                memcpy(p, v->u.o.m[i].k, v->u.o.m[i].klen);
+                p = lept_msgpack_write(p + v->u.o.m[i].klen, &v->u.o.m[i].v);
+            }
+            break;
+    }
+    return p;
+}
+
+char* lept_to_msgpack(const lept_value* v, size_t* length){
+    size_t size = lept_msgpack_size(v);
+    char* buf = (char*)malloc(size);
+    lept_msgpack_write(buf, v);
+    if(length)
+        *length = size;
+    return buf;
+}
+
+size_t lept_to_msgpack_into(const lept_value* v, char* buf, size_t cap){
+    size_t size = lept_msgpack_size(v);
+    assert(buf != NULL || cap == 0);
+    if(size > cap)
+        return 0;
+    lept_msgpack_write(buf, v);
+    return size;
+}
+
+/* the n-byte big-endian length or number after the tag, LEPT_PARSE_INVALID_MSGPACK if the input ends first */
+#define MSGPACK_GET(c, x, n)\
+    do{\
+        if((size_t)((c)->end - (c)->json) < (size_t)(n))\
+            return LEPT_PARSE_INVALID_MSGPACK;\
+        x = lept_msgpack_get((c)->json, n);\
+        (c)->json += (n);\
+    }while(0)
+
+/* a str or bin, which both become strings; *s points into the input */
+static int lept_msgpack_string(lept_context* c, const char** s, size_t* len){
+    unsigned char tag;
+    uint64_t x;
+    if(c->json == c->end)
+        return LEPT_PARSE_INVALID_MSGPACK;
+    tag = (unsigned char)*c->json++;
+    if((tag & 0xe0) == 0xa0)
+        x = tag & 0x1f;
+    else if(tag == 0xd9 || tag == 0xc4)
+        MSGPACK_GET(c, x, 1);
+    else if(tag == 0xda || tag == 0xc5)
+        MSGPACK_GET(c, x, 2);
+    else if(tag == 0xdb || tag == 0xc6)
+        MSGPACK_GET(c, x, 4);
+    else
+        return LEPT_PARSE_INVALID_MSGPACK;
+    if((uint64_t)(c->end - c->json) < x)
+        return LEPT_PARSE_INVALID_MSGPACK;
+    *s = c->json;
+    *len = (size_t)x;
+    c->json += *len;
+    return LEPT_PARSE_OK;
+}
+
+/* depth is the containers already open around this one */
+static int lept_msgpack_array(lept_context* c, lept_value* v, size_t n, size_t depth){
+    size_t i;
+    int ret;
+    if(depth == LEPT_MSGPACK_MAX_DEPTH)
+        return LEPT_PARSE_DEPTH_EXCEEDED;
+    /* every element takes a byte at least, which bounds what a bad count can allocate */
+    if(n > (size_t)(c->end - c->json))
+        return LEPT_PARSE_INVALID_MSGPACK;
+    v->type = LEPT_ARRAY;
+    v->u.a.e = n > 0 ? (lept_value*)malloc(n * sizeof(lept_value)) : NULL;
+    v->u.a.size = 0;
+    v->u.a.capacity = n;
+    for(i = 0; i < n; i++){
+        lept_init(&v->u.a.e[i]);
+        if((ret = lept_msgpack_value(c, &v->u.a.e[i], depth + 1)) != LEPT_PARSE_OK){
+            lept_free(&v->u.a.e[i]);
+            lept_free(v);
+            return ret;
+        }
+        v->u.a.size++;
+    }
+    return LEPT_PARSE_OK;
+}
+
+static int lept_msgpack_map(lept_context* c, lept_value* v, size_t n, size_t depth){
+    const char* s;
+    size_t i;
+    int ret;
+    if(depth == LEPT_MSGPACK_MAX_DEPTH)
+        return LEPT_PARSE_DEPTH_EXCEEDED;
+    if(n > (size_t)(c->end - c->json) / 2)
+        return LEPT_PARSE_INVALID_MSGPACK;
+    v->type = LEPT_OBJECT;
+    v->u.o.m = n > 0 ? (lept_member*)malloc(lept_object_bytes(n)) : NULL;
+    v->u.o.size = 0;
+    v->u.o.capacity = n;
+    for(i = 0; i < n; i++){
+        lept_member* m = &v->u.o.m[i];
+        /* keys are strings, json has no others */
+        if((ret = lept_msgpack_string(c, &s, &m->klen)) == LEPT_PARSE_OK){
+            memcpy(m->k = (char*)malloc(m->klen + 1), s, m->klen);
+            m->k[m->klen] = '\0';
+            lept_init(&m->v);
+            if((ret = lept_msgpack_value(c, &m->v, depth + 1)) != LEPT_PARSE_OK){
+                lept_free(&m->v);
+                free(m->k);
+            }
+        }
+        if(ret != LEPT_PARSE_OK){
+            lept_free(v);
+            return ret;
+        }
+        v->u.o.size++;
+    }
+    lept_index_build(v);
+    return LEPT_PARSE_OK;
+}
+
+static int lept_msgpack_value(lept_context* c, lept_value* v, size_t depth){
+    unsigned char tag;
+    uint64_t x;
+    size_t n;
+    const char* s;
+    int ret;
+    if(c->json == c->end)
+        return LEPT_PARSE_INVALID_MSGPACK;
+    tag = (unsigned char)*c->json++;
+    if(tag <= 0x7f || tag >= 0xe0){
+        v->type = LEPT_NUMBER;
+        v->u.n = tag <= 0x7f ? (double)tag : (double)((int)tag - 0x100);
+        return LEPT_PARSE_OK;
+    }
+    if((tag & 0xe0) == 0xa0 || tag == 0xd9 || tag == 0xda || tag == 0xdb || tag == 0xc4 || tag == 0xc5 || tag == 0xc6){
+        c->json--;
+        if((ret = lept_msgpack_string(c, &s, &n)) != LEPT_PARSE_OK)
+            return ret;
+        lept_set_string(v, s, n);
+        return LEPT_PARSE_OK;
+    }
+    if((tag & 0xf0) == 0x90)
+        return lept_msgpack_array(c, v, tag & 0x0f, depth);
+    if((tag & 0xf0) == 0x80)
+        return lept_msgpack_map(c, v, tag & 0x0f, depth);
+    switch(tag){
+        case 0xc0: v->type = LEPT_NULL; return LEPT_PARSE_OK;
+        case 0xc2: v->type = LEPT_FALSE; return LEPT_PARSE_OK;
+        case 0xc3: v->type = LEPT_TRUE; return LEPT_PARSE_OK;
+        case 0xcc: case 0xcd: case 0xce: case 0xcf:
+            MSGPACK_GET(c, x, 1 << (tag - 0xcc));
+            v->type = LEPT_NUMBER;
+            v->u.n = (double)x;
+            return LEPT_PARSE_OK;
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+            int bytes = 1 << (tag - 0xd0);
+            MSGPACK_GET(c, x, bytes);
+            if(bytes < 8 && (x >> (bytes * 8 - 1)))
+                x |= ~(uint64_t)0 << (bytes * 8);    /* sign extension */
+            v->type = LEPT_NUMBER;
+            v->u.n = (double)(int64_t)x;
+            return LEPT_PARSE_OK;
+        }
+        case 0xca: {
+            float f;
+            uint32_t bits;
+            MSGPACK_GET(c, x, 4);
+            bits = (uint32_t)x;
+            memcpy(&f, &bits, sizeof(f));
+            v->u.n = f;
+            break;
+        }
+        case 0xcb:
+            MSGPACK_GET(c, x, 8);
+            memcpy(&v->u.n, &x, sizeof(x));
+            break;
+        case 0xdc: case 0xdd:
+            MSGPACK_GET(c, x, tag == 0xdc ? 2 : 4);
+            return lept_msgpack_array(c, v, (size_t)x, depth);
+        case 0xde: case 0xdf:
+            MSGPACK_GET(c, x, tag == 0xde ? 2 : 4);
+            return lept_msgpack_map(c, v, (size_t)x, depth);
+        default:
+            /* 0xc1 is never used, ext types have no json form */
+            return LEPT_PARSE_INVALID_MSGPACK;
+    }
+    /* a float: json has no NaN or infinity */
+    if(v->u.n != v->u.n || v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL)
+        return LEPT_PARSE_INVALID_MSGPACK;
+    v->type = LEPT_NUMBER;
+    return LEPT_PARSE_OK;
+}
+
+int lept_from_msgpack(lept_value* v, const char* data, size_t len){
+    lept_context c;
+    int ret;
+    assert(v != NULL && (data != NULL || len == 0));
+    lept_init(v);
+    lept_context_init(&c, data, len);
+    if((ret = lept_msgpack_value(&c, v, 0)) == LEPT_PARSE_OK && c.json != c.end){
+        lept_free(v);
+        ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    return ret;
+}
+
+//stringify
+#ifndef LEPT_PARSE_STRINGIFY_INIT_SIZE
+#define LEPT_PARSE_STRINGIFY_INIT_SIZE 256
+#endif
+
+#ifndef LEPT_STRINGIFY_CHUNK_SIZE
+#define LEPT_STRINGIFY_CHUNK_SIZE 65536     /* lept_stringify_to() output piece */
+#endif
+
+/* the longest run of string bytes lept_stringify_to() copies to the stack at once */
+#define LEPT_STRINGIFY_STRING_BLOCK 4096
+
+/*
+ * Shortest round-trip number formatting (Schubfach, R. Giulietti): finds the
+ * decimal f * 10^e with the fewest digits that still parses back to the same
+ * double, picking the closest one when there are several. The layout follows
+ * printf("%.17g"): exponent notation only when the exponent is < -4 or >= 17.
+ */
+#define LEPT_NUMBER_MAX_LENGTH 32
+
+static uint64_t lept_umul128_hi(uint64_t a, uint64_t b){
+    uint64_t hi;
+    lept_umul128(a, b, &hi);
+    return hi;
+}
+
+/* floor(g * cp / 2^127) with the lowest bit set when the discarded part is nonzero */
+static uint64_t lept_schubfach_rop(uint64_t g1, uint64_t g0, uint64_t cp){
+    uint64_t x1 = lept_umul128_hi(g0, cp);
+    uint64_t y0, y1 = lept_umul128_hi(g1, cp), z;
+    y0 = g1 * cp;
+    z = (y0 >> 1) + x1;
+    return (y1 + (z >> 63)) | (((z & 0x7FFFFFFFFFFFFFFFULL) + 0x7FFFFFFFFFFFFFFFULL) >> 63);
+}
+
+/* value is c * 2^q; the shortest decimal is stored as *f * 10^*e */
+static void lept_schubfach(uint64_t c, int q, uint64_t* f, int* e){
+    uint64_t out = c & 1, cb = c << 2, cbr = cb + 2, cbl, g1, g0, vb, vbl, vbr, s, t;
+    int k, h;
+    size_t index;
+    if(c != ((uint64_t)1 << 52) || q == -1074){
+        cbl = cb - 2;
+        k = (int)(((int64_t)q * 661971961083LL) >> 41);                    /* floor(log10(2^q)) */
+    }
+    else{
+        /* the gap below a power of two is half as wide */
+        cbl = cb - 1;
+        k = (int)(((int64_t)q * 661971961083LL - 274743187321LL) >> 41);   /* floor(log10(3/4 * 2^q)) */
+    }
+    h = q + (int)(((int64_t)-k * 913124641741LL) >> 38) + 2;              /* q + floor(log2(10^-k)) + 2 */
+    index = 2 * (size_t)(k - LEPT_POW10_G_MIN);
+    g1 = lept_pow10_g[index];
+    g0 = lept_pow10_g[index + 1];
+    vb = lept_schubfach_rop(g1, g0, cb << h);
+    vbl = lept_schubfach_rop(g1, g0, cbl << h);
+    vbr = lept_schubfach_rop(g1, g0, cbr << h);
+    s = vb >> 2;
+    if(s >= 100){
+        /* try one digit less first */
+        uint64_t sp10 = s / 10 * 10, tp10 = sp10 + 10;
+        int upin = vbl + out <= sp10 << 2;
+        int wpin = (tp10 << 2) + out <= vbr;
+        if(upin != wpin){
+            *f = upin ? sp10 : tp10;
+            *e = k;
+            return;
+        }
+    }
+    t = s + 1;
+    {
+        int uin = vbl + out <= s << 2;
+        int win = (t << 2) + out <= vbr;
+        if(uin != win)
+            *f = uin ? s : t;
+        else{
+            /* both in range: take the closer one, ties to even */
+            int64_t cmp = (int64_t)(vb - ((s + t) << 1));
+            *f = cmp < 0 || (cmp == 0 && (s & 1) == 0) ? s : t;
         }
     }
-    free(m.k);      //free(NULL) is ok here
-    for (i = 0; i < size; i++){
-        lept_member* m = (lept_member*)lept_context_pop(c, sizeof(lept_member));
-        free(m->k);
-        lept_free(&m->v);
+    *e = k;
+}
+
+static int lept_count_digits(uint64_t f){
+    int n = 1;
+    for(; f >= 10; f /= 10)
+        n++;
+    return n;
+}
+
+static char* lept_write_digits(char* p, uint64_t f, int n){
+    int i;
+    for(i = n - 1; i >= 0; i--){
+        p[i] = (char)('0' + f % 10);
+        f /= 10;
     }
-    v->type = LEPT_NULL;
-    return ret;
+    return p + n;
 }
 
-//stringify
-#ifndef LEPT_PARSE_STRINGIFY_INIT_SIZE
-#define LEPT_PARSE_STRINGIFY_INIT_SIZE 256
-#endif
+static int lept_format_number(char* buf, double d){
+    uint64_t bits, c, f;
+    int bq, q, e, n, x, i;
+    char* p = buf;
+    memcpy(&bits, &d, sizeof(d));
+    assert(((bits >> 52) & 0x7FF) != 0x7FF);   /* json has no inf or nan */
+    if(bits >> 63)
+        *p++ = '-';
+    bq = (int)((bits >> 52) & 0x7FF);
+    c = bits & (((uint64_t)1 << 52) - 1);
+    if(bq == 0 && c == 0){
+        *p++ = '0';
+        return (int)(p - buf);
+    }
+    if(bq != 0){
+        c |= (uint64_t)1 << 52;
+        q = bq - 1075;
+        /* integers below 2^53: print them directly */
+        if(q <= 0 && q > -53 && (c & ((((uint64_t)1) << -q) - 1)) == 0){
+            f = c >> -q;
+            return (int)(lept_write_digits(p, f, lept_count_digits(f)) - buf);
+        }
+        lept_schubfach(c, q, &f, &e);
+    }
+    else if(c < 3){
+        /* too few bits for the approximation above; 5e-324 and 1e-323 are the shortest forms */
+        f = c == 1 ? 5 : 1;
+        e = c == 1 ? -324 : -323;
+    }
+    else
+        lept_schubfach(c, -1074, &f, &e);
+    /* drop trailing zeros, count digits */
+    while(f % 10 == 0){
+        f /= 10;
+        e++;
+    }
+    n = lept_count_digits(f);
+    x = e + n - 1;  /* exponent in scientific notation */
+    if(x < -4 || x >= 17){
+        lept_write_digits(p + 1, f, n);
+        p[0] = p[1];
+        if(n > 1){
+            p[1] = '.';
+            p += n + 1;
+        }
+        else
+            p++;
+        *p++ = 'e';
+        *p++ = x < 0 ? '-' : '+';
+        if(x < 0)
+            x = -x;
+        if(x >= 100)
+            *p++ = (char)('0' + x / 100);
+        *p++ = (char)('0' + x / 10 % 10);
+        *p++ = (char)('0' + x % 10);
+    }
+    else if(e >= 0){
+        /* integer: digits then zeros */
+        p = lept_write_digits(p, f, n);
+        for(i = 0; i < e; i++)
+            *p++ = '0';
+    }
+    else if(x >= 0){
+        /* decimal point inside the digits */
+        lept_write_digits(p, f, n);
+        memmove(p + x + 2, p + x + 1, n - x - 1);
+        p[x + 1] = '.';
+        p += n + 1;
+    }
+    else{
+        /* 0.000ddd */
+        *p++ = '0';
+        *p++ = '.';
+        for(i = 0; i < -x - 1; i++)
+            *p++ = '0';
+        p = lept_write_digits(p, f, n);
+    }
+    return (int)(p - buf);
+}
 
-#define PUTS(c, s, len) memcpy(lept_context_push(c, len), s, len)
+/* the letter after '\' for bytes that must be escaped, 'u' for \u00XX, 0 for bytes written as they are */
+static const char lept_escape[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    ['"'] = '"', ['\\'] = '\\'
+};
 
-static void lept_stringify_string(lept_context* c, const char* s, size_t len){
+/*
+ * The bytes that need escaping are the ones lept_scan_string() stops at, so the
+ * runs between them are found with the same vector scan as in parsing and
+ * copied whole; only the escapes themselves go through lept_escape[].
+ */
+
+/* bytes the escaped form of s takes, without the quotes */
+static size_t lept_escaped_length(const char* s, size_t len){
+    const char* end = s + len;
+    size_t n = len;
+    while((s = lept_scan_string(s, end)) != end){
+        n += lept_escape[(unsigned char)*s] == 'u' ? 5 : 1;
+        s++;
+    }
+    return n;
+}
+
+static char* lept_escape_char(char* p, unsigned char ch){
     static const char hex_digits[] =  { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-    size_t i, size;
-    char* head, *p;
+    char e = lept_escape[ch];
+    *p++ = '\\';
+    if(e != 'u')
+        *p++ = e;
+    else{
+        *p++ = 'u'; *p++ = '0'; *p++ = '0';
+        *p++ = hex_digits[ch >> 4];
+        *p++ = hex_digits[ch & 15];
+    }
+    return p;
+}
+
+/* writes the escaped form of s to p, which has room for lept_escaped_length(s, len) bytes */
+static char* lept_escape_string(char* p, const char* s, size_t len){
+    const char* end = s + len, *run;
+    while(s != end){
+        run = lept_scan_string(s, end);
+        memcpy(p, s, run - s);
+        p += run - s;
+        if(run == end)
+            break;
+        p = lept_escape_char(p, (unsigned char)*run);
+        s = run + 1;
+    }
+    return p;
+}
+
+/* reserves stack only for what is written: clean runs as they are, 6 bytes per escape at most */
+static void lept_stringify_string(lept_context* c, const char* s, size_t len){
+    const char* end = s + len, *run;
+    char* head;
     assert( s != NULL);
-    p = head = lept_context_push(c, size = len * 6 + 2);
-    *p++ = '"';
-    for(i = 0; i < len; i++){
-        unsigned char ch = (unsigned char)s[i];
-        switch(ch) {
-            case '\"': *p++ = '\\'; *p++ = '\"'; break;
-            case '\\': *p++ = '\\'; *p++ = '\\'; break;
-            case '\b': *p++ = '\\'; *p++ = 'b';  break;
-            case '\f': *p++ = '\\'; *p++ = 'f';  break;
-            case '\n': *p++ = '\\'; *p++ = 'n';  break;
-            case '\r': *p++ = '\\'; *p++ = 'r';  break;
-            case '\t': *p++ = '\\'; *p++ = 't';  break;
-            default:
-                if (ch < 0x20) {
-                    *p++ = '\\'; *p++ = 'u'; *p++ = '0'; *p++ = '0';
-                    *p++ = hex_digits[ch >> 4];
-                    *p++ = hex_digits[ch & 15];
-                }
-                else
-                    *p++ = s[i];
+    PUTC(c, '"');
+    while(s != end){
+        if(lept_escape[(unsigned char)*s] != 0){
+            head = lept_context_push(c, 6);
+            c->top -= 6 - (lept_escape_char(head, (unsigned char)*s++) - head);
+            continue;
         }
+        run = lept_scan_string(s, end);
+        /* a writer gets a long run in pieces, so the stack stays small */
+        if(c->write != NULL && (size_t)(run - s) > LEPT_STRINGIFY_STRING_BLOCK)
+            run = s + LEPT_STRINGIFY_STRING_BLOCK;
+        PUTS(c, s, run - s);
+        s = run;
+        lept_stringify_flush(c);
     }
-    *p++ = '"';
-    c->top -= size - (p - head);
+    PUTC(c, '"');
 }
 
 static void lept_stringify_value(lept_context* c, const lept_value* v){
     size_t i;
+    if(c->write != NULL){
+        if(c->write_error)
+            return;
+        lept_stringify_flush(c);
+    }
     switch (v->type){
         case LEPT_NULL: PUTS(c, "null", 4); break;
         case LEPT_FALSE: PUTS(c, "false", 5); break;
         case LEPT_TRUE: PUTS(c, "true", 4); break;
         case LEPT_NUMBER: {
-            c->top -= 32 - sprintf(lept_context_push(c, 32), "%.17g", v->u.n);
+            c->top -= LEPT_NUMBER_MAX_LENGTH - lept_format_number(lept_context_push(c, LEPT_NUMBER_MAX_LENGTH), v->u.n);
             break;
         }
         case LEPT_STRING: {
-            lept_stringify_string(c, v->u.s.s, v->u.s.len);
+            lept_stringify_string(c, lept_get_string(v), lept_get_string_length(v));
             break;
         }
         case LEPT_ARRAY: {
@@ -598,8 +4156,8 @@ static void lept_stringify_value(lept_context* c, const lept_value* v){
 char* lept_stringify(const lept_value* v, size_t* length){
     lept_context c;
     assert(v != NULL);
+    lept_context_init(&c, "", 0);
     c.stack = (char*)malloc(c.size = LEPT_PARSE_STRINGIFY_INIT_SIZE);
-    c.top = 0;
     lept_stringify_value(&c, v);
     if (length)
         *length = c.top;
@@ -607,14 +4165,450 @@ char* lept_stringify(const lept_value* v, size_t* length){
     return c.stack;
 }
 
-//query
-#define LEPT_KEY_NOT_EXIST ((size_t)-1)
+static size_t lept_stringify_value_size(const lept_value* v){
+    char buf[LEPT_NUMBER_MAX_LENGTH];
+    size_t i, n;
+    switch (v->type){
+        case LEPT_NULL: return 4;
+        case LEPT_FALSE: return 5;
+        case LEPT_TRUE: return 4;
+        case LEPT_NUMBER: return (size_t)lept_format_number(buf, v->u.n);
+        case LEPT_STRING: return lept_escaped_length(lept_get_string(v), lept_get_string_length(v)) + 2;
+        case LEPT_ARRAY:
+            n = v->u.a.size > 0 ? v->u.a.size + 1 : 2;     /* brackets and commas */
+            for(i = 0; i < v->u.a.size; i++)
+                n += lept_stringify_value_size(&v->u.a.e[i]);
+            return n;
+        case LEPT_OBJECT:
+            n = v->u.o.size > 0 ? v->u.o.size * 2 + 1 : 2;     /* braces, commas and colons */
+            for(i = 0; i < v->u.o.size; i++)
+                n += lept_escaped_length(v->u.o.m[i].k, v->u.o.m[i].klen) + 2 + lept_stringify_value_size(&v->u.o.m[i].v);
+            return n;
+        default: assert(0 && "invalid type"); return 0;
+    }
+}
+
+size_t lept_stringify_size(const lept_value* v){
+    assert(v != NULL);
+    return lept_stringify_value_size(v);
+}
+
+/* the quoted string at p, NULL if it does not fit before end */
+static char* lept_write_string(char* p, char* end, const char* s, size_t len){
+    size_t room = (size_t)(end - p);
+    /* count the escapes only when the worst case, every byte as \u00XX, might not fit */
+    if(room < 2 || (len > (room - 2) / 6 && lept_escaped_length(s, len) > room - 2))
+        return NULL;
+    *p++ = '"';
+    p = lept_escape_string(p, s, len);
+    *p++ = '"';
+    return p;
+}
+
+#define LEPT_WRITE(p, end, s, len) do{ if((size_t)((end) - (p)) < (len)) return NULL; memcpy(p, s, len); (p) += (len); }while(0)
+
+static char* lept_write_value(char* p, char* end, const lept_value* v){
+    char buf[LEPT_NUMBER_MAX_LENGTH];
+    size_t i;
+    switch (v->type){
+        case LEPT_NULL: LEPT_WRITE(p, end, "null", 4); return p;
+        case LEPT_FALSE: LEPT_WRITE(p, end, "false", 5); return p;
+        case LEPT_TRUE: LEPT_WRITE(p, end, "true", 4); return p;
+        case LEPT_NUMBER:
+            if((size_t)(end - p) >= LEPT_NUMBER_MAX_LENGTH)
+                return p + lept_format_number(p, v->u.n);
+            LEPT_WRITE(p, end, buf, (size_t)lept_format_number(buf, v->u.n));
+            return p;
+        case LEPT_STRING:
+            return lept_write_string(p, end, lept_get_string(v), lept_get_string_length(v));
+        case LEPT_ARRAY:
+            LEPT_WRITE(p, end, "[", 1);
+            for(i = 0; i < v->u.a.size; i++){
+                if(i > 0)
+                    LEPT_WRITE(p, end, ",", 1);
+                if((p = lept_write_value(p, end, &v->u.a.e[i])) == NULL)
+                    return NULL;
+            }
+            LEPT_WRITE(p, end, "]", 1);
+            return p;
+        case LEPT_OBJECT:
+            LEPT_WRITE(p, end, "{", 1);
+            for(i = 0; i < v->u.o.size; i++){
+                if(i > 0)
+                    LEPT_WRITE(p, end, ",", 1);
+                if((p = lept_write_string(p, end, v->u.o.m[i].k, v->u.o.m[i].klen)) == NULL)
+                    return NULL;
+                LEPT_WRITE(p, end, ":", 1);
+                if((p = lept_write_value(p, end, &v->u.o.m[i].v)) == NULL)
+                    return NULL;
+            }
+            LEPT_WRITE(p, end, "}", 1);
+            return p;
+        default: assert(0 && "invalid type"); return NULL;
+    }
+}
+
+size_t lept_stringify_into(const lept_value* v, char* buf, size_t cap){
+    char* end;
+    assert(v != NULL && (buf != NULL || cap == 0));
+    if(cap == 0)
+        return 0;
+    end = lept_write_value(buf, buf + cap, v);
+    return end != NULL ? (size_t)(end - buf) : 0;
+}
+
+/* hands the stack to c->write in whole chunks and keeps the rest, which is less than one chunk */
+static void lept_stringify_flush(lept_context* c){
+    size_t n = 0;
+    if(c->write == NULL)
+        return;
+    for(; c->top - n >= LEPT_STRINGIFY_CHUNK_SIZE; n += LEPT_STRINGIFY_CHUNK_SIZE)
+        if(!c->write_error && !c->write(c->ud, c->stack + n, LEPT_STRINGIFY_CHUNK_SIZE))
+            c->write_error = 1;
+    if(n > 0)
+        memmove(c->stack, c->stack + n, c->top -= n);
+}
+
+int lept_stringify_to(const lept_value* v, lept_writer_fn write, void* ud){
+    lept_context c;
+    assert(v != NULL && write != NULL);
+    lept_context_init(&c, "", 0);
+    c.write = write;
+    c.ud = ud;
+    lept_stringify_value(&c, v);
+    lept_stringify_flush(&c);
+    if(!c.write_error && c.top > 0 && !write(ud, c.stack, c.top))
+        c.write_error = 1;
+    free(c.stack);
+    return c.write_error ? LEPT_STRINGIFY_WRITE_ERROR : LEPT_STRINGIFY_OK;
+}
+
+int lept_write_file(void* ud, const char* buf, size_t len){
+    assert(ud != NULL);
+    return fwrite(buf, 1, len, (FILE*)ud) == len;
+}
+
+int lept_write_fd(void* ud, const char* buf, size_t len){
+    int fd;
+    assert(ud != NULL);
+    fd = *(const int*)ud;
+    while(len > 0){
+#if defined(_WIN32)
+        int n = _write(fd, buf, len > 0x40000000 ? 0x40000000 : (unsigned)len);
+        if(n <= 0)
+            return 0;
+#else
+        ssize_t n = write(fd, buf, len);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return 0;
+#endif
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+//snapshot
+#define LEPT_SNAPSHOT_VERSION 1
+#define LEPT_SNAPSHOT_ORDER 0x01020304u     /* reads back as itself only in the writer's byte order */
+
+typedef struct{
+    char magic[8];
+    uint32_t version;
+    uint32_t order;
+    uint64_t size;              /* nodes, right after the header */
+    uint64_t strings_size;      /* pool bytes, right after the nodes */
+}lept_snapshot_header;
+
+static const char lept_snapshot_magic[8] = { 'l', 'e', 'p', 't', 's', 'n', 'a', 'p' };
+
+static int lept_snapshot_count(const lept_value* v, size_t* nodes, size_t* strings){
+    size_t i;
+    ++*nodes;
+    switch(v->type){
+        case LEPT_STRING:
+            *strings += lept_get_string_length(v) + 1;
+            return lept_get_string_length(v) <= UINT32_MAX;
+        case LEPT_ARRAY:
+            for(i = 0; i < v->u.a.size; i++)
+                if(!lept_snapshot_count(&v->u.a.e[i], nodes, strings))
+                    return 0;
+            return v->u.a.size <= UINT32_MAX;
+        case LEPT_OBJECT:
+            *nodes += v->u.o.size;
+            for(i = 0; i < v->u.o.size; i++){
+                *strings += v->u.o.m[i].klen + 1;
+                if(v->u.o.m[i].klen > UINT32_MAX || !lept_snapshot_count(&v->u.o.m[i].v, nodes, strings))
+                    return 0;
+            }
+            return v->u.o.size <= UINT32_MAX;
+        default:
+            return 1;
+    }
+}
+
+/* counts the nodes and pool bytes of v and returns the image length, 0 if a node cannot hold them */
+static size_t lept_snapshot_layout(const lept_value* v, size_t* nodes, size_t* strings){
+    *nodes = *strings = 0;
+    if(!lept_snapshot_count(v, nodes, strings) || (uint64_t)*strings > 0xFFFFFFFFFFFFull ||
+        *nodes > ((size_t)-1 - sizeof(lept_snapshot_header) - *strings) / sizeof(lept_compact_node))
+        return 0;
+    return sizeof(lept_snapshot_header) + *nodes * sizeof(lept_compact_node) + *strings;
+}
+
+size_t lept_snapshot_size(const lept_value* v){
+    size_t nodes, strings;
+    assert(v != NULL);
+    return lept_snapshot_layout(v, &nodes, &strings);
+}
+
+static void lept_snapshot_push(lept_context* c, uint64_t word, size_t len, uint32_t hash){
+    lept_compact_node n;
+    n.word = word;
+    n.len = (uint32_t)len;
+    n.hash = hash;
+    memcpy(lept_context_push(c, sizeof(n)), &n, sizeof(n));
+}
 
+static void lept_snapshot_string(lept_context* c, const char* s, size_t len, size_t* offset){
+    lept_snapshot_push(c, LEPT_COMPACT_TAG(LEPT_STRING) | *offset, len, lept_hash_key(s, len));
+    *offset += len + 1;
+}
+
+/* the node of v: a container's children take the next free nodes, a string the next pool bytes */
+static void lept_snapshot_node(lept_context* c, const lept_value* v, size_t* next, size_t* offset){
+    uint64_t word;
+    switch(v->type){
+        case LEPT_NUMBER:
+            if(v->u.n != v->u.n)
+                word = 0x7FF8000000000000ull;   /* one quiet NaN, others could read as a tag */
+            else
+                memcpy(&word, &v->u.n, sizeof(word));
+            lept_snapshot_push(c, word, 0, 0);
+            break;
+        case LEPT_STRING:
+            lept_snapshot_string(c, lept_get_string(v), lept_get_string_length(v), offset);
+            break;
+        case LEPT_ARRAY:
+            lept_snapshot_push(c, LEPT_COMPACT_TAG(LEPT_ARRAY) | *next, v->u.a.size, 0);
+            *next += v->u.a.size;
+            break;
+        case LEPT_OBJECT:
+            lept_snapshot_push(c, LEPT_COMPACT_TAG(LEPT_OBJECT) | *next, v->u.o.size, 0);
+            *next += v->u.o.size * 2;
+            break;
+        default:
+            lept_snapshot_push(c, LEPT_COMPACT_TAG(v->type), 0, 0);
+    }
+}
+
+static void lept_snapshot_child(lept_context* c, lept_context* queue, const lept_value* v, size_t* next, size_t* offset){
+    lept_snapshot_node(c, v, next, offset);
+    if(v->type == LEPT_ARRAY || v->type == LEPT_OBJECT)
+        memcpy(lept_context_push(queue, sizeof(v)), &v, sizeof(v));
+    lept_stringify_flush(c);
+}
+
+/* a long string goes to the writer in chunks, the stack never holds more than one */
+static void lept_snapshot_bytes(lept_context* c, const char* s, size_t len){
+    size_t n;
+    for(; len > 0; s += n, len -= n){
+        n = len < LEPT_STRINGIFY_CHUNK_SIZE ? len : LEPT_STRINGIFY_CHUNK_SIZE;
+        memcpy(lept_context_push(c, n), s, n);
+        lept_stringify_flush(c);
+    }
+    *(char*)lept_context_push(c, 1) = '\0';
+}
+
+static void lept_snapshot_value_bytes(lept_context* c, const lept_value* v){
+    if(v->type == LEPT_STRING)
+        lept_snapshot_bytes(c, lept_get_string(v), lept_get_string_length(v));
+}
+
+/*
+ * Nodes go out breadth first: the containers, in the order their own nodes were
+ * written, hand out the following node slots to their children, so every block
+ * of children lands exactly where its container says. The pool is then written
+ * in the order its offsets were handed out, by walking the same containers again.
+ */
+int lept_snapshot_write(const lept_value* v, lept_writer_fn write, void* ud){
+    lept_snapshot_header h;
+    lept_context c, queue;
+    const lept_value* e;
+    size_t nodes, strings, next = 1, offset = 0, i, q;
+    assert(v != NULL && write != NULL);
+    if(lept_snapshot_layout(v, &nodes, &strings) == 0)
+        return LEPT_PARSE_COMPACT_TOO_BIG;
+    memcpy(h.magic, lept_snapshot_magic, sizeof(h.magic));
+    h.version = LEPT_SNAPSHOT_VERSION;
+    h.order = LEPT_SNAPSHOT_ORDER;
+    h.size = nodes;
+    h.strings_size = strings;
+    lept_context_init(&c, "", 0);
+    lept_context_init(&queue, "", 0);
+    c.write = write;
+    c.ud = ud;
+    memcpy(lept_context_push(&c, sizeof(h)), &h, sizeof(h));
+
+    lept_snapshot_child(&c, &queue, v, &next, &offset);
+    for(q = 0; q < queue.top && !c.write_error; q += sizeof(e)){
+        memcpy(&e, queue.stack + q, sizeof(e));
+        if(e->type == LEPT_ARRAY)
+            for(i = 0; i < e->u.a.size; i++)
+                lept_snapshot_child(&c, &queue, &e->u.a.e[i], &next, &offset);
+        else
+            for(i = 0; i < e->u.o.size; i++){
+                lept_snapshot_string(&c, e->u.o.m[i].k, e->u.o.m[i].klen, &offset);
+                lept_snapshot_child(&c, &queue, &e->u.o.m[i].v, &next, &offset);
+            }
+    }
+    assert(c.write_error || (next == nodes && offset == strings));
+
+    lept_snapshot_value_bytes(&c, v);
+    for(q = 0; q < queue.top && !c.write_error; q += sizeof(e)){
+        memcpy(&e, queue.stack + q, sizeof(e));
+        if(e->type == LEPT_ARRAY)
+            for(i = 0; i < e->u.a.size; i++)
+                lept_snapshot_value_bytes(&c, &e->u.a.e[i]);
+        else
+            for(i = 0; i < e->u.o.size; i++){
+                lept_snapshot_bytes(&c, e->u.o.m[i].k, e->u.o.m[i].klen);
+                lept_snapshot_value_bytes(&c, &e->u.o.m[i].v);
+            }
+        lept_stringify_flush(&c);
+    }
+    lept_stringify_flush(&c);
+    if(!c.write_error && c.top > 0 && !write(ud, c.stack, c.top))
+        c.write_error = 1;
+    free(c.stack);
+    free(queue.stack);
+    return c.write_error ? LEPT_STRINGIFY_WRITE_ERROR : LEPT_STRINGIFY_OK;
+}
+
+int lept_snapshot_open(lept_compact* d, const void* image, size_t size){
+    lept_snapshot_header h;
+    const char* p = (const char*)image;
+    assert(d != NULL && (image != NULL || size == 0));
+    lept_compact_reset(d);
+    if(size < sizeof(h) || ((uintptr_t)image & 7) != 0)
+        return LEPT_PARSE_INVALID_SNAPSHOT;
+    memcpy(&h, image, sizeof(h));
+    if(memcmp(h.magic, lept_snapshot_magic, sizeof(h.magic)) != 0 || h.version != LEPT_SNAPSHOT_VERSION ||
+        h.order != LEPT_SNAPSHOT_ORDER || h.size == 0 ||
+        h.size > (size - sizeof(h)) / sizeof(lept_compact_node) ||
+        h.strings_size != size - sizeof(h) - h.size * sizeof(lept_compact_node))
+        return LEPT_PARSE_INVALID_SNAPSHOT;
+    d->nodes = (lept_compact_node*)(p + sizeof(h));
+    d->size = (size_t)h.size;
+    d->strings = (char*)(d->nodes + d->size);
+    d->strings_size = (size_t)h.strings_size;
+    d->image = image;
+    return LEPT_PARSE_OK;
+}
+
+/* MAP_SHARED, so every process mapping the file reads the same page cache */
+int lept_snapshot_map(lept_compact* d, const char* path){
+    int ret;
+    size_t length;
+#if defined(_WIN32)
+    HANDLE file, map;
+    LARGE_INTEGER size;
+    const void* image;
+    assert(d != NULL && path != NULL);
+    lept_compact_reset(d);
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return LEPT_PARSE_FILE_ERROR;
+    if(!GetFileSizeEx(file, &size) || (unsigned long long)size.QuadPart > (size_t)-1){
+        CloseHandle(file);
+        return LEPT_PARSE_FILE_ERROR;
+    }
+    if(size.QuadPart == 0){     /* an empty file cannot be mapped */
+        CloseHandle(file);
+        return LEPT_PARSE_INVALID_SNAPSHOT;
+    }
+    length = (size_t)size.QuadPart;
+    map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(map == NULL)
+        return LEPT_PARSE_FILE_ERROR;
+    image = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(map);
+    if(image == NULL)
+        return LEPT_PARSE_FILE_ERROR;
+#else
+    int fd;
+    struct stat st;
+    void* image;
+    assert(d != NULL && path != NULL);
+    lept_compact_reset(d);
+    if((fd = open(path, O_RDONLY)) < 0)
+        return LEPT_PARSE_FILE_ERROR;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (unsigned long long)st.st_size > (size_t)-1){
+        close(fd);
+        return LEPT_PARSE_FILE_ERROR;
+    }
+    if(st.st_size == 0){        /* an empty file cannot be mapped */
+        close(fd);
+        return LEPT_PARSE_INVALID_SNAPSHOT;
+    }
+    length = (size_t)st.st_size;
+    image = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED)
+        return LEPT_PARSE_FILE_ERROR;
+#endif
+    ret = lept_snapshot_open(d, image, length);
+    d->image = image;
+    d->mapped = length;
+    if(ret != LEPT_PARSE_OK)
+        lept_compact_free(d);
+    return ret;
+}
+
+/* children always sit after their container, so a verified image has no cycles */
+int lept_snapshot_verify(const lept_compact* d){
+    const lept_compact_node* n;
+    size_t i, j, offset;
+    assert(d != NULL);
+    if(d->size == 0 || (d->strings_size > 0 && d->strings[d->strings_size - 1] != '\0'))
+        return 0;
+    for(i = 0, n = d->nodes; i < d->size; i++, n++){
+        offset = LEPT_COMPACT_OFFSET(n);
+        switch(lept_compact_get_type(n)){
+            case LEPT_STRING:
+                if(offset >= d->strings_size || n->len >= d->strings_size - offset || d->strings[offset + n->len] != '\0')
+                    return 0;
+                break;
+            case LEPT_ARRAY:
+                if(offset <= i || offset > d->size || n->len > d->size - offset)
+                    return 0;
+                break;
+            case LEPT_OBJECT:
+                if(offset <= i || offset > d->size || n->len > (d->size - offset) / 2)
+                    return 0;
+                for(j = 0; j < n->len; j++)
+                    if(lept_compact_get_type(d->nodes + offset + j * 2) != LEPT_STRING)
+                        return 0;
+                break;
+            default:
+                break;
+        }
+    }
+    return 1;
+}
+
+//query
 size_t lept_find_object_index(const lept_value* v, const char* key, size_t klen){
     size_t i;
     assert(v != NULL && v->type ==LEPT_OBJECT && key != NULL);
+    if(lept_index_slots(v->u.o.capacity) > 0)
+        return lept_index_find(v, key, klen);
+    /* an interned key is found by its address, the bytes are only compared for other keys */
     for( i = 0; i < v->u.o.size; i++)
-        if(v->u.o.m[i].klen == klen && memcmp(v->u.o.m[i].k, key, klen) == 0);
+        if(v->u.o.m[i].klen == klen && (v->u.o.m[i].k == key || memcmp(v->u.o.m[i].k, key, klen) == 0))
             return i;
     return LEPT_KEY_NOT_EXIST;
 }
@@ -632,8 +4626,8 @@ int lept_is_equal(const lept_value* lhs, const lept_value* rhs){
         return 0;
     switch(lhs->type){
         case LEPT_STRING:
-            return lhs->u.s.len == rhs->u.s.len &&
-                    memcmp(lhs->u.s.s, rhs->u.s.s, lhs->u.s.len) == 0;
+            return lept_get_string_length(lhs) == lept_get_string_length(rhs) &&
+                    memcmp(lept_get_string(lhs), lept_get_string(rhs), lept_get_string_length(lhs)) == 0;
         case LEPT_NUMBER:
             return lhs->u.n == rhs->u.n;
         /* array and object type need recursion */
@@ -643,13 +4637,17 @@ int lept_is_equal(const lept_value* lhs, const lept_value* rhs){
             for(i = 0; i < lhs->u.a.size; i++)
                 if(!lept_is_equal(&lhs->u.a.e[i], &rhs->u.a.e[i]))
                     return 0;
+            return 1;
         /* object key-value pair have no order ({"a":1,"b":2} equal {"b":2,"a":1}) */
         case LEPT_OBJECT:
             if(lhs->u.o.size != rhs->u.o.size)
                 return 0;
             for(i = 0; i < lhs->u.o.size; i++){
                 size_t r_index;
-                if( (r_index = lept_find_object_index(rhs, lhs->u.o.m[i].k, lhs->u.o.m[i].klen) ) 
+                /* records from one intern table share key addresses, and mostly key order too */
+                if(rhs->u.o.m[i].k == lhs->u.o.m[i].k && rhs->u.o.m[i].klen == lhs->u.o.m[i].klen)
+                    r_index = i;
+                else if( (r_index = lept_find_object_index(rhs, lhs->u.o.m[i].k, lhs->u.o.m[i].klen) ) 
                     == LEPT_KEY_NOT_EXIST)
                     return 0;
                 if(!lept_is_equal(&lhs->u.o.m[i].v, &rhs->u.o.m[r_index].v))
@@ -661,6 +4659,243 @@ int lept_is_equal(const lept_value* lhs, const lept_value* rhs){
     }
 }
 
+//iterative
+/* the same grammar as lept_parse_value() and friends, with the push parser's frames for the open containers */
+static int lept_parse_iterative_value(lept_push_parser* p){
+    lept_context* c = &p->c;
+    lept_value v;
+    char* str;
+    size_t len;
+    int ret;
+    for(;;){
+        char ch;
+        lept_parse_whitespace(c);
+        ch = PEEK(c->json, c->end);
+        switch(p->state){
+            case LEPT_PUSH_ARRAY_FIRST:
+                if(ch == ']'){
+                    c->json++;
+                    lept_push_close(p);
+                    break;
+                }
+                /* fall through */
+            case LEPT_PUSH_VALUE:
+                if(ch == '[' || ch == '{'){
+                    if((ret = lept_push_open(p, ch == '[' ? LEPT_ARRAY : LEPT_OBJECT)) != LEPT_PARSE_OK)
+                        return ret;
+                    c->json++;
+                    break;
+                }
+                lept_init(&v);
+                if((ret = lept_parse_value(c, &v)) != LEPT_PARSE_OK)
+                    return ret;
+                lept_push_value(p, &v);
+                break;
+            case LEPT_PUSH_OBJECT_FIRST:
+                if(ch == '}'){
+                    c->json++;
+                    lept_push_close(p);
+                    break;
+                }
+                /* fall through */
+            case LEPT_PUSH_KEY:
+                if(ch != '"')
+                    return LEPT_PARSE_MISS_KEY;
+                if((ret = lept_parse_string_raw(c, &str, &len)) != LEPT_PARSE_OK)
+                    return ret;
+                memcpy(PUSH_FRAME(p)->k = (char*)malloc(len + 1), str, len);
+                PUSH_FRAME(p)->k[len] = '\0';
+                PUSH_FRAME(p)->klen = len;
+                p->state = LEPT_PUSH_COLON;
+                break;
+            case LEPT_PUSH_COLON:
+                if(ch != ':')
+                    return LEPT_PARSE_MISS_COLON;
+                c->json++;
+                p->state = LEPT_PUSH_VALUE;
+                break;
+            default:
+                if(p->frame == LEPT_PUSH_ROOT)
+                    return LEPT_PARSE_OK;
+                if(ch == ','){
+                    c->json++;
+                    p->state = PUSH_FRAME(p)->type == LEPT_ARRAY ? LEPT_PUSH_VALUE : LEPT_PUSH_KEY;
+                }
+                else if(ch == (PUSH_FRAME(p)->type == LEPT_ARRAY ? ']' : '}')){
+                    c->json++;
+                    lept_push_close(p);
+                }
+                else
+                    return lept_push_after_value_error(p);
+                break;
+        }
+    }
+}
+
+int lept_parse_iterative(lept_value* v, const char* json, size_t len, size_t max_depth){
+    lept_push_parser p;
+    int ret;
+    assert(v != NULL && (json != NULL || len == 0));
+    lept_init(v);
+    lept_push_parser_init(&p);
+    p.max_depth = max_depth;
+    p.c.json = json;
+    p.c.end = json + len;
+    if((ret = lept_parse_iterative_value(&p)) == LEPT_PARSE_OK){
+        lept_parse_whitespace(&p.c);
+        if(p.c.json != p.c.end)
+            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    if(ret == LEPT_PARSE_OK)
+        memcpy(v, &p.root, sizeof(lept_value));
+    else
+        lept_push_unwind(&p);
+    free(p.c.stack);
+    return ret;
+}
+
+/* a container being walked: v, the one it is compared with, and the next child */
+typedef struct{
+    const lept_value* v;
+    const lept_value* w;
+    size_t i;
+}lept_walk_frame;
+
+#define LEPT_CHILDREN(v) ((v)->type == LEPT_ARRAY ? (v)->u.a.size : (v)->u.o.size)
+#define WALK_TOP(s) ((lept_walk_frame*)((s)->stack + (s)->top) - 1)
+
+static void lept_walk_push(lept_context* s, const lept_value* v, const lept_value* w){
+    lept_walk_frame* f = (lept_walk_frame*)lept_context_push(s, sizeof(lept_walk_frame));
+    f->v = v;
+    f->w = w;
+    f->i = 0;
+}
+
+char* lept_stringify_iterative(const lept_value* v, size_t* length){
+    lept_context c, s;
+    assert(v != NULL);
+    lept_context_init(&c, "", 0);
+    lept_context_init(&s, "", 0);
+    c.stack = (char*)malloc(c.size = LEPT_PARSE_STRINGIFY_INIT_SIZE);
+    for(;;){
+        lept_walk_frame* f;
+        if(v->type == LEPT_ARRAY || v->type == LEPT_OBJECT){
+            PUTC(&c, v->type == LEPT_ARRAY ? '[' : '{');
+            lept_walk_push(&s, v, NULL);
+        }
+        else
+            lept_stringify_value(&c, v);
+        /* close the finished containers, then go on with the next child */
+        for(v = NULL; s.top > 0 && v == NULL; ){
+            f = WALK_TOP(&s);
+            if(f->i == LEPT_CHILDREN(f->v)){
+                PUTC(&c, f->v->type == LEPT_ARRAY ? ']' : '}');
+                lept_context_pop(&s, sizeof(lept_walk_frame));
+                continue;
+            }
+            if(f->i > 0)
+                PUTC(&c, ',');
+            if(f->v->type == LEPT_ARRAY)
+                v = &f->v->u.a.e[f->i];
+            else{
+                lept_stringify_string(&c, f->v->u.o.m[f->i].k, f->v->u.o.m[f->i].klen);
+                PUTC(&c, ':');
+                v = &f->v->u.o.m[f->i].v;
+            }
+            f->i++;
+        }
+        if(v == NULL)
+            break;
+    }
+    free(s.stack);
+    if (length)
+        *length = c.top;
+    PUTC(&c, '\0');
+    return c.stack;
+}
+
+void lept_free_iterative(lept_value* v){
+    lept_context s;
+    assert(v != NULL);
+    lept_context_init(&s, "", 0);
+    if(v->type == LEPT_ARRAY || v->type == LEPT_OBJECT)
+        lept_walk_push(&s, v, NULL);
+    /* children first; a container's own storage goes when its frame is done */
+    while(s.top > 0){
+        lept_walk_frame* f = WALK_TOP(&s);
+        lept_value* x = (lept_value*)f->v;
+        lept_value* child;
+        if(f->i == LEPT_CHILDREN(x)){
+            x->u.a.size = x->u.o.size = 0;  /* the children are gone, lept_free() releases the rest */
+            lept_free(x);
+            lept_context_pop(&s, sizeof(lept_walk_frame));
+            continue;
+        }
+        if(x->type == LEPT_ARRAY)
+            child = &x->u.a.e[f->i];
+        else{
+            if(!(x->flags & LEPT_FLAG_BORROWED_KEYS))
+                free(x->u.o.m[f->i].k);
+            child = &x->u.o.m[f->i].v;
+        }
+        f->i++;
+        if(child->type == LEPT_ARRAY || child->type == LEPT_OBJECT)
+            lept_walk_push(&s, child, NULL);
+        else
+            lept_free(child);
+    }
+    free(s.stack);
+    lept_free(v);
+}
+
+int lept_is_equal_iterative(const lept_value* lhs, const lept_value* rhs){
+    lept_context s;
+    int equal = 1;
+    assert(lhs != NULL && rhs != NULL);
+    lept_context_init(&s, "", 0);
+    for(;;){
+        lept_walk_frame* f;
+        if(lhs->type != rhs->type)
+            equal = 0;
+        else if(lhs->type == LEPT_ARRAY || lhs->type == LEPT_OBJECT){
+            if(LEPT_CHILDREN(lhs) != LEPT_CHILDREN(rhs))
+                equal = 0;
+            else
+                lept_walk_push(&s, lhs, rhs);
+        }
+        else
+            equal = lept_is_equal(lhs, rhs);
+        if(!equal)
+            break;
+        /* the next pair of children, matched by key in objects as lept_is_equal() does */
+        for(lhs = NULL; s.top > 0 && lhs == NULL; ){
+            size_t i, r_index;
+            f = WALK_TOP(&s);
+            if((i = f->i++) == LEPT_CHILDREN(f->v)){
+                lept_context_pop(&s, sizeof(lept_walk_frame));
+                continue;
+            }
+            if(f->v->type == LEPT_ARRAY){
+                lhs = &f->v->u.a.e[i];
+                rhs = &f->w->u.a.e[i];
+                continue;
+            }
+            if(f->w->u.o.m[i].k == f->v->u.o.m[i].k && f->w->u.o.m[i].klen == f->v->u.o.m[i].klen)
+                r_index = i;
+            else if((r_index = lept_find_object_index(f->w, f->v->u.o.m[i].k, f->v->u.o.m[i].klen)) == LEPT_KEY_NOT_EXIST){
+                equal = 0;
+                break;
+            }
+            lhs = &f->v->u.o.m[i].v;
+            rhs = &f->w->u.o.m[r_index].v;
+        }
+        if(lhs == NULL)
+            break;
+    }
+    free(s.stack);
+    return equal;
+}
+
 //copy move and swap
 //copy
 void lept_copy(lept_value* dst, const lept_value* src) {
@@ -668,13 +4903,25 @@ void lept_copy(lept_value* dst, const lept_value* src) {
     assert(src != NULL && dst != NULL && src != dst);
     switch (src->type) {
         case LEPT_STRING:
-            lept_set_string(dst, src->u.s.s, src->u.s.len);
+            lept_set_string(dst, lept_get_string(src), lept_get_string_length(src));
             break;
         case LEPT_ARRAY:
-            /* \todo */
+            lept_set_array(dst, src->u.a.size);
+            for (i = 0; i < src->u.a.size; i++)
+                lept_copy(lept_pushback_array_element(dst), &src->u.a.e[i]);
             break;
         case LEPT_OBJECT:
-            /* \todo */
+            /* member by member, so that duplicate keys are kept as they are */
+            lept_set_object(dst, src->u.o.size);
+            for (i = 0; i < src->u.o.size; i++) {
+                lept_member* m = &dst->u.o.m[i];
+                memcpy(m->k = (char*)malloc(src->u.o.m[i].klen + 1), src->u.o.m[i].k, src->u.o.m[i].klen + 1);
+                m->klen = src->u.o.m[i].klen;
+                lept_init(&m->v);
+                lept_copy(&m->v, &src->u.o.m[i].v);
+            }
+            dst->u.o.size = src->u.o.size;
+            lept_index_build(dst);
             break;
         default:
             lept_free(dst);
@@ -702,9 +4949,6 @@ void lept_swap(lept_value* lhs, lept_value* rhs) {
     }
 }
 
-lept_value* lept_set_object_value(lept_value* v, const char* key, size_t klen){
-
-}
 
 // //parse null
 // static int lept_parse_null(lept_context*c, lept_value* v){
@@ -1,6 +1,8 @@
 #ifndef LEPTJSON_H__
 #define LEPTJSON_H__
 
+#include <stdint.h>
+
 // ALL data type in json
 typedef enum { LEPT_NULL, LEPT_FALSE, LEPT_TRUE, 
 LEPT_NUMBER, LEPT_STRING, LEPT_ARRAY, LEPT_OBJECT } lept_type;
@@ -24,42 +26,202 @@ enum {
     LEPT_PARSE_MISS_KEY,
     LEPT_PARSE_MISS_COLON,
     LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+    LEPT_PARSE_FILE_ERROR,
+    LEPT_PARSE_HANDLER_STOP,
+    LEPT_PARSE_COMPACT_TOO_BIG,
+    LEPT_PARSE_DEPTH_EXCEEDED,
+    LEPT_PARSE_INVALID_MSGPACK,
+    LEPT_PARSE_INVALID_SNAPSHOT,
 
-    LEPT_STRINGIFY_OK
+    LEPT_STRINGIFY_OK,
+    LEPT_STRINGIFY_WRITE_ERROR
 };  // the return value of the first api
 
 // mem efficient way, v->n change to v->u.n or v->u.s/v->u.len
 typedef struct lept_value lept_value;
 typedef struct lept_member lept_member;
+typedef struct lept_document lept_document;
+typedef struct lept_arena_block lept_arena_block;
+typedef struct lept_push_parser lept_push_parser;
+typedef struct lept_push_frame lept_push_frame;
+typedef struct lept_intern_table lept_intern_table;
+typedef struct lept_intern_slot lept_intern_slot;
+typedef struct lept_compact lept_compact;
+typedef struct lept_compact_node lept_compact_node;
+typedef struct lept_lazy lept_lazy;
+typedef struct lept_pointer lept_pointer;
+typedef struct lept_pointer_token lept_pointer_token;
+typedef struct lept_projection lept_projection;
+
+/* lept_value.flags */
+#define LEPT_FLAG_BORROWED      0x1  /* string bytes or element/member buffer are not owned by the value */
+#define LEPT_FLAG_BORROWED_KEYS 0x2  /* object keys are not owned by the value */
+#define LEPT_FLAG_SHORT         0x4  /* string bytes are in u.ss, the length in the flags from LEPT_SHORT_SHIFT up */
+#define LEPT_SHORT_SHIFT        8
 
 struct lept_value{
     union{
-        struct{ lept_member* m; size_t size; }o;   //object
+        struct{ lept_member* m; size_t size, capacity; }o;   //object, capacity >= LEPT_OBJECT_INDEX_THRESHOLD adds a key index after m
         struct{ lept_value* e; size_t size, capacity; }a;    //array
         struct{ char* s; size_t len; }s;           //string
+        char ss[sizeof(void*) + 2 * sizeof(size_t)];    //short string, NUL-terminated, as big as the union
         double n;                                  //number
     }u;
     lept_type type;
+    unsigned flags;                                /* LEPT_FLAG_*, fits in the padding after type */
 } ;
 
+#define LEPT_SHORT_STRING_MAX (sizeof(((lept_value*)0)->u.ss) - 1)
+
 struct lept_member{
     char* k; size_t klen;    /* member key string, key string length */
     lept_value v;            /* member value */
 };
 
+/*
+ * A document owns a whole parsed tree: nodes, keys and string bytes are bump
+ * allocated from large blocks and released together by lept_document_free(),
+ * without walking the tree. Values in it work with every getter and setter;
+ * a setter that needs new memory takes it from the heap as usual, and such
+ * values must be released with lept_free(&doc->root) before the document.
+ */
+struct lept_document{
+    lept_value root;
+    lept_arena_block* blocks;   /* newest first */
+};
+
+/* takes the next len bytes of output; returns nonzero to go on, or 0 on a write error */
+typedef int (*lept_writer_fn)(void* ud, const char* buf, size_t len);
+
 typedef struct{
     const char* json;
+    const char* end;        /* one past the last input byte, nothing is read from here on */
     char* stack;
     size_t size, top;
+    lept_document* doc;     /* allocate from this arena instead of the heap */
+    int insitu;             /* decode strings into the input buffer itself */
+    lept_intern_table* keys;    /* share object keys through this table instead of copying them */
+    lept_writer_fn write;   /* stringify: hand full chunks of the stack to this */
+    void* ud;
+    int write_error;
+    lept_projection* project;   /* build only the members on these paths */
 }lept_context;
 
-#define lept_init(v) do{ (v)->type = LEPT_NULL; }while(0)
+/*
+ * Object keys stored once and shared: objects parsed with a table point at its
+ * copy of each key instead of owning one (LEPT_FLAG_BORROWED_KEYS), so the table
+ * must outlive them. A key can then be looked up by the address the table gave.
+ */
+struct lept_intern_table{
+    lept_intern_slot* slots;        /* open addressing, size is a power of two */
+    size_t size, count;
+    lept_arena_block* blocks;       /* the key bytes */
+};
+
+/*
+ * Event callbacks for lept_parse_sax(), called in document order. Each returns
+ * nonzero to go on, or 0 to stop the parse with LEPT_PARSE_HANDLER_STOP; a NULL
+ * callback skips its events. Strings and keys are not NUL-terminated and only
+ * valid during the call.
+ */
+typedef struct{
+    int (*null)(void* ud);
+    int (*boolean)(void* ud, int b);
+    int (*number)(void* ud, double n);
+    int (*string)(void* ud, const char* s, size_t len);
+    int (*start_array)(void* ud);
+    int (*end_array)(void* ud, size_t size);        /* size: elements in the array */
+    int (*start_object)(void* ud);
+    int (*key)(void* ud, const char* k, size_t klen);
+    int (*end_object)(void* ud, size_t size);       /* size: members in the object */
+}lept_handler;
+
+/*
+ * Parses a document that arrives in chunks: feed them in order, then finish.
+ * Whole tokens are parsed straight from the chunk, one cut by a chunk end is
+ * carried over; open containers are kept on the stack, their elements with them.
+ * The tree and the error code are the ones lept_parse_n() gives for all chunks
+ * joined together.
+ */
+struct lept_push_parser{
+    lept_context c;                 /* open frames and their elements, tokens are parsed through it */
+    lept_value root;
+    char* carry;                    /* the start of a token cut by a chunk end */
+    size_t carry_len, carry_size;
+    size_t frame;                   /* stack offset of the innermost open frame */
+    size_t depth;                   /* open frames */
+    size_t max_depth;               /* more open frames is LEPT_PARSE_DEPTH_EXCEEDED, 0 for no limit; set after init */
+    int state, escape, ret;
+};
+
+/*
+ * A read-only form of a whole document: 16-byte nodes in one array and the
+ * string bytes in one pool. A node's word is its number, or a NaN whose top
+ * bits give the type and whose low 48 bits give an offset: into the pool for a
+ * string, to the first child node for a container. A container's children are
+ * consecutive (an object's as key, value pairs), so element and member access
+ * is indexing. Nodes hold offsets, never addresses.
+ */
+struct lept_compact_node{
+    uint64_t word;
+    uint32_t len;       /* string bytes, array elements or object members */
+    uint32_t hash;      /* strings and keys: FNV-1a of the bytes, compared before them in lookups */
+};
+
+struct lept_compact{
+    lept_compact_node* nodes;   /* nodes[0] is the root */
+    size_t size;
+    char* strings;              /* string and key bytes, each NUL-terminated */
+    size_t strings_size;
+    const void* image;          /* the snapshot nodes and strings point into, NULL if they are allocated */
+    size_t mapped;              /* bytes lept_compact_free() unmaps, 0 if the image is the caller's */
+};
+
+/*
+ * A value left in its json text: where it starts and where the input ends.
+ * Nothing is parsed up front. Accessors skip the values before the one asked
+ * for, brackets and quotes only, and lept_lazy_get_value() parses just that
+ * subtree, so the time spent follows what is read, not the document size. The
+ * input must outlive every lept_lazy taken from it.
+ */
+struct lept_lazy{
+    const char* json;   /* the value's first byte */
+    const char* end;    /* one past the last input byte */
+};
+
+/*
+ * A JSON Pointer (RFC 6901) split into its reference tokens once, with "~1"
+ * and "~0" already unescaped, so it can be applied to any number of documents.
+ */
+struct lept_pointer_token{
+    const char* s;      /* NUL-terminated, but may hold NULs itself */
+    size_t len;
+    size_t index;       /* the array index the token names, or LEPT_POINTER_NOT_INDEX */
+};
+
+struct lept_pointer{
+    lept_pointer_token* tokens;     /* their bytes are in the same block */
+    size_t count;                   /* 0 for "", the whole document */
+};
+
+#define LEPT_POINTER_NOT_INDEX ((size_t)-1)
+
+#define lept_init(v) do{ (v)->type = LEPT_NULL; (v)->flags = 0; }while(0)
 #define lept_set_null(v) lept_free(v)
 
 // twp api func to parse json and access data
 void lept_free(lept_value* v);
 
 int lept_parse(lept_value* v, const char* json);  // char[] json and parse to tree
+/* parses exactly len bytes, json needs no terminator; a NUL byte in a string is an invalid char */
+int lept_parse_n(lept_value* v, const char* json, size_t len);
+/* maps the file at path and parses it in place, LEPT_PARSE_FILE_ERROR if it cannot be opened or mapped */
+int lept_parse_file(lept_value* v, const char* path);
+/*
+ * zero-copy parse: strings and keys are unescaped in place and point into json,
+ * which is modified and must outlive v; lept_free(v) leaves those bytes alone
+ */
+int lept_parse_insitu(lept_value* v, char* json);
 lept_type lept_get_type(const lept_value* v);
 
 //boolean
@@ -75,10 +237,6 @@ const char* lept_get_string(const lept_value* v);
 size_t lept_get_string_length(const lept_value* v);
 void lept_set_string(lept_value* v, const char* s, size_t len);
 
-//unicode
-static const char* lept_parse_hex4(const char* p, unsigned *u);
-static void lept_encode_utf8(lept_context* c, unsigned u);
-
 //array
 size_t lept_get_array_size(const lept_value *v);
 size_t lept_get_array_capacity(const lept_value* v);
@@ -126,18 +284,241 @@ static int lept_parse_literal(lept_context*c, lept_value* v, const char* literal
 static int lept_parse_array(lept_context*c, lept_value* v);
 static int lept_parse_object(lept_context* c, lept_value* v);
 
+//document
+void lept_document_init(lept_document* doc);
+int lept_parse_into_document(lept_document* doc, const char* json);
+lept_value* lept_document_root(lept_document* doc);
+void lept_document_free(lept_document* doc);
+
+//intern
+void lept_intern_init(lept_intern_table* t);
+const char* lept_intern(lept_intern_table* t, const char* key, size_t klen);
+void lept_intern_free(lept_intern_table* t);
+/* lept_parse() with every object key taken from keys */
+int lept_parse_interned(lept_value* v, const char* json, lept_intern_table* keys);
+
+//sax
+/*
+ * streams the document to h without building a tree; memory use is bounded by the
+ * nesting depth and the longest string. Returns the same error codes as lept_parse(),
+ * events before an error have already been delivered.
+ */
+int lept_parse_sax(const char* json, const lept_handler* h, void* ud);
+
+//push
+void lept_push_parser_init(lept_push_parser* p);
+/* returns LEPT_PARSE_OK, or the first error once it is certain; later feeds return it again */
+int lept_push_parser_feed(lept_push_parser* p, const char* chunk, size_t len);
+/* ends the input and moves the document into v; p is then ready for the next document */
+int lept_push_parser_finish(lept_push_parser* p, lept_value* v);
+void lept_push_parser_free(lept_push_parser* p);
+
+//compact
+/*
+ * parses json into d, which must be freed with lept_compact_free() even on error;
+ * LEPT_PARSE_COMPACT_TOO_BIG if a string or container is longer than 32 bits can count
+ */
+int lept_compact_parse(lept_compact* d, const char* json);
+void lept_compact_free(lept_compact* d);
+const lept_compact_node* lept_compact_root(const lept_compact* d);
+lept_type lept_compact_get_type(const lept_compact_node* n);
+int lept_compact_get_boolean(const lept_compact_node* n);
+double lept_compact_get_number(const lept_compact_node* n);
+const char* lept_compact_get_string(const lept_compact* d, const lept_compact_node* n);
+size_t lept_compact_get_string_length(const lept_compact_node* n);
+size_t lept_compact_get_array_size(const lept_compact_node* n);
+const lept_compact_node* lept_compact_get_array_element(const lept_compact* d, const lept_compact_node* n, size_t index);
+size_t lept_compact_get_object_size(const lept_compact_node* n);
+/* the key is a string node */
+const lept_compact_node* lept_compact_get_object_key(const lept_compact* d, const lept_compact_node* n, size_t index);
+const lept_compact_node* lept_compact_get_object_value(const lept_compact* d, const lept_compact_node* n, size_t index);
+/* the value of the first member named key, NULL if there is none */
+const lept_compact_node* lept_compact_find_object_value(const lept_compact* d, const lept_compact_node* n, const char* key, size_t klen);
+/* builds the lept_value tree of node n into dst */
+void lept_compact_copy(lept_value* dst, const lept_compact* d, const lept_compact_node* n);
+
+//ndjson
+/*
+ * called for each non-blank line (one with more than json whitespace) with its
+ * byte offset and lept_parse_n()'s result;
+ * v is freed after the call unless it is moved out with lept_move(). Returns
+ * nonzero to go on.
+ */
+typedef int (*lept_ndjson_fn)(void* ud, size_t offset, int ret, lept_value* v);
+/* calls back on the calling thread in input order; without it, on the workers as lines finish, possibly at once */
+#define LEPT_NDJSON_ORDERED 0x1
+/*
+ * parses newline-delimited json (a trailing '\r' is dropped) on nthreads workers,
+ * 0 for one per cpu, each taking line-aligned chunks with its own context.
+ * LEPT_PARSE_HANDLER_STOP if the callback stopped it; no chunk is started after
+ * that, but without LEPT_NDJSON_ORDERED other workers finish theirs.
+ */
+int lept_parse_ndjson(const char* json, size_t len, int nthreads, int flags, lept_ndjson_fn callback, void* ud);
+
+//parallel
+/*
+ * lept_parse_n() of a large top-level array on nthreads threads, 0 for one per
+ * cpu. A vectorized pass finds string bounds and the array's own commas, which
+ * sizes the element array and splits it into one run of elements per thread.
+ * Other input, and input with an error, is parsed on the calling thread, so the
+ * result and the error code are always lept_parse_n()'s.
+ */
+int lept_parse_parallel(lept_value* v, const char* json, size_t len, int nthreads);
+
+//lazy
+/*
+ * points v at the first value in json; LEPT_PARSE_EXPECT_VALUE or
+ * LEPT_PARSE_INVALID_VALUE if there is none. The rest of the input is not
+ * checked, a malformed part shows up when it is read.
+ */
+int lept_lazy_init(lept_lazy* v, const char* json, size_t len);
+lept_type lept_lazy_get_type(const lept_lazy* v);
+int lept_lazy_get_boolean(const lept_lazy* v);
+/* 0.0 for a malformed number */
+double lept_lazy_get_number(const lept_lazy* v);
+/* the value's own text, NULL if the input ends inside it */
+const char* lept_lazy_get_raw(const lept_lazy* v, size_t* len);
+/* parses the value into out and returns lept_parse_n()'s error code for it */
+int lept_lazy_get_value(const lept_lazy* v, lept_value* out);
+/*
+ * Sizes count the elements or members that start before the input turns
+ * malformed. Getters return 1 and set their last argument, or 0 if the index
+ * or key is not there or the input is malformed before it; lept_lazy_get_value()
+ * on v tells which. Each one skips from the start of v, so index loops are
+ * quadratic.
+ */
+size_t lept_lazy_get_array_size(const lept_lazy* v);
+int lept_lazy_get_array_element(const lept_lazy* v, size_t index, lept_lazy* e);
+size_t lept_lazy_get_object_size(const lept_lazy* v);
+/* the key is a string value */
+int lept_lazy_get_object_key(const lept_lazy* v, size_t index, lept_lazy* k);
+int lept_lazy_get_object_value(const lept_lazy* v, size_t index, lept_lazy* m);
+/* the value of the first member named key, keys with escapes compared unescaped */
+int lept_lazy_find_object_value(const lept_lazy* v, const char* key, size_t klen, lept_lazy* m);
+
+//pointer
+/* returns 1, or 0 with nothing to free if pointer is malformed: not "" or starting with '/', or a '~' not followed by 0 or 1 */
+int lept_pointer_compile(lept_pointer* p, const char* pointer, size_t len);
+void lept_pointer_free(lept_pointer* p);
+/* the value p refers to in v, NULL if there is none; tokens are keys in objects and indexes in arrays, "-" names nothing */
+lept_value* lept_pointer_find(const lept_value* v, const lept_pointer* p);
+/* lept_pointer_find() of a pointer given as text, compiled for this one call */
+lept_value* lept_pointer_get(const lept_value* v, const char* pointer);
+/*
+ * Finds the count pointers in json in one pass and sets values[i] to the value
+ * pointers[i] refers to, or to json NULL if there is none. Nothing is built:
+ * only the containers on the pointers' paths are walked, every other value is
+ * skipped, and the scan stops once every pointer is settled. Returns the error
+ * found on the way, with the values found before it set; the input past the
+ * point where it stopped is not read.
+ */
+int lept_extract(const char* json, size_t len, const lept_pointer* pointers, size_t count, lept_lazy* values);
+
+//projection
+/*
+ * lept_parse_n() that builds only the object members on one of count paths, a
+ * field mask: pointers whose tokens are keys only, as an array on the way is
+ * passed through and the rest of a path applies to each of its elements. A
+ * member a path ends at is built whole; any other member is checked through the
+ * tokenizer but its key and value are never allocated. The error codes are
+ * lept_parse_n()'s for the whole input.
+ */
+int lept_parse_projected(lept_value* v, const char* json, size_t len, const lept_pointer* paths, size_t count);
+#define LEPT_PROJECT_NONE 0     /* the member is left out */
+#define LEPT_PROJECT_SOME 1     /* the member is on a path, only part of its value is built */
+#define LEPT_PROJECT_ALL  2     /* a path ends at the member, all of its value is built */
+
+//msgpack
+/*
+ * MessagePack straight from and to trees, no text in between. Integral numbers
+ * are written in the smallest int form and others as float32 when that is
+ * exact, else float64; strings as str, arrays as array and objects as map.
+ */
+size_t lept_msgpack_size(const lept_value* v);
+char* lept_to_msgpack(const lept_value* v, size_t* length);
+/* writes lept_msgpack_size(v) bytes to buf, or returns 0 and writes nothing if they do not fit in cap */
+size_t lept_to_msgpack_into(const lept_value* v, char* buf, size_t cap);
+#ifndef LEPT_MSGPACK_MAX_DEPTH
+#define LEPT_MSGPACK_MAX_DEPTH 1000     /* containers lept_from_msgpack() lets nest, the decoder recurses per level */
+#endif
+/*
+ * decodes exactly len bytes into v; bin becomes a string. LEPT_PARSE_INVALID_MSGPACK
+ * for truncated input, ext types, a key that is not a str or bin, or a NaN or
+ * infinite float, LEPT_PARSE_DEPTH_EXCEEDED if more than LEPT_MSGPACK_MAX_DEPTH
+ * containers are open at once, LEPT_PARSE_ROOT_NOT_SINGULAR if bytes are left over
+ */
+int lept_from_msgpack(lept_value* v, const char* data, size_t len);
+
 //stringify
 static void lept_stringify_value(lept_context* c, const lept_value* v);
 static void lept_stringify_string(lept_context* c, const char* s, size_t len);
 char* lept_stringify(const lept_value* v, size_t* length);
+/*
+ * writes v through write in LEPT_STRINGIFY_CHUNK_SIZE pieces, the last one shorter,
+ * so memory use does not grow with the output; LEPT_STRINGIFY_WRITE_ERROR once
+ * write returns 0, nothing more is written after that
+ */
+int lept_stringify_to(const lept_value* v, lept_writer_fn write, void* ud);
+int lept_write_file(void* ud, const char* buf, size_t len);    /* ud is a FILE* */
+int lept_write_fd(void* ud, const char* buf, size_t len);      /* ud points to an int file descriptor */
+/* the exact length lept_stringify() gives for v, without writing it */
+size_t lept_stringify_size(const lept_value* v);
+/*
+ * writes v to buf without allocating and returns its length; no terminator is
+ * added. Returns 0 if it does not fit in cap bytes, buf is then partly written.
+ */
+size_t lept_stringify_into(const lept_value* v, char* buf, size_t cap);
+
+//snapshot
+/*
+ * A tree saved in the compact form, to be used where it lies: a 32-byte header,
+ * the nodes, then the string pool. Nodes hold offsets only, so an image means
+ * the same at any address and a mapped file is shared by every process reading
+ * it. Opening checks the header and the sizes, nothing that grows with the
+ * document; the lept_compact_* accessors then read the image in place. Words
+ * are in the writer's byte order, an image from the other order is refused.
+ */
+/* the image length, 0 if a string or container is longer than 32 bits can count */
+size_t lept_snapshot_size(const lept_value* v);
+/*
+ * writes the image of v through write; LEPT_PARSE_COMPACT_TOO_BIG before
+ * writing anything if lept_snapshot_size(v) is 0, else as lept_stringify_to()
+ */
+int lept_snapshot_write(const lept_value* v, lept_writer_fn write, void* ud);
+/*
+ * views size bytes at image, which must be 8-byte aligned and outlive d, as a
+ * compact document; LEPT_PARSE_INVALID_SNAPSHOT if the header or sizes are wrong
+ */
+int lept_snapshot_open(lept_compact* d, const void* image, size_t size);
+/* maps the file at path read-only and opens it, lept_compact_free() unmaps it; LEPT_PARSE_FILE_ERROR as lept_parse_file() */
+int lept_snapshot_map(lept_compact* d, const char* path);
+/*
+ * walks every node of an opened image and returns 0 if one points outside it,
+ * so that an image from an untrusted source can be read safely
+ */
+int lept_snapshot_verify(const lept_compact* d);
 
 //query object
+#define LEPT_KEY_NOT_EXIST ((size_t)-1)
 size_t lept_find_object_index(const lept_value* v, const char* key, size_t klen);
 lept_value* lept_find_object_value(const lept_value* v, const char* key, size_t klen);
 
 //compare value
 int lept_is_equal(const lept_value* lhs, const lept_value* rhs);
 
+//iterative
+/*
+ * Versions of lept_parse_n(), lept_stringify(), lept_free() and lept_is_equal()
+ * that keep open containers on a heap stack instead of recursing, so the C
+ * stack they use does not grow with the nesting depth. The parse fails with
+ * LEPT_PARSE_DEPTH_EXCEEDED as soon as more than max_depth containers are open
+ * (0 for no limit); otherwise the results are the same as the recursive ones.
+ */
+int lept_parse_iterative(lept_value* v, const char* json, size_t len, size_t max_depth);
+char* lept_stringify_iterative(const lept_value* v, size_t* length);
+void lept_free_iterative(lept_value* v);
+int lept_is_equal_iterative(const lept_value* lhs, const lept_value* rhs);
+
 //copy move and swap
 void lept_copy(lept_value* dst, const lept_value* src);
 void lept_move(lept_value* dst, lept_value* src);
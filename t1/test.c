@@ -43,6 +43,9 @@ static int test_pass = 0;
         v.type = LEPT_FALSE;\
         EXPECT_EQ_INT(error, lept_parse(&v, json));\
         EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));\
+        v.type = LEPT_FALSE;\
+        EXPECT_EQ_INT(error, lept_parse_iterative(&v, json, strlen(json), 0));\
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));\
         lept_free(&v);\
     }while(0)
 
@@ -87,6 +90,29 @@ static void test_parse(){
     TEST_ERROR(LEPT_PARSE_ROOT_NOT_SINGULAR, "null Z");
 }
 
+static void test_parse_whitespace(){
+    /* runs shorter and longer than one 16/32-byte vector, ending on every offset */
+    static const char ws[] = " \t\n\r";
+    char json[256];
+    size_t i, n;
+    for(n = 0; n < 80; n++){
+        lept_value v;
+        for(i = 0; i < n; i++)
+            json[i] = ws[i % 4];
+        memcpy(json + n, "[1,", 3);
+        for(i = 0; i < n; i++)
+            json[n + 3 + i] = ws[(i + 1) % 4];
+        memcpy(json + 2 * n + 3, "2]", 3);
+        lept_init(&v);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+        EXPECT_EQ_INT(LEPT_ARRAY, lept_get_type(&v));
+        EXPECT_EQ_SIZE_T(2, lept_get_array_size(&v));
+        lept_free(&v);
+    }
+    TEST_ERROR(LEPT_PARSE_ROOT_NOT_SINGULAR, "null                                  \t\n  x");
+    TEST_ERROR(LEPT_PARSE_EXPECT_VALUE, "                                                      ");
+}
+
 static void test_parse_number(){
     TEST_NUMBER(0.0, "0");
     TEST_NUMBER(0.0, "-0");
@@ -107,6 +133,66 @@ static void test_parse_number(){
     TEST_NUMBER(1.234E+10, "1.234E+10");
     TEST_NUMBER(1.234E-10, "1.234E-10");
     TEST_NUMBER(0.0, "1e-10000"); /* must underflow */
+
+    TEST_NUMBER(1.0000000000000002, "1.0000000000000002"); /* the smallest number > 1 */
+    TEST_NUMBER( 4.9406564584124654e-324, "4.9406564584124654e-324"); /* minimum denormal */
+    TEST_NUMBER(-4.9406564584124654e-324, "-4.9406564584124654e-324");
+    TEST_NUMBER( 2.2250738585072009e-308, "2.2250738585072009e-308");  /* Max subnormal double */
+    TEST_NUMBER(-2.2250738585072009e-308, "-2.2250738585072009e-308");
+    TEST_NUMBER( 2.2250738585072014e-308, "2.2250738585072014e-308");  /* Min normal positive double */
+    TEST_NUMBER(-2.2250738585072014e-308, "-2.2250738585072014e-308");
+    TEST_NUMBER( 1.7976931348623157e+308, "1.7976931348623157e+308");  /* Max double */
+    TEST_NUMBER(-1.7976931348623157e+308, "-1.7976931348623157e+308");
+}
+
+#define TEST_NUMBER_EXACT(json)\
+    do{\
+        lept_value v;\
+        double expect = strtod(json, NULL), actual;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
+        EXPECT_EQ_INT(LEPT_NUMBER, lept_get_type(&v));\
+        actual = lept_get_number(&v);\
+        EXPECT_TRUE(memcmp(&expect, &actual, sizeof(double)) == 0);\
+        lept_free(&v);\
+    }while(0)
+
+/* bit-for-bit against strtod on the cases where rounding is hard */
+static void test_parse_number_exact(){
+    char big[1024];
+    TEST_NUMBER_EXACT("0.1");
+    TEST_NUMBER_EXACT("-0");
+    TEST_NUMBER_EXACT("9007199254740993");         /* 2^53 + 1, halfway, rounds to even */
+    TEST_NUMBER_EXACT("9007199254740995");
+    TEST_NUMBER_EXACT("1e23");
+    TEST_NUMBER_EXACT("123456789012345678901234567890");
+    TEST_NUMBER_EXACT("0.30000000000000001665334536937734810635447502136230468750");
+    TEST_NUMBER_EXACT("2.2250738585072011e-308");
+    TEST_NUMBER_EXACT("2.4703282292062327e-324"); /* just below half the minimum denormal */
+    TEST_NUMBER_EXACT("2.4703282292062328e-324"); /* just above, rounds up to it */
+    TEST_NUMBER_EXACT("1.7976931348623158e308");   /* rounds down to the max double */
+    TEST_NUMBER_EXACT("7.2057594037927933e16");
+    TEST_NUMBER_EXACT("1.00000000000000011102230246251565404236316680908203125");   /* 1 + 2^-53, halfway */
+    TEST_NUMBER_EXACT("1.00000000000000011102230246251565404236316680908203124");
+    TEST_NUMBER_EXACT("1.00000000000000011102230246251565404236316680908203126");
+    TEST_NUMBER_EXACT("0.000000000000000000000000000000000000000000001e300");
+
+    /* an integer part longer than the exact fallback keeps, its dropped digits still count */
+    memcpy(big, "9007199254740993", 16);
+    memset(big + 16, '0', 890);
+    memcpy(big + 906, "1e-891", 7);
+    TEST_NUMBER_EXACT(big);
+    memcpy(big + 906, "1.0e-891", 9);
+    TEST_NUMBER_EXACT(big);
+    memcpy(big + 906, "1.5e-890", 9);
+    TEST_NUMBER_EXACT(big);
+}
+
+static void test_parse_number_too_big() {
+    TEST_ERROR(LEPT_PARSE_NUMBER_TOO_BIG, "1e309");
+    TEST_ERROR(LEPT_PARSE_NUMBER_TOO_BIG, "-1e309");
+    TEST_ERROR(LEPT_PARSE_NUMBER_TOO_BIG, "1.7976931348623159e308");   /* rounds up past the max double */
+    TEST_ERROR(LEPT_PARSE_NUMBER_TOO_BIG, "1e100000000000");
 }
 
 static void test_parse_invalid_value() {
@@ -120,6 +206,10 @@ static void test_parse_invalid_value() {
     TEST_ERROR(LEPT_PARSE_INVALID_VALUE, "inf");
     TEST_ERROR(LEPT_PARSE_INVALID_VALUE, "NAN");
     TEST_ERROR(LEPT_PARSE_INVALID_VALUE, "nan");
+
+    /* invalid value in array */
+    TEST_ERROR(LEPT_PARSE_INVALID_VALUE, "[1,]");
+    TEST_ERROR(LEPT_PARSE_INVALID_VALUE, "[\"a\", nul]");
 }
 
 static void test_parse_string() {
@@ -127,6 +217,11 @@ static void test_parse_string() {
     TEST_STRING("Hello", "\"Hello\"");
     TEST_STRING("Hello\nWorld", "\"Hello\\nWorld\"");
     TEST_STRING("\" \\ / \b \f \n \r \t", "\"\\\" \\\\ \\/ \\b \\f \\n \\r \\t\"");
+    TEST_STRING("\xE4\xB8\xAD\xE6\x96\x87 \xF0\x9D\x84\x9E", "\"\xE4\xB8\xAD\xE6\x96\x87 \xF0\x9D\x84\x9E\"");
+    TEST_STRING("https://example.com/a/very/long/path/that/spans/several/vectors?q=1",
+        "\"https://example.com/a/very/long/path/that/spans/several/vectors?q=1\"");
+    TEST_STRING("0123456789abcdef0123456789abcdef\n0123456789abcdef0123456789abcdef\"x",
+        "\"0123456789abcdef0123456789abcdef\\n0123456789abcdef0123456789abcdef\\\"x\"");
 }
 
 static void test_parse_missing_quotation_mark() {
@@ -144,6 +239,8 @@ static void test_parse_invalid_string_escape() {
 static void test_parse_invalid_string_char() {
     TEST_ERROR(LEPT_PARSE_INVALID_STRING_CHAR, "\"\x01\"");
     TEST_ERROR(LEPT_PARSE_INVALID_STRING_CHAR, "\"\x1F\"");
+    TEST_ERROR(LEPT_PARSE_INVALID_STRING_CHAR, "\"0123456789abcdef0123456789abcdef0123456789\x1F\"");
+    TEST_ERROR(LEPT_PARSE_MISS_QUOTATION_MARK, "\"0123456789abcdef0123456789abcdef0123456789");
 }
 
 // testing unicode
@@ -181,6 +278,44 @@ static void test_access_string(){
     lept_free(&v);
 }
 
+/* strings up to LEPT_SHORT_STRING_MAX bytes live inside the value */
+static void test_access_short_string() {
+    static const char text[] = "0123456789abcdef0123456789abcdef";
+    lept_document doc;
+    lept_value v, w, *e;
+    size_t len;
+    lept_init(&v);
+    lept_init(&w);
+    for (len = LEPT_SHORT_STRING_MAX - 1; len <= LEPT_SHORT_STRING_MAX + 1; len++) {
+        int inline_ = len <= LEPT_SHORT_STRING_MAX;
+        lept_set_string(&v, text, len);
+        EXPECT_EQ_SIZE_T(len, lept_get_string_length(&v));
+        EXPECT_TRUE(memcmp(text, lept_get_string(&v), len) == 0 && lept_get_string(&v)[len] == '\0');
+        EXPECT_EQ_INT(inline_, (const char*)lept_get_string(&v) >= (const char*)&v && lept_get_string(&v) < (const char*)(&v + 1));
+        lept_copy(&w, &v);
+        EXPECT_TRUE(lept_is_equal(&v, &w));
+        lept_swap(&v, &w);
+        EXPECT_EQ_SIZE_T(len, lept_get_string_length(&v));
+        lept_move(&w, &v);
+        EXPECT_TRUE(memcmp(text, lept_get_string(&w), len) == 0);
+    }
+    lept_set_string(&v, "a\0b", 3);
+    EXPECT_EQ_STRING("a\0b", lept_get_string(&v), lept_get_string_length(&v));
+    lept_set_number(&v, 1.0);
+    lept_free(&v);
+    lept_free(&w);
+
+    /* parsed strings are stored the same way, in a document too */
+    TEST_STRING("ok", "\"ok\"");
+    lept_document_init(&doc);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_into_document(&doc, "[\"ok\",\"0123456789abcdef0123456789abcdef\"]"));
+    e = lept_get_array_element(lept_document_root(&doc), 0);
+    EXPECT_TRUE(lept_get_string(e) >= (const char*)e && lept_get_string(e) < (const char*)(e + 1));
+    e = lept_get_array_element(lept_document_root(&doc), 1);
+    EXPECT_EQ_STRING("0123456789abcdef0123456789abcdef", lept_get_string(e), lept_get_string_length(e));
+    lept_document_free(&doc);
+}
+
 // boolean
 static void test_access_boolean(){
     lept_value v;
@@ -203,6 +338,540 @@ static void test_access_number(){
     lept_free(&v);
 }
 
+//object
+static void test_access_object() {
+    lept_value o, v, *pv;
+    size_t i, j, index;
+    char key[16];
+
+    lept_init(&o);
+    for (j = 0; j <= 5; j += 5) {
+        lept_set_object(&o, j);
+        EXPECT_EQ_SIZE_T(0, lept_get_object_size(&o));
+        EXPECT_EQ_SIZE_T(j, lept_get_object_capacity(&o));
+        for (i = 0; i < 10; i++) {
+            key[0] = 'a' + (char)i;
+            key[1] = '\0';
+            lept_init(&v);
+            lept_set_number(&v, (double)i);
+            lept_move(lept_set_object_value(&o, key, 1), &v);
+            lept_free(&v);
+        }
+        EXPECT_EQ_SIZE_T(10, lept_get_object_size(&o));
+        for (i = 0; i < 10; i++) {
+            key[0] = 'a' + (char)i;
+            index = lept_find_object_index(&o, key, 1);
+            EXPECT_TRUE(index != LEPT_KEY_NOT_EXIST);
+            pv = lept_get_object_value(&o, index);
+            EXPECT_EQ_DOUBLE((double)i, lept_get_number(pv));
+        }
+    }
+
+    index = lept_find_object_index(&o, "j", 1);
+    EXPECT_TRUE(index != LEPT_KEY_NOT_EXIST);
+    lept_remove_object_value(&o, index);
+    index = lept_find_object_index(&o, "j", 1);
+    EXPECT_TRUE(index == LEPT_KEY_NOT_EXIST);
+    EXPECT_EQ_SIZE_T(9, lept_get_object_size(&o));
+
+    index = lept_find_object_index(&o, "a", 1);
+    EXPECT_TRUE(index != LEPT_KEY_NOT_EXIST);
+    lept_remove_object_value(&o, index);
+    index = lept_find_object_index(&o, "a", 1);
+    EXPECT_TRUE(index == LEPT_KEY_NOT_EXIST);
+    EXPECT_EQ_SIZE_T(8, lept_get_object_size(&o));
+
+    EXPECT_TRUE(lept_get_object_capacity(&o) > 8);
+    lept_shrink_object(&o);
+    EXPECT_EQ_SIZE_T(8, lept_get_object_capacity(&o));
+    EXPECT_EQ_SIZE_T(8, lept_get_object_size(&o));
+    for (i = 0; i < 8; i++) {
+        key[0] = 'a' + (char)i + 1;
+        EXPECT_EQ_DOUBLE((double)i + 1, lept_get_number(lept_get_object_value(&o, lept_find_object_index(&o, key, 1))));
+    }
+
+    lept_set_string(&v, "Hello", 5);
+    lept_move(lept_set_object_value(&o, "World", 5), &v); /* Test if element is freed */
+    lept_free(&v);
+
+    pv = lept_find_object_value(&o, "World", 5);
+    EXPECT_TRUE(pv != NULL);
+    EXPECT_EQ_STRING("Hello", lept_get_string(pv), lept_get_string_length(pv));
+
+    i = lept_get_object_capacity(&o);
+    lept_clear_object(&o);
+    EXPECT_EQ_SIZE_T(0, lept_get_object_size(&o));
+    EXPECT_EQ_SIZE_T(i, lept_get_object_capacity(&o)); /* capacity remains unchanged */
+    lept_shrink_object(&o);
+    EXPECT_EQ_SIZE_T(0, lept_get_object_capacity(&o));
+
+    lept_free(&o);
+}
+
+/* objects past the index threshold, built, parsed, edited and copied */
+static void test_object_index() {
+    static const char text[] = "{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":9,"
+        "\"k10\":10,\"k11\":11,\"k12\":12,\"k13\":13,\"k14\":14,\"k15\":15,\"k16\":16,\"k17\":17,\"k18\":18,\"k19\":19}";
+    lept_document doc;
+    lept_value o, copy, *root;
+    size_t i, n;
+    char key[16];
+
+    lept_init(&o);
+    lept_set_object(&o, 0);
+    for (i = 0; i < 1000; i++) {
+        n = sprintf(key, "k%d", (int)i);
+        lept_set_number(lept_set_object_value(&o, key, n), (double)i);
+    }
+    EXPECT_EQ_SIZE_T(1000, lept_get_object_size(&o));
+    for (i = 0; i < 1000; i += 7) {
+        n = sprintf(key, "k%d", (int)i);
+        EXPECT_EQ_SIZE_T(i, lept_find_object_index(&o, key, n));
+    }
+    EXPECT_TRUE(lept_find_object_value(&o, "k1000", 5) == NULL);
+    /* removal shifts the later members, the index follows them */
+    lept_remove_object_value(&o, 0);
+    lept_remove_object_value(&o, 500);
+    EXPECT_TRUE(lept_find_object_value(&o, "k0", 2) == NULL);
+    EXPECT_TRUE(lept_find_object_value(&o, "k501", 4) == NULL);
+    EXPECT_EQ_SIZE_T(499, lept_find_object_index(&o, "k500", 4));
+    EXPECT_EQ_SIZE_T(500, lept_find_object_index(&o, "k502", 4));
+    EXPECT_EQ_SIZE_T(997, lept_find_object_index(&o, "k999", 4));
+    /* an existing key gives its value back instead of a second member */
+    lept_set_null(lept_set_object_value(&o, "k999", 4));
+    EXPECT_EQ_SIZE_T(998, lept_get_object_size(&o));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(lept_find_object_value(&o, "k999", 4)));
+
+    lept_init(&copy);
+    lept_copy(&copy, &o);
+    EXPECT_TRUE(lept_is_equal(&o, &copy));
+    EXPECT_EQ_SIZE_T(2, lept_find_object_index(&copy, "k3", 2));
+    lept_free(&copy);
+    lept_free(&o);
+
+    /* parsed into an arena document, then edited */
+    lept_document_init(&doc);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_into_document(&doc, text));
+    root = lept_document_root(&doc);
+    EXPECT_EQ_SIZE_T(20, lept_get_object_size(root));
+    EXPECT_EQ_SIZE_T(17, lept_find_object_index(root, "k17", 3));
+    lept_remove_object_value(root, 3);
+    EXPECT_EQ_SIZE_T(16, lept_find_object_index(root, "k17", 3));
+    lept_set_number(lept_set_object_value(root, "new", 3), 1.0);
+    EXPECT_EQ_SIZE_T(19, lept_find_object_index(root, "new", 3));
+    EXPECT_EQ_SIZE_T(0, lept_find_object_index(root, "k0", 2));
+    lept_free(root);
+    lept_document_free(&doc);
+}
+
+static void test_parse_interned() {
+    lept_intern_table keys;
+    lept_value v, w, *a, *b;
+    size_t i;
+
+    lept_intern_init(&keys);
+    EXPECT_TRUE(lept_intern(&keys, "id", 2) == lept_intern(&keys, "id", 2));
+    EXPECT_TRUE(lept_intern(&keys, "id", 2) != lept_intern(&keys, "ts", 2));
+    EXPECT_EQ_STRING("", lept_intern(&keys, "", 0), 0);
+
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_interned(&v, "[{\"id\":1,\"host\":\"a\"},{\"id\":2,\"host\":\"b\"},{\"host\":\"c\",\"id\":3}]", &keys));
+    EXPECT_EQ_SIZE_T(4, keys.count);    /* "id", "ts", "" and "host" */
+    a = lept_get_array_element(&v, 0);
+    b = lept_get_array_element(&v, 2);
+    EXPECT_TRUE(lept_get_object_key(a, 0) == lept_intern(&keys, "id", 2));
+    EXPECT_TRUE(lept_get_object_key(lept_get_array_element(&v, 1), 1) == lept_get_object_key(a, 1));
+    EXPECT_TRUE(lept_get_object_key(b, 0) == lept_get_object_key(a, 1));
+    EXPECT_EQ_SIZE_T(1, lept_find_object_index(b, lept_intern(&keys, "id", 2), 2));
+    EXPECT_EQ_SIZE_T(0, lept_find_object_index(b, "host", 4));
+
+    /* the same records parsed again are equal, in any key order */
+    lept_init(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_interned(&w, "[{\"host\":\"a\",\"id\":1},{\"id\":2,\"host\":\"b\"},{\"host\":\"c\",\"id\":3}]", &keys));
+    EXPECT_TRUE(lept_is_equal(&v, &w));
+    lept_set_number(lept_find_object_value(lept_get_array_element(&w, 1), "id", 2), 5.0);
+    EXPECT_FALSE(lept_is_equal(&v, &w));
+    lept_free(&w);
+
+    /* editing takes the keys out of the table first */
+    for (i = 0; i < 20; i++)
+        lept_set_number(lept_set_object_value(a, i % 2 ? "x" : "y", 1), (double)i);
+    EXPECT_EQ_SIZE_T(4, lept_get_object_size(a));
+    lept_remove_object_value(b, 0);
+    EXPECT_EQ_SIZE_T(1, lept_get_object_size(b));
+    lept_free(&v);
+
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, lept_parse_interned(&v, "[{\"id\":1},{\"id\" 2}]", &keys));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    lept_intern_free(&keys);
+}
+
+static void test_parse_compact() {
+    static const char json[] = "{\"n\":null,\"f\":false,\"t\":true,\"i\":-123,\"s\":\"a\\u0000b\","
+        "\"a\":[1,[],{},[\"x\",[2]]],\"o\":{\"\":0,\"k\":{\"k\":\"deep\"}},\"k\":\"last\"}";
+    lept_compact d;
+    lept_value v, w;
+    const lept_compact_node *root, *a, *e;
+
+    EXPECT_EQ_SIZE_T(16, sizeof(lept_compact_node));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_compact_parse(&d, json));
+    root = lept_compact_root(&d);
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_compact_get_type(root));
+    EXPECT_EQ_SIZE_T(8, lept_compact_get_object_size(root));
+    EXPECT_EQ_STRING("n", lept_compact_get_string(&d, lept_compact_get_object_key(&d, root, 0)), 1);
+    EXPECT_EQ_INT(LEPT_NULL, lept_compact_get_type(lept_compact_get_object_value(&d, root, 0)));
+    EXPECT_FALSE(lept_compact_get_boolean(lept_compact_find_object_value(&d, root, "f", 1)));
+    EXPECT_TRUE(lept_compact_get_boolean(lept_compact_find_object_value(&d, root, "t", 1)));
+    EXPECT_EQ_DOUBLE(-123.0, lept_compact_get_number(lept_compact_find_object_value(&d, root, "i", 1)));
+    e = lept_compact_find_object_value(&d, root, "s", 1);
+    EXPECT_EQ_STRING("a\0b", lept_compact_get_string(&d, e), lept_compact_get_string_length(e));
+
+    a = lept_compact_find_object_value(&d, root, "a", 1);
+    EXPECT_EQ_SIZE_T(4, lept_compact_get_array_size(a));
+    EXPECT_EQ_DOUBLE(1.0, lept_compact_get_number(lept_compact_get_array_element(&d, a, 0)));
+    EXPECT_EQ_SIZE_T(0, lept_compact_get_array_size(lept_compact_get_array_element(&d, a, 1)));
+    EXPECT_EQ_SIZE_T(0, lept_compact_get_object_size(lept_compact_get_array_element(&d, a, 2)));
+    e = lept_compact_get_array_element(&d, lept_compact_get_array_element(&d, a, 3), 1);
+    EXPECT_EQ_DOUBLE(2.0, lept_compact_get_number(lept_compact_get_array_element(&d, e, 0)));
+
+    /* lookups only see their own object's members */
+    e = lept_compact_find_object_value(&d, lept_compact_find_object_value(&d, root, "o", 1), "k", 1);
+    EXPECT_EQ_STRING("deep", lept_compact_get_string(&d, lept_compact_find_object_value(&d, e, "k", 1)), 4);
+    EXPECT_EQ_STRING("last", lept_compact_get_string(&d, lept_compact_find_object_value(&d, root, "k", 1)), 4);
+    EXPECT_EQ_DOUBLE(0.0, lept_compact_get_number(lept_compact_find_object_value(&d, lept_compact_find_object_value(&d, root, "o", 1), "", 0)));
+    EXPECT_TRUE(lept_compact_find_object_value(&d, root, "x", 1) == NULL);
+
+    /* one node per value and per key */
+    EXPECT_EQ_SIZE_T(1 + 16 + 4 + 2 + 1 + 4 + 2, d.size);
+    lept_init(&v);
+    lept_init(&w);
+    lept_compact_copy(&v, &d, root);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&w, json));
+    EXPECT_TRUE(lept_is_equal(&v, &w));
+    lept_free(&v);
+    lept_free(&w);
+    lept_compact_free(&d);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_compact_parse(&d, " 1.5 "));
+    EXPECT_EQ_SIZE_T(1, d.size);
+    EXPECT_EQ_DOUBLE(1.5, lept_compact_get_number(lept_compact_root(&d)));
+    lept_compact_free(&d);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_compact_parse(&d, "{\"\":\"\"}"));
+    e = lept_compact_get_object_key(&d, lept_compact_root(&d), 0);
+    EXPECT_EQ_STRING("", lept_compact_get_string(&d, e), lept_compact_get_string_length(e));
+    e = lept_compact_find_object_value(&d, lept_compact_root(&d), "", 0);
+    EXPECT_EQ_STRING("", lept_compact_get_string(&d, e), lept_compact_get_string_length(e));
+    EXPECT_EQ_SIZE_T(2, d.strings_size);
+    lept_compact_free(&d);
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_compact_parse(&d, "[\"a\", {\"b\": [1 2]}]"));
+    EXPECT_TRUE(d.nodes == NULL && d.size == 0);
+    lept_compact_free(&d);
+}
+
+static void test_parse_lazy() {
+    static const char json[] = " {\"n\":null,\"f\":false,\"t\":true,\"i\":-123,\"s\":\"a\\u0000b\","
+        "\"a\":[1,[],{},[\"]x,\\\"\",[2]]],\"o\":{\"\":0,\"k\":{\"k\":\"deep\"}},\"k\\u0022\":1,\"k\":\"last\"} ";
+    lept_lazy root, e, a;
+    lept_value v, w;
+    const char* raw;
+    size_t len;
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_lazy_init(&root, json, sizeof(json) - 1));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_lazy_get_type(&root));
+    EXPECT_EQ_SIZE_T(9, lept_lazy_get_object_size(&root));
+    EXPECT_TRUE(lept_lazy_get_object_key(&root, 0, &e));
+    EXPECT_EQ_INT(LEPT_STRING, lept_lazy_get_type(&e));
+    EXPECT_TRUE(lept_lazy_get_object_value(&root, 0, &e));
+    EXPECT_EQ_INT(LEPT_NULL, lept_lazy_get_type(&e));
+    EXPECT_FALSE(lept_lazy_get_object_value(&root, 9, &e));
+    EXPECT_TRUE(lept_lazy_find_object_value(&root, "f", 1, &e));
+    EXPECT_FALSE(lept_lazy_get_boolean(&e));
+    EXPECT_TRUE(lept_lazy_find_object_value(&root, "t", 1, &e));
+    EXPECT_TRUE(lept_lazy_get_boolean(&e));
+    EXPECT_TRUE(lept_lazy_find_object_value(&root, "i", 1, &e));
+    EXPECT_EQ_DOUBLE(-123.0, lept_lazy_get_number(&e));
+    EXPECT_TRUE(lept_lazy_find_object_value(&root, "s", 1, &e));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_lazy_get_value(&e, &v));
+    EXPECT_EQ_STRING("a\0b", lept_get_string(&v), lept_get_string_length(&v));
+    lept_free(&v);
+
+    /* brackets, commas and quotes in strings are skipped over */
+    EXPECT_TRUE(lept_lazy_find_object_value(&root, "a", 1, &a));
+    EXPECT_EQ_SIZE_T(4, lept_lazy_get_array_size(&a));
+    EXPECT_TRUE(lept_lazy_get_array_element(&a, 3, &e));
+    raw = lept_lazy_get_raw(&e, &len);
+    EXPECT_EQ_SIZE_T(sizeof("[\"]x,\\\"\",[2]]") - 1, len);
+    EXPECT_TRUE(memcmp("[\"]x,\\\"\",[2]]", raw, len) == 0);
+    EXPECT_FALSE(lept_lazy_get_array_element(&a, 4, &e));
+    EXPECT_TRUE(lept_lazy_get_array_element(&a, 1, &e));
+    EXPECT_EQ_SIZE_T(0, lept_lazy_get_array_size(&e));
+    EXPECT_TRUE(lept_lazy_get_array_element(&a, 2, &e));
+    EXPECT_EQ_SIZE_T(0, lept_lazy_get_object_size(&e));
+
+    /* lookups only see their own object's members, escaped keys match unescaped */
+    EXPECT_TRUE(lept_lazy_find_object_value(&root, "o", 1, &e));
+    EXPECT_TRUE(lept_lazy_find_object_value(&e, "k", 1, &e));
+    EXPECT_TRUE(lept_lazy_find_object_value(&e, "k", 1, &e));
+    raw = lept_lazy_get_raw(&e, &len);
+    EXPECT_EQ_SIZE_T(sizeof("\"deep\"") - 1, len);
+    EXPECT_TRUE(memcmp("\"deep\"", raw, len) == 0);
+    EXPECT_TRUE(lept_lazy_find_object_value(&root, "k\"", 2, &e));
+    EXPECT_EQ_DOUBLE(1.0, lept_lazy_get_number(&e));
+    EXPECT_TRUE(lept_lazy_find_object_value(&root, "k", 1, &e));
+    raw = lept_lazy_get_raw(&e, &len);
+    EXPECT_EQ_SIZE_T(sizeof("\"last\"") - 1, len);
+    EXPECT_TRUE(memcmp("\"last\"", raw, len) == 0);
+    EXPECT_FALSE(lept_lazy_find_object_value(&root, "x", 1, &e));
+
+    lept_init(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_lazy_get_value(&root, &v));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&w, json));
+    EXPECT_TRUE(lept_is_equal(&v, &w));
+    lept_free(&v);
+    lept_free(&w);
+
+    /* errors show up where they are read, values before them are still there */
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_lazy_init(&root, " ", 1));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, lept_lazy_init(&root, "?", 1));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_lazy_init(&root, "[\"a\", {\"b\": [1 2]}, 3", 20));
+    EXPECT_TRUE(lept_lazy_get_array_element(&root, 1, &e));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_lazy_get_value(&e, &v));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_lazy_init(&root, "[\"a\", [1, 2", 11));
+    EXPECT_EQ_SIZE_T(2, lept_lazy_get_array_size(&root));
+    EXPECT_TRUE(lept_lazy_get_array_element(&root, 1, &e));
+    EXPECT_TRUE(lept_lazy_get_raw(&e, &len) == NULL);
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_lazy_get_value(&e, &v));
+}
+
+static void test_pointer() {
+    /* the example document of RFC 6901 */
+    static const char json[] = "{\"foo\":[\"bar\",\"baz\"],\"\":0,\"a/b\":1,\"c%d\":2,\"e^f\":3,\"g|h\":4,"
+        "\"i\\\\j\":5,\"k\\\"l\":6,\" \":7,\"m~n\":8,\"01\":{\"x\":[[9]]}}";
+    static const char* pointers[] = { "", "/foo", "/foo/0", "/", "/a~1b", "/c%d", "/e^f", "/g|h", "/i\\j", "/k\"l", "/ ", "/m~0n" };
+    lept_pointer p[12];
+    lept_lazy values[12];
+    lept_value v, w;
+    size_t i;
+
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+    for(i = 0; i < 12; i++)
+        EXPECT_TRUE(lept_pointer_compile(&p[i], pointers[i], strlen(pointers[i])));
+    EXPECT_EQ_SIZE_T(0, p[0].count);
+    EXPECT_EQ_SIZE_T(2, p[2].count);
+    EXPECT_EQ_SIZE_T(0, p[2].tokens[1].index);
+    EXPECT_EQ_SIZE_T(1, p[3].count);
+    EXPECT_EQ_SIZE_T(0, p[3].tokens[0].len);
+    EXPECT_EQ_STRING("a/b", p[4].tokens[0].s, p[4].tokens[0].len);
+    EXPECT_EQ_STRING("m~n", p[11].tokens[0].s, p[11].tokens[0].len);
+
+    EXPECT_TRUE(lept_pointer_get(&v, "") == &v);
+    EXPECT_TRUE(lept_pointer_get(&v, "/foo") == lept_find_object_value(&v, "foo", 3));
+    EXPECT_EQ_STRING("bar", lept_get_string(lept_pointer_get(&v, "/foo/0")), lept_get_string_length(lept_pointer_get(&v, "/foo/0")));
+    for(i = 3; i < 12; i++)
+        EXPECT_EQ_DOUBLE((double)(i - 3), lept_get_number(lept_pointer_find(&v, &p[i])));
+    EXPECT_EQ_DOUBLE(9.0, lept_get_number(lept_pointer_get(&v, "/01/x/0/0")));
+    EXPECT_TRUE(lept_pointer_get(&v, "/foo/2") == NULL);
+    EXPECT_TRUE(lept_pointer_get(&v, "/foo/-") == NULL);
+    EXPECT_TRUE(lept_pointer_get(&v, "/foo/01") == NULL);
+    EXPECT_TRUE(lept_pointer_get(&v, "/foo/0/x") == NULL);
+    EXPECT_TRUE(lept_pointer_get(&v, "/1") == NULL);
+    EXPECT_TRUE(lept_pointer_get(&v, "foo") == NULL);
+    EXPECT_TRUE(lept_pointer_get(&v, "/m~2n") == NULL);
+    EXPECT_FALSE(lept_pointer_compile(&p[0], "/~", 2));
+
+    /* one pass over the text finds the same values */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_extract(json, sizeof(json) - 1, p, 12, values));
+    for(i = 0; i < 12; i++){
+        lept_value* expect = lept_pointer_get(&v, pointers[i]);
+        EXPECT_TRUE(values[i].json != NULL);
+        if(values[i].json != NULL){
+            EXPECT_EQ_INT(LEPT_PARSE_OK, lept_lazy_get_value(&values[i], &w));
+            EXPECT_TRUE(lept_is_equal(&w, expect));
+            lept_free(&w);
+        }
+    }
+    for(i = 0; i < 12; i++)
+        lept_pointer_free(&p[i]);
+
+    EXPECT_TRUE(lept_pointer_compile(&p[0], "/01/x/0/0", 9));
+    EXPECT_TRUE(lept_pointer_compile(&p[1], "/foo/1", 6));
+    EXPECT_TRUE(lept_pointer_compile(&p[2], "/foo/2", 6));
+    EXPECT_TRUE(lept_pointer_compile(&p[3], "/nothing", 8));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_extract(json, sizeof(json) - 1, p, 4, values));
+    EXPECT_EQ_DOUBLE(9.0, lept_lazy_get_number(&values[0]));
+    EXPECT_EQ_INT(LEPT_STRING, lept_lazy_get_type(&values[1]));
+    EXPECT_TRUE(values[2].json == NULL);
+    EXPECT_TRUE(values[3].json == NULL);
+
+    /* the scan stops once every pointer is found; an error before that is reported */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_extract("{\"foo\":[1,\"baz\"] garbage", 25, &p[1], 1, values));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_extract("{\"foo\":[1 \"baz\"]}", 17, &p[1], 1, values));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, lept_extract("{\"a\":1,\"foo\" [1,2]}", 19, &p[1], 1, values));
+    EXPECT_TRUE(values[0].json == NULL);
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_extract(" ", 1, &p[1], 1, values));
+    for(i = 0; i < 4; i++)
+        lept_pointer_free(&p[i]);
+    lept_free(&v);
+}
+
+static void test_parse_projected() {
+    static const char json[] = "{\"id\":7,\"user\":{\"name\":\"a\",\"email\":\"b\",\"tags\":[1,2]},"
+        "\"events\":[{\"type\":\"x\",\"ts\":1},{\"ts\":2,\"type\":\"y\",\"extra\":{\"type\":0}}],\"blob\":\"\\u00e9\"}";
+    static const char* paths[] = { "/id", "/user/name", "/events/type", "/user/tags" };
+    lept_pointer p[4];
+    lept_value v, w;
+    size_t i;
+
+    for(i = 0; i < 4; i++)
+        EXPECT_TRUE(lept_pointer_compile(&p[i], paths[i], strlen(paths[i])));
+    lept_init(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&w, "{\"id\":7,\"user\":{\"name\":\"a\",\"tags\":[1,2]},\"events\":[{\"type\":\"x\"},{\"type\":\"y\"}]}"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_projected(&v, json, sizeof(json) - 1, p, 4));
+    EXPECT_TRUE(lept_is_equal(&v, &w));
+    lept_free(&v);
+    lept_free(&w);
+
+    /* an object on no path is left empty, a path with no match builds nothing */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_projected(&v, json, sizeof(json) - 1, &p[1], 1));
+    EXPECT_EQ_SIZE_T(1, lept_get_object_size(&v));
+    EXPECT_EQ_SIZE_T(1, lept_get_object_size(lept_find_object_value(&v, "user", 4)));
+    lept_free(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_projected(&v, "[{\"a\":1},2,{}]", 14, &p[1], 1));
+    EXPECT_EQ_SIZE_T(3, lept_get_array_size(&v));
+    EXPECT_EQ_SIZE_T(0, lept_get_object_size(lept_get_array_element(&v, 0)));
+    lept_free(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_projected(&v, json, sizeof(json) - 1, p, 0));
+    EXPECT_EQ_SIZE_T(0, lept_get_object_size(&v));
+    lept_free(&v);
+    lept_pointer_free(&p[0]);
+    EXPECT_TRUE(lept_pointer_compile(&p[0], "", 0));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_projected(&v, json, sizeof(json) - 1, p, 2));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&w, json));
+    EXPECT_TRUE(lept_is_equal(&v, &w));
+    lept_free(&v);
+    lept_free(&w);
+
+    /* members left out are still checked */
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_parse_projected(&v, "{\"x\":[1 2],\"id\":1}", 19, &p[1], 1));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_STRING_ESCAPE, lept_parse_projected(&v, "{\"x\":\"\\q\"}", 10, &p[1], 1));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, lept_parse_projected(&v, "{\"user\":{\"x\" 1}}", 16, &p[1], 1));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, lept_parse_projected(&v, "{} x", 4, &p[1], 1));
+    for(i = 0; i < 4; i++)
+        lept_pointer_free(&p[i]);
+}
+
+#define TEST_MSGPACK(expect, json)\
+    do{\
+        lept_value v, w;\
+        char* m;\
+        size_t length;\
+        lept_init(&v);\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
+        m = lept_to_msgpack(&v, &length);\
+        EXPECT_EQ_SIZE_T(sizeof(expect) - 1, length);\
+        EXPECT_TRUE(memcmp(expect, m, length) == 0);\
+        EXPECT_EQ_SIZE_T(length, lept_msgpack_size(&v));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_from_msgpack(&w, m, length));\
+        EXPECT_TRUE(lept_is_equal(&v, &w));\
+        lept_free(&w);\
+        free(m);\
+        lept_free(&v);\
+    }while(0)
+
+#define TEST_MSGPACK_ERROR(error, data)\
+    do{\
+        lept_value v;\
+        EXPECT_EQ_INT(error, lept_from_msgpack(&v, data, sizeof(data) - 1));\
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));\
+    }while(0)
+
+/* nesting is bounded, so hostile input cannot run the decoder's recursion off the stack */
+static void test_msgpack_depth() {
+    size_t i, n = 2000000;
+    char* data = (char*)malloc(n + 1);
+    lept_value v;
+
+    memset(data, 0x91, n);      /* fixarray of one element, n deep */
+    data[n] = (char)0xc0;
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_from_msgpack(&v, data, n + 1));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    for (i = 0; i < n; i += 2)
+        data[i] = (char)0x81, data[i + 1] = (char)0xa0;     /* maps of one member with an empty key */
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_from_msgpack(&v, data, n + 1));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+
+    /* LEPT_MSGPACK_MAX_DEPTH containers are fine, one more is not */
+    memset(data, 0x91, LEPT_MSGPACK_MAX_DEPTH);
+    data[LEPT_MSGPACK_MAX_DEPTH] = (char)0xc0;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_from_msgpack(&v, data, LEPT_MSGPACK_MAX_DEPTH + 1));
+    EXPECT_EQ_INT(LEPT_ARRAY, lept_get_type(&v));
+    lept_free(&v);
+    memset(data, 0x91, LEPT_MSGPACK_MAX_DEPTH + 1);
+    data[LEPT_MSGPACK_MAX_DEPTH + 1] = (char)0xc0;
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_from_msgpack(&v, data, LEPT_MSGPACK_MAX_DEPTH + 2));
+    free(data);
+}
+
+static void test_msgpack() {
+    char buf[16];
+    lept_value v;
+
+    TEST_MSGPACK("\xc0", "null");
+    TEST_MSGPACK("\xc2", "false");
+    TEST_MSGPACK("\xc3", "true");
+    TEST_MSGPACK("\x00", "0");
+    TEST_MSGPACK("\x7f", "127");
+    TEST_MSGPACK("\xcc\x80", "128");
+    TEST_MSGPACK("\xcd\x01\x00", "256");
+    TEST_MSGPACK("\xce\x00\x01\x00\x00", "65536");
+    TEST_MSGPACK("\xcf\x00\x00\x00\x01\x00\x00\x00\x00", "4294967296");
+    TEST_MSGPACK("\xff", "-1");
+    TEST_MSGPACK("\xe0", "-32");
+    TEST_MSGPACK("\xd0\xdf", "-33");
+    TEST_MSGPACK("\xd1\xff\x7f", "-129");
+    TEST_MSGPACK("\xd2\xff\xff\x7f\xff", "-32769");
+    TEST_MSGPACK("\xd3\x80\x00\x00\x00\x00\x00\x00\x00", "-9223372036854775808");
+    TEST_MSGPACK("\xca\x3f\xc0\x00\x00", "1.5");
+    TEST_MSGPACK("\xca\x80\x00\x00\x00", "-0");
+    TEST_MSGPACK("\xcb\x3f\xb9\x99\x99\x99\x99\x99\x9a", "0.1");
+    TEST_MSGPACK("\xa0", "\"\"");
+    TEST_MSGPACK("\xa3" "a\0b", "\"a\\u0000b\"");
+    TEST_MSGPACK("\xd9\x20" "0123456789abcdef0123456789abcdef", "\"0123456789abcdef0123456789abcdef\"");
+    TEST_MSGPACK("\x90", "[]");
+    TEST_MSGPACK("\x92\x01\x91\xc0", "[1,[null]]");
+    TEST_MSGPACK("\xdc\x00\x10\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", "[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]");
+    TEST_MSGPACK("\x80", "{}");
+    TEST_MSGPACK("\x82\xa1" "a\x01\xa1" "b\x81\xa0\xc3", "{\"a\":1,\"b\":{\"\":true}}");
+
+    /* bin is read as a string, 16 and 32-bit lengths as well as fix ones */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_from_msgpack(&v, "\xc4\x02hi", 4));
+    EXPECT_EQ_STRING("hi", lept_get_string(&v), lept_get_string_length(&v));
+    lept_free(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_from_msgpack(&v, "\xdf\x00\x00\x00\x01\xda\x00\x01k\xdd\x00\x00\x00\x00", 14));
+    EXPECT_EQ_SIZE_T(0, lept_get_array_size(lept_find_object_value(&v, "k", 1)));
+    EXPECT_EQ_SIZE_T(4, lept_to_msgpack_into(&v, buf, sizeof(buf)));
+    EXPECT_TRUE(memcmp("\x81\xa1k\x90", buf, 4) == 0);
+    EXPECT_EQ_SIZE_T(0, lept_to_msgpack_into(&v, buf, 3));
+    lept_free(&v);
+
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\xc1");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\xd4\x01\x00");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\xcd\x01");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\xa3" "ab");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\x93\x01\x02");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\xdd\xff\xff\xff\xff\x01");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\x81\x01\x02");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\x82\xa1" "a\x01\xa1" "b");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\xca\x7f\xc0\x00\x00");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_INVALID_MSGPACK, "\xcb\x7f\xf0\x00\x00\x00\x00\x00\x00");
+    TEST_MSGPACK_ERROR(LEPT_PARSE_ROOT_NOT_SINGULAR, "\xc0\xc0");
+    test_msgpack_depth();
+}
+
 //array
 static void test_parse_array() {
     size_t i, j;
@@ -339,15 +1008,28 @@ static void test_parse_object() {
 //test generator
 #define TEST_ROUNDTRIP(json)\
     do {\
-        lept_value v;\
-        char* json2;\
+        lept_value v, w;\
+        char* json2, *buf;\
         size_t length;\
         lept_init(&v);\
+        lept_init(&w);\
         EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));\
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_iterative(&w, json, strlen(json), 0));\
+        EXPECT_TRUE(lept_is_equal_iterative(&v, &w));\
+        lept_free_iterative(&w);\
+        json2 = lept_stringify_iterative(&v, &length);\
+        EXPECT_EQ_STRING(json, json2, length);\
+        free(json2);\
         json2 = lept_stringify(&v, &length);\
         EXPECT_EQ_STRING(json, json2, length);\
+        EXPECT_EQ_SIZE_T(length, lept_stringify_size(&v));\
+        buf = (char*)malloc(length);    /* exact size, so a sanitizer sees any write past it */\
+        EXPECT_EQ_SIZE_T(length, lept_stringify_into(&v, buf, length));\
+        EXPECT_TRUE(memcmp(json, buf, length) == 0);\
+        EXPECT_EQ_SIZE_T(0, lept_stringify_into(&v, buf, length - 1));\
         lept_free(&v);\
         free(json2);\
+        free(buf);\
     } while(0)
 
 static void test_stringify_number() {
@@ -358,15 +1040,27 @@ static void test_stringify_number() {
     TEST_ROUNDTRIP("1.5");
     TEST_ROUNDTRIP("-1.5");
     TEST_ROUNDTRIP("3.25");
-    TEST_ROUNDTRIP("1e+020");
-    TEST_ROUNDTRIP("1.234e+020");
-    TEST_ROUNDTRIP("1.234e-020");
+    TEST_ROUNDTRIP("1e+20");
+    TEST_ROUNDTRIP("1.234e+20");
+    TEST_ROUNDTRIP("1.234e-20");
+
+    /* shortest form that parses back to the same double */
+    TEST_ROUNDTRIP("0.1");
+    TEST_ROUNDTRIP("0.3");
+    TEST_ROUNDTRIP("-0.0001");
+    TEST_ROUNDTRIP("1e-05");
+    TEST_ROUNDTRIP("123.456");
+    TEST_ROUNDTRIP("9007199254740992");
+    TEST_ROUNDTRIP("10000000000000000");
+    TEST_ROUNDTRIP("1e+17");
+    TEST_ROUNDTRIP("1.2345678901234567e+19");
 
     TEST_ROUNDTRIP("1.0000000000000002"); /* the smallest number > 1 */
-    TEST_ROUNDTRIP("4.9406564584124654e-324"); /* minimum denormal */
-    TEST_ROUNDTRIP("-4.9406564584124654e-324");
-    TEST_ROUNDTRIP("2.2250738585072009e-308");  /* Max subnormal double */
-    TEST_ROUNDTRIP("-2.2250738585072009e-308");
+    TEST_ROUNDTRIP("5e-324"); /* minimum denormal */
+    TEST_ROUNDTRIP("-5e-324");
+    TEST_ROUNDTRIP("1e-323");
+    TEST_ROUNDTRIP("2.225073858507201e-308");  /* Max subnormal double */
+    TEST_ROUNDTRIP("-2.225073858507201e-308");
     TEST_ROUNDTRIP("2.2250738585072014e-308");  /* Min normal positive double */
     TEST_ROUNDTRIP("-2.2250738585072014e-308");
     TEST_ROUNDTRIP("1.7976931348623157e+308");  /* Max double */
@@ -391,6 +1085,224 @@ static void test_stringify_object() {
     TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
 }
 
+/* collects the output, fails the write after fail_after chunks if that is nonzero */
+typedef struct {
+    char* buf;
+    size_t len, chunks, first, last;
+    size_t fail_after;
+    int uneven;
+}stringify_sink;
+
+static int stringify_sink_write(void* ud, const char* buf, size_t len) {
+    stringify_sink* s = (stringify_sink*)ud;
+    if (s->fail_after && s->chunks == s->fail_after)
+        return 0;
+    s->buf = (char*)realloc(s->buf, s->len + len);
+    memcpy(s->buf + s->len, buf, len);
+    s->len += len;
+    if (s->chunks++ == 0)
+        s->first = len;
+    else if (s->last != s->first)
+        s->uneven = 1;  /* only the final chunk may differ */
+    s->last = len;
+    return 1;
+}
+
+static void test_stringify_to() {
+    static const char path[] = "leptjson_test.json";
+    stringify_sink s = { NULL, 0, 0, 0, 0, 0, 0 };
+    lept_value v;
+    char *json, *big, item[32];
+    size_t length, i;
+    int fd = -1;
+    FILE* fp;
+
+    lept_init(&v);
+    lept_set_array(&v, 0);
+    for (i = 0; i < 20000; i++)
+        lept_set_string(lept_pushback_array_element(&v), item, sprintf(item, "item \"%lu\"\n", (unsigned long)i));
+    big = (char*)malloc(300000);
+    for (i = 0; i < 300000; i++)
+        big[i] = (char)(i % 97 == 0 ? '\x01' : 'a' + i % 26);
+    lept_set_string(lept_pushback_array_element(&v), big, 300000);
+    free(big);
+    json = lept_stringify(&v, &length);
+    EXPECT_EQ_SIZE_T(length, lept_stringify_size(&v));
+
+    EXPECT_EQ_INT(LEPT_STRINGIFY_OK, lept_stringify_to(&v, stringify_sink_write, &s));
+    EXPECT_EQ_SIZE_T(length, s.len);
+    EXPECT_TRUE(s.len == length && memcmp(json, s.buf, length) == 0);
+    EXPECT_TRUE(s.chunks > 2);
+    EXPECT_FALSE(s.uneven);
+    EXPECT_TRUE(s.last <= s.first);
+
+    /* nothing is written after a failed chunk */
+    free(s.buf);
+    s.buf = NULL;
+    s.len = s.chunks = s.first = s.last = 0;
+    s.fail_after = 2;
+    EXPECT_EQ_INT(LEPT_STRINGIFY_WRITE_ERROR, lept_stringify_to(&v, stringify_sink_write, &s));
+    EXPECT_EQ_SIZE_T(2, s.chunks);
+    free(s.buf);
+
+    fp = fopen(path, "wb");
+    EXPECT_TRUE(fp != NULL);
+    if (fp != NULL) {
+        EXPECT_EQ_INT(LEPT_STRINGIFY_OK, lept_stringify_to(&v, lept_write_file, fp));
+        fclose(fp);
+        lept_free(&v);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_file(&v, path));
+        free(json);
+        json = lept_stringify(&v, &length);
+        lept_free(&v);
+        lept_parse_n(&v, json, length);
+        remove(path);
+    }
+    EXPECT_EQ_INT(LEPT_STRINGIFY_WRITE_ERROR, lept_stringify_to(&v, lept_write_fd, &fd));
+    free(json);
+    lept_free(&v);
+}
+
+static void test_snapshot() {
+    static const char json[] = "{\"n\":null,\"f\":false,\"t\":true,\"i\":-123,\"s\":\"a\\u0000b\","
+        "\"a\":[1,[],{},[\"x\",[2]]],\"o\":{\"\":0,\"k\":{\"k\":\"deep\"}},\"k\":\"last\"}";
+    static const char path[] = "leptjson_test.snap";
+    stringify_sink s = { NULL, 0, 0, 0, 0, 0, 0 };
+    lept_compact d;
+    lept_value v, w;
+    const lept_compact_node *root, *a, *e;
+    char* image;
+    size_t i;
+    FILE* fp;
+
+    lept_init(&v);
+    lept_init(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+    EXPECT_EQ_INT(LEPT_STRINGIFY_OK, lept_snapshot_write(&v, stringify_sink_write, &s));
+    EXPECT_EQ_SIZE_T(lept_snapshot_size(&v), s.len);
+    /* a header, one node per value and per key, then each string and key NUL-terminated */
+    EXPECT_EQ_SIZE_T(32 + (1 + 16 + 4 + 2 + 1 + 4 + 2) * 16 + 8 * 2 + 4 + 2 + 1 + 2 + 2 + 5 + 5, s.len);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_snapshot_open(&d, s.buf, s.len));
+    EXPECT_TRUE(d.image == s.buf && d.mapped == 0);
+    EXPECT_TRUE(lept_snapshot_verify(&d));
+
+    root = lept_compact_root(&d);
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_compact_get_type(root));
+    EXPECT_EQ_SIZE_T(8, lept_compact_get_object_size(root));
+    EXPECT_EQ_STRING("n", lept_compact_get_string(&d, lept_compact_get_object_key(&d, root, 0)), 1);
+    EXPECT_EQ_INT(LEPT_NULL, lept_compact_get_type(lept_compact_get_object_value(&d, root, 0)));
+    EXPECT_TRUE(lept_compact_get_boolean(lept_compact_find_object_value(&d, root, "t", 1)));
+    EXPECT_EQ_DOUBLE(-123.0, lept_compact_get_number(lept_compact_find_object_value(&d, root, "i", 1)));
+    e = lept_compact_find_object_value(&d, root, "s", 1);
+    EXPECT_EQ_STRING("a\0b", lept_compact_get_string(&d, e), lept_compact_get_string_length(e));
+    a = lept_compact_find_object_value(&d, root, "a", 1);
+    EXPECT_EQ_SIZE_T(4, lept_compact_get_array_size(a));
+    e = lept_compact_get_array_element(&d, lept_compact_get_array_element(&d, a, 3), 1);
+    EXPECT_EQ_DOUBLE(2.0, lept_compact_get_number(lept_compact_get_array_element(&d, e, 0)));
+    e = lept_compact_find_object_value(&d, lept_compact_find_object_value(&d, root, "o", 1), "k", 1);
+    EXPECT_EQ_STRING("deep", lept_compact_get_string(&d, lept_compact_find_object_value(&d, e, "k", 1)), 4);
+    EXPECT_TRUE(lept_compact_find_object_value(&d, root, "x", 1) == NULL);
+    lept_compact_copy(&w, &d, root);
+    EXPECT_TRUE(lept_is_equal(&v, &w));
+    lept_free(&w);
+
+    /* the image is only offsets, a copy anywhere else reads the same */
+    image = (char*)malloc(s.len);
+    memcpy(image, s.buf, s.len);
+    memset(s.buf, 0, s.len);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_snapshot_open(&d, image, s.len));
+    lept_compact_copy(&w, &d, lept_compact_root(&d));
+    EXPECT_TRUE(lept_is_equal(&v, &w));
+    lept_free(&w);
+    lept_compact_free(&d);
+    EXPECT_TRUE(d.nodes == NULL && d.image == NULL);
+
+    /* only the header and the sizes are checked on open */
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_SNAPSHOT, lept_snapshot_open(&d, image, s.len - 1));
+    EXPECT_TRUE(d.nodes == NULL && d.size == 0);
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_SNAPSHOT, lept_snapshot_open(&d, image, 16));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_SNAPSHOT, lept_snapshot_open(&d, NULL, 0));
+    memcpy(s.buf, image, s.len);
+    memmove(s.buf + 4, s.buf, s.len - 4);
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_SNAPSHOT, lept_snapshot_open(&d, s.buf + 4, s.len - 4));
+    image[0] = 'L';
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_SNAPSHOT, lept_snapshot_open(&d, image, s.len));
+    image[0] = 'l';
+    image[12] ^= 1;     /* the byte order mark */
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_SNAPSHOT, lept_snapshot_open(&d, image, s.len));
+    image[12] ^= 1;
+
+    /* a node pointing back at its container only shows up in a walk */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_snapshot_open(&d, image, s.len));
+    d.nodes[0].word &= ~0xFFFFFFFFFFFFull;
+    EXPECT_FALSE(lept_snapshot_verify(&d));
+    d.nodes[0].word |= 1;
+    EXPECT_TRUE(lept_snapshot_verify(&d));
+    d.strings[d.strings_size - 1] = 'x';
+    EXPECT_FALSE(lept_snapshot_verify(&d));
+    lept_compact_free(&d);
+    free(image);
+    free(s.buf);
+
+    /* goes out in whole chunks, nothing is written after a failed one */
+    lept_set_array(&w, 0);
+    for (i = 0; i < 10000; i++)
+        lept_set_string(lept_pushback_array_element(&w), "0123456789", 10);
+    s.buf = NULL;
+    s.len = s.chunks = s.first = s.last = 0;
+    EXPECT_EQ_INT(LEPT_STRINGIFY_OK, lept_snapshot_write(&w, stringify_sink_write, &s));
+    EXPECT_EQ_SIZE_T(lept_snapshot_size(&w), s.len);
+    EXPECT_TRUE(s.chunks > 2);
+    EXPECT_FALSE(s.uneven);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_snapshot_open(&d, s.buf, s.len));
+    EXPECT_EQ_STRING("0123456789", lept_compact_get_string(&d, lept_compact_get_array_element(&d, lept_compact_root(&d), 9999)), 10);
+    lept_compact_free(&d);
+    free(s.buf);
+    s.buf = NULL;
+    s.len = s.chunks = s.first = s.last = 0;
+    s.fail_after = 1;
+    EXPECT_EQ_INT(LEPT_STRINGIFY_WRITE_ERROR, lept_snapshot_write(&w, stringify_sink_write, &s));
+    EXPECT_EQ_SIZE_T(1, s.chunks);
+    free(s.buf);
+    lept_free(&w);
+
+    fp = fopen(path, "wb");
+    EXPECT_TRUE(fp != NULL);
+    if (fp != NULL) {
+        EXPECT_EQ_INT(LEPT_STRINGIFY_OK, lept_snapshot_write(&v, lept_write_file, fp));
+        fclose(fp);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_snapshot_map(&d, path));
+        EXPECT_TRUE(d.mapped == lept_snapshot_size(&v));
+        EXPECT_TRUE(lept_snapshot_verify(&d));
+        lept_compact_copy(&w, &d, lept_compact_root(&d));
+        EXPECT_TRUE(lept_is_equal(&v, &w));
+        lept_free(&w);
+        lept_compact_free(&d);
+        EXPECT_TRUE(d.image == NULL && d.mapped == 0);
+
+        fp = fopen(path, "wb");
+        fclose(fp);
+        EXPECT_EQ_INT(LEPT_PARSE_INVALID_SNAPSHOT, lept_snapshot_map(&d, path));
+        remove(path);
+    }
+    EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, lept_snapshot_map(&d, path));
+    EXPECT_TRUE(d.nodes == NULL && d.size == 0);
+    lept_free(&v);
+
+    /* a lone value is a one-node image */
+    lept_set_string(&v, "", 0);
+    s.buf = NULL;
+    s.len = s.chunks = s.fail_after = 0;
+    EXPECT_EQ_INT(LEPT_STRINGIFY_OK, lept_snapshot_write(&v, stringify_sink_write, &s));
+    EXPECT_EQ_SIZE_T(32 + 16 + 1, s.len);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_snapshot_open(&d, s.buf, s.len));
+    EXPECT_EQ_SIZE_T(0, lept_compact_get_string_length(lept_compact_root(&d)));
+    EXPECT_TRUE(lept_snapshot_verify(&d));
+    lept_compact_free(&d);
+    free(s.buf);
+    lept_free(&v);
+}
+
 static void test_stringify() {
     TEST_ROUNDTRIP("null");
     TEST_ROUNDTRIP("false");
@@ -399,16 +1311,520 @@ static void test_stringify() {
     test_stringify_string();
     test_stringify_array();
     test_stringify_object();
+    test_stringify_to();
+}
+
+//document
+static void test_document() {
+    lept_document doc;
+    lept_value* root, *a, *e;
+    char* json;
+    size_t length, i;
+    static const char text[] = "{\"n\":null,\"s\":\"abc\",\"a\":[1,\"x\",[true]],\"o\":{\"k\":\"v\"}}";
+
+    lept_document_init(&doc);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_into_document(&doc, text));
+    root = lept_document_root(&doc);
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(root));
+    EXPECT_EQ_SIZE_T(4, lept_get_object_size(root));
+    EXPECT_EQ_STRING("s", lept_get_object_key(root, 1), lept_get_object_key_length(root, 1));
+    EXPECT_EQ_STRING("abc", lept_get_string(lept_get_object_value(root, 1)), lept_get_string_length(lept_get_object_value(root, 1)));
+    json = lept_stringify(root, &length);
+    EXPECT_EQ_STRING(text, json, length);
+    free(json);
+
+    /* setters work on arena values, new memory comes from the heap */
+    lept_set_string(lept_get_object_value(root, 1), "hello", 5);
+    EXPECT_EQ_STRING("hello", lept_get_string(lept_get_object_value(root, 1)), lept_get_string_length(lept_get_object_value(root, 1)));
+    a = lept_get_object_value(root, 2);
+    for (i = 0; i < 10; i++)
+        lept_set_number(lept_pushback_array_element(a), (double)i);
+    EXPECT_EQ_SIZE_T(13, lept_get_array_size(a));
+    EXPECT_EQ_STRING("x", lept_get_string(lept_get_array_element(a, 1)), lept_get_string_length(lept_get_array_element(a, 1)));
+    e = lept_get_array_element(a, 2);
+    EXPECT_EQ_INT(LEPT_TRUE, lept_get_type(lept_get_array_element(e, 0)));
+    lept_popback_array_element(a);
+    lept_shrink_array(a);
+    EXPECT_EQ_SIZE_T(12, lept_get_array_capacity(a));
+    lept_free(root);    /* releases what the setters took from the heap */
+
+    /* the document is reusable, and parse errors leave a null root */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_into_document(&doc, "[\"0123456789abcdef0123456789abcdef\"]"));
+    EXPECT_EQ_SIZE_T(1, lept_get_array_size(lept_document_root(&doc)));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, lept_parse_into_document(&doc, "{\"a\":[\"b\"]"));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(lept_document_root(&doc)));
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, lept_parse_into_document(&doc, "\"a\" x"));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(lept_document_root(&doc)));
+    lept_document_free(&doc);
+}
+
+static void test_parse_insitu() {
+    lept_value v;
+    lept_value* e;
+    char* json;
+    size_t length;
+    char buf[128];
+
+    strcpy(buf, "{\"k\\n\":\"a\\tb\\u20AC\\uD834\\uDD1E\",\"arr\":[\"x\", 1, \"\\\"\\\\\"], \"\":\"\"}");
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_insitu(&v, buf));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(&v));
+    EXPECT_EQ_SIZE_T(3, lept_get_object_size(&v));
+    /* keys and strings are decoded in place and point into buf */
+    EXPECT_EQ_STRING("k\n", lept_get_object_key(&v, 0), lept_get_object_key_length(&v, 0));
+    EXPECT_TRUE(lept_get_object_key(&v, 0) == buf + 2);
+    e = lept_get_object_value(&v, 0);
+    EXPECT_EQ_STRING("a\tb\xE2\x82\xAC\xF0\x9D\x84\x9E", lept_get_string(e), lept_get_string_length(e));
+    EXPECT_TRUE(lept_get_string(e) > buf && lept_get_string(e) < buf + sizeof(buf));
+    e = lept_get_object_value(&v, 1);
+    EXPECT_EQ_SIZE_T(3, lept_get_array_size(e));
+    EXPECT_EQ_STRING("x", lept_get_string(lept_get_array_element(e, 0)), 1);
+    EXPECT_EQ_STRING("\"\\", lept_get_string(lept_get_array_element(e, 2)), lept_get_string_length(lept_get_array_element(e, 2)));
+    EXPECT_EQ_STRING("", lept_get_object_key(&v, 2), lept_get_object_key_length(&v, 2));
+    json = lept_stringify(&v, &length);
+    EXPECT_EQ_STRING("{\"k\\n\":\"a\\tb\xE2\x82\xAC\xF0\x9D\x84\x9E\",\"arr\":[\"x\",1,\"\\\"\\\\\"],\"\":\"\"}", json, length);
+    free(json);
+    /* setters on in-situ values take heap memory as usual */
+    lept_set_string(lept_get_array_element(e, 0), "heap", 4);
+    lept_free(&v);
+
+    strcpy(buf, "\"abc\\u0000def\"");
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_insitu(&v, buf));
+    EXPECT_EQ_STRING("abc\0def", lept_get_string(&v), lept_get_string_length(&v));
+    lept_free(&v);
+
+    strcpy(buf, "[\"a\", {\"b\":\"\\x\"}]");
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_STRING_ESCAPE, lept_parse_insitu(&v, buf));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    strcpy(buf, "{\"a\":\"b");
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, lept_parse_insitu(&v, buf));
+    strcpy(buf, "\"\\uD800\\uDBFF\"");
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_UNICODE_SURROGATE, lept_parse_insitu(&v, buf));
+    strcpy(buf, "\"a\" \"b\"");
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, lept_parse_insitu(&v, buf));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+}
+
+/* exact-size heap copies, so reading one byte past len is caught by a memory checker */
+#define TEST_PARSE_N(error, json, len)\
+    do{\
+        lept_value v;\
+        char* buf = (char*)malloc((len) > 0 ? (len) : 1);\
+        memcpy(buf, json, len);\
+        lept_init(&v);\
+        EXPECT_EQ_INT(error, lept_parse_n(&v, buf, len));\
+        lept_free(&v);\
+        free(buf);\
+    }while(0)
+
+static void test_parse_n() {
+    static const char* const cases[] = {
+        "null", "true", "false", "0", "-12.5e+3", "1e", "-", "\"abc\"", "\"abc", "\"a\\", "\"\\u12",
+        "\"\\uD834\"", "\"\\uD834\\", "\"\\uD834\\u", "\"\\uD834\\uDD1E\"", "[1, [2, \"x\"]]", "[1,", "[",
+        "{\"a\":{\"b\":[]}}", "{\"a\"", "{\"a\":", "{", "   ", "nul", "tru",
+        "\"0123456789abcdef0123456789abcdef0123456789abcdef\"", "\"0123456789abcdef0123456789abcdef0123456789abcde",
+        "[\"x\"                                         ", "[\"x\"                                         ]"
+    };
+    size_t i;
+    lept_value v;
+    /* with the terminator left out the result is what lept_parse() gives */
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int expect;
+        lept_init(&v);
+        expect = lept_parse(&v, cases[i]);
+        lept_free(&v);
+        TEST_PARSE_N(expect, cases[i], strlen(cases[i]));
+    }
+    /* only len bytes are looked at */
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_n(&v, "123456", 3));
+    EXPECT_EQ_DOUBLE(123.0, lept_get_number(&v));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_n(&v, "truex", 4));
+    EXPECT_EQ_INT(LEPT_TRUE, lept_get_type(&v));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_n(&v, "\"ab\"\"cd\"", 4));
+    EXPECT_EQ_STRING("ab", lept_get_string(&v), lept_get_string_length(&v));
+    lept_free(&v);
+    TEST_PARSE_N(LEPT_PARSE_EXPECT_VALUE, "", 0);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_VALUE, "tr", 2);
+    TEST_PARSE_N(LEPT_PARSE_MISS_QUOTATION_MARK, "\"abc\"", 4);
+    /* NUL is just another byte: invalid inside strings, trailing garbage after the root */
+    TEST_PARSE_N(LEPT_PARSE_INVALID_STRING_CHAR, "\"a\0b\"", 5);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_STRING_CHAR, "[\"0123456789abcdef0123456789abcdef\0\"]", 38);
+    TEST_PARSE_N(LEPT_PARSE_ROOT_NOT_SINGULAR, "1\0", 2);
+    TEST_PARSE_N(LEPT_PARSE_INVALID_VALUE, "\0", 1);
+}
+
+static void test_parse_file() {
+    static const char text[] = "{\"a\":[1,2,\"\\u20AC\"],\"b\":null}";
+    static const char path[] = "leptjson_test.json";
+    lept_value v;
+    FILE* fp;
+    char* json;
+    size_t length;
+
+    fp = fopen(path, "wb");
+    EXPECT_TRUE(fp != NULL);
+    if (fp == NULL)
+        return;
+    fwrite(text, 1, sizeof(text) - 1, fp);
+    fclose(fp);
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_file(&v, path));
+    json = lept_stringify(&v, &length);
+    EXPECT_EQ_STRING("{\"a\":[1,2,\"\xE2\x82\xAC\"],\"b\":null}", json, length);
+    free(json);
+    lept_free(&v);
+
+    fp = fopen(path, "wb");
+    fclose(fp);
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, lept_parse_file(&v, path));
+    remove(path);
+    EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, lept_parse_file(&v, path));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+}
+
+/* records every event as text, stops after stop_after events if that is nonzero */
+typedef struct {
+    char log[256];
+    size_t len;
+    int events, stop_after;
+}sax_recorder;
+
+static int sax_log(void* ud, const char* prefix, const char* s, size_t len) {
+    sax_recorder* r = (sax_recorder*)ud;
+    size_t plen = strlen(prefix);
+    if (r->len + plen + len + 1 < sizeof(r->log)) {
+        memcpy(r->log + r->len, prefix, plen);
+        memcpy(r->log + r->len + plen, s, len);
+        r->len += plen + len;
+        r->log[r->len++] = ' ';
+        r->log[r->len] = '\0';
+    }
+    return ++r->events != r->stop_after;
+}
+
+static int sax_null(void* ud) { return sax_log(ud, "", "null", 4); }
+static int sax_boolean(void* ud, int b) { return b ? sax_log(ud, "", "true", 4) : sax_log(ud, "", "false", 5); }
+static int sax_number(void* ud, double n) { char buf[32]; return sax_log(ud, "", buf, sprintf(buf, "%g", n)); }
+static int sax_string(void* ud, const char* s, size_t len) { return sax_log(ud, "s:", s, len); }
+static int sax_start_array(void* ud) { return sax_log(ud, "", "[", 1); }
+static int sax_end_array(void* ud, size_t size) { char buf[32]; return sax_log(ud, "]", buf, sprintf(buf, "%d", (int)size)); }
+static int sax_start_object(void* ud) { return sax_log(ud, "", "{", 1); }
+static int sax_key(void* ud, const char* k, size_t klen) { return sax_log(ud, "k:", k, klen); }
+static int sax_end_object(void* ud, size_t size) { char buf[32]; return sax_log(ud, "}", buf, sprintf(buf, "%d", (int)size)); }
+
+static const lept_handler sax_recorder_handler = {
+    sax_null, sax_boolean, sax_number, sax_string,
+    sax_start_array, sax_end_array, sax_start_object, sax_key, sax_end_object
+};
+
+static int sax_sum(void* ud, double n) { *(double*)ud += n; return 1; }
+
+static void test_parse_sax() {
+    static const char* const errors[] = {
+        "", "nul", "?", "[1,]", "[1 2", "{\"a\" 1}", "{1:2}", "{\"a\":1", "\"abc", "\"\\v\"", "\"\\uD800\"", "1e309", "[] x"
+    };
+    sax_recorder r;
+    lept_handler h;
+    lept_value v;
+    double sum = 0.0;
+    size_t i;
+
+    memset(&r, 0, sizeof(r));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_sax(" {\"a\" : [1, true, null, []], \"b\\n\":\"x\\u0041\", \"c\":{}, \"d\":false} ", &sax_recorder_handler, &r));
+    EXPECT_EQ_STRING("{ k:a [ 1 true null [ ]0 ]4 k:b\n s:xA k:c { }0 k:d false }4 ", r.log, r.len);
+
+    /* a handler that returns 0 stops the parse right there */
+    memset(&r, 0, sizeof(r));
+    r.stop_after = 4;
+    EXPECT_EQ_INT(LEPT_PARSE_HANDLER_STOP, lept_parse_sax("[[1, \"x\"], 3]", &sax_recorder_handler, &r));
+    EXPECT_EQ_STRING("[ [ 1 s:x ", r.log, r.len);
+
+    /* missing callbacks skip their events */
+    memset(&h, 0, sizeof(h));
+    h.number = sax_sum;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_sax("{\"a\":[1.5,{\"b\":2}],\"c\":\"3\",\"d\":[4,null]}", &h, &sum));
+    EXPECT_EQ_DOUBLE(7.5, sum);
+
+    /* errors are the ones lept_parse() reports */
+    for (i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+        memset(&r, 0, sizeof(r));
+        lept_init(&v);
+        EXPECT_EQ_INT(lept_parse(&v, errors[i]), lept_parse_sax(errors[i], &sax_recorder_handler, &r));
+    }
+}
+
+/* feeds json in chunks of step bytes and checks the result against lept_parse() */
+static void test_push_chunks(const char* json, size_t step) {
+    lept_push_parser p;
+    lept_value expect, actual;
+    size_t i, n = strlen(json);
+    int ret;
+    char* s1, *s2;
+    size_t l1, l2;
+
+    lept_init(&expect);
+    ret = lept_parse(&expect, json);
+    lept_push_parser_init(&p);
+    for (i = 0; i < n; i += step)
+        lept_push_parser_feed(&p, json + i, n - i < step ? n - i : step);
+    EXPECT_EQ_INT(ret, lept_push_parser_finish(&p, &actual));
+    if (ret == LEPT_PARSE_OK) {
+        s1 = lept_stringify(&expect, &l1);
+        s2 = lept_stringify(&actual, &l2);
+        EXPECT_TRUE(l1 == l2 && memcmp(s1, s2, l1) == 0);
+        free(s1);
+        free(s2);
+    }
+    else
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&actual));
+    lept_free(&expect);
+    lept_free(&actual);
+    lept_push_parser_free(&p);
+}
+
+static void test_parse_push() {
+    static const char* const cases[] = {
+        "null", " true ", "-12.5e+3", "\"\"", "\"a\\n\\u20AC\\uD834\\uDD1E\\\"\"", "[]", "{}", "[ [ ], { } ]",
+        "{\"a\" : [1, true, null, [\"x\"]], \"b\\\"c\":{\"d\":-0.5e-7}, \"e\":\"0123456789abcdef0123456789abcdef\"}",
+        "", "  ", "nul", "truex", "0123", "1.", "-", "[1,]", "[1 2]", "[1", "[", "{", "{1:2}", "{\"a\"}", "{\"a\":1,}",
+        "{\"a\":1", "{\"a\":1]", "\"abc", "\"\\", "\"\\x\"", "\"\\u12\"", "\"\\uD800\"", "\"\\uD800\\uE000\"",
+        "\"\x01\"", "1e309", "[] x", "[1e309]", "{\"a\":\"\x01\"}"
+    };
+    lept_push_parser p;
+    lept_value v;
+    size_t i, step;
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        for (step = 1; step <= 8; step++)
+            test_push_chunks(cases[i], step);
+
+    /* errors stick, and finish() leaves the parser ready for the next document */
+    lept_push_parser_init(&p);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_push_parser_feed(&p, "[1, ", 4));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_push_parser_feed(&p, "2 3]", 4));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_push_parser_feed(&p, "]", 1));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_push_parser_finish(&p, &v));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_push_parser_feed(&p, "{\"k\":\"v", 7));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_push_parser_feed(&p, "\"}", 2));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_push_parser_finish(&p, &v));
+    EXPECT_EQ_STRING("k", lept_get_object_key(&v, 0), lept_get_object_key_length(&v, 0));
+    EXPECT_EQ_STRING("v", lept_get_string(lept_get_object_value(&v, 0)), lept_get_string_length(lept_get_object_value(&v, 0)));
+    lept_free(&v);
+    /* free() also releases a document left unfinished */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_push_parser_feed(&p, "[\"abc\", {\"k\": [\"de", 18));
+    lept_push_parser_free(&p);
+}
+
+#define NDJSON_LINES 100000
+
+typedef struct {
+    size_t calls, errors, stop_after, last_offset;
+    size_t* offsets;    /* by id, each written by one call only */
+    int in_order;
+    lept_value kept;
+}ndjson_recorder;
+
+static int ndjson_record(void* ud, size_t offset, int ret, lept_value* v) {
+    ndjson_recorder* r = (ndjson_recorder*)ud;
+    lept_value* id;
+    if (r->offsets == NULL) {   /* ordered: one call at a time, in input order */
+        if (r->calls > 0 && offset <= r->last_offset)
+            r->in_order = 0;
+        r->last_offset = offset;
+        if (ret != LEPT_PARSE_OK)
+            r->errors++;
+        if (++r->calls == 5)
+            lept_move(&r->kept, v);
+        return r->stop_after == 0 || r->calls < r->stop_after;
+    }
+    if (ret == LEPT_PARSE_OK && (id = lept_find_object_value(v, "id", 2)) != NULL)
+        r->offsets[(size_t)lept_get_number(id)] = offset + 1;
+    return 1;
+}
+
+static void test_parse_ndjson() {
+    size_t i, len = 0, missing = 0;
+    char* json = (char*)malloc(NDJSON_LINES * 48);
+    ndjson_recorder r;
+    int nthreads;
+
+    for (i = 0; i < NDJSON_LINES; i++) {
+        len += sprintf(json + len, "{\"id\":%lu,\"tag\":\"line\"}%s", (unsigned long)i, i % 3 ? "\n" : "\r\n");
+        if (i % 1000 == 0)
+            json[len++] = '\n';     /* blank lines are skipped */
+    }
+    memcpy(json + len, "{\"id\":", 6);  /* an unfinished last line, with no line end */
+    len += 6;
+
+    for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+        memset(&r, 0, sizeof(r));
+        lept_init(&r.kept);
+        r.in_order = 1;
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ndjson(json, len, nthreads, LEPT_NDJSON_ORDERED, ndjson_record, &r));
+        EXPECT_EQ_SIZE_T(NDJSON_LINES + 1, r.calls);
+        EXPECT_EQ_SIZE_T(1, r.errors);
+        EXPECT_TRUE(r.in_order);
+        EXPECT_EQ_DOUBLE(4.0, lept_get_number(lept_find_object_value(&r.kept, "id", 2)));
+        lept_free(&r.kept);
+
+        r.calls = 0;
+        r.stop_after = 10;
+        EXPECT_EQ_INT(LEPT_PARSE_HANDLER_STOP, lept_parse_ndjson(json, len, nthreads, LEPT_NDJSON_ORDERED, ndjson_record, &r));
+        EXPECT_EQ_SIZE_T(10, r.calls);
+        lept_free(&r.kept);
+
+        memset(&r, 0, sizeof(r));
+        r.offsets = (size_t*)calloc(NDJSON_LINES, sizeof(size_t));
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ndjson(json, len, nthreads, 0, ndjson_record, &r));
+        for (i = 0, missing = 0; i < NDJSON_LINES; i++)
+            missing += r.offsets[i] == 0 || memcmp(json + r.offsets[i] - 1, "{\"id\":", 6) != 0;
+        EXPECT_EQ_SIZE_T(0, missing);
+        free(r.offsets);
+    }
+    memset(&r, 0, sizeof(r));
+    r.in_order = 1;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ndjson("", 0, 0, LEPT_NDJSON_ORDERED, ndjson_record, &r));
+    EXPECT_EQ_SIZE_T(0, r.calls);
+
+    /* lines of only spaces and tabs are blank too, surrounding whitespace on a value is fine */
+    memset(&r, 0, sizeof(r));
+    r.in_order = 1;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ndjson("1\n  \t\n\r\n \r\n\t 2 \r\n \t", 19, 1, LEPT_NDJSON_ORDERED, ndjson_record, &r));
+    EXPECT_EQ_SIZE_T(2, r.calls);
+    EXPECT_EQ_SIZE_T(0, r.errors);
+    free(json);
+}
+
+#define TEST_PARSE_PARALLEL(json, len)\
+    do{\
+        lept_value v, w;\
+        int expect;\
+        lept_init(&v);\
+        lept_init(&w);\
+        expect = lept_parse_n(&w, json, len);\
+        EXPECT_EQ_INT(expect, lept_parse_parallel(&v, json, len, 4));\
+        EXPECT_TRUE(lept_is_equal(&v, &w));\
+        lept_free(&v);\
+        lept_free(&w);\
+    }while(0)
+
+static void test_parse_parallel() {
+    size_t i, len = 0, size = 40000;
+    char* json = (char*)malloc(size * 64 + 16);
+    lept_value v, w;
+    int nthreads;
+
+    /* more than LEPT_PARALLEL_MIN_SIZE, with brackets, commas and escaped quotes inside strings */
+    json[len++] = '[';
+    for (i = 0; i < size; i++)
+        len += sprintf(json + len, "%s{\"id\":%lu,\"s\":\"[,\\\"]\\\\\",\"a\":[%lu,{}]}", i ? (i % 7 ? "," : " ,\n ") : "",
+            (unsigned long)i, (unsigned long)i % 10);
+    json[len++] = ']';
+    json[len] = '\0';
+
+    lept_init(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_n(&w, json, len));
+    for (nthreads = 1; nthreads <= 8; nthreads *= 2) {
+        lept_init(&v);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_parallel(&v, json, len, nthreads));
+        EXPECT_EQ_SIZE_T(size, lept_get_array_size(&v));
+        EXPECT_EQ_SIZE_T(size, lept_get_array_capacity(&v));
+        EXPECT_TRUE(lept_is_equal(&v, &w));
+        lept_free(&v);
+    }
+    lept_free(&w);
+
+    /* every error is the one lept_parse_n() reports */
+    json[len - 30] = ' ';                           /* a missing comma near the end */
+    TEST_PARSE_PARALLEL(json, len);
+    json[len - 30] = ',';
+    json[len - 1] = '}';                            /* the wrong closing bracket */
+    TEST_PARSE_PARALLEL(json, len);
+    json[len - 1] = ']';
+    TEST_PARSE_PARALLEL(json, len + 1);             /* the terminator is not whitespace */
+    json[len / 2] = '\x01';                         /* a control character, maybe in a string */
+    TEST_PARSE_PARALLEL(json, len);
+    json[0] = '{';                                  /* not an array */
+    TEST_PARSE_PARALLEL(json, len);
+    TEST_PARSE_PARALLEL("[ ]", 3);
+    TEST_PARSE_PARALLEL("[1,2", 4);
+    free(json);
+}
+
+static void test_iterative() {
+    static const char json[] = "{\"a\":[1,{\"b\":\"long enough to live on the heap\"},[]],\"c\":{},\"d\":[[null]]}";
+    size_t depth = 100000, i, length;
+    lept_push_parser p;
+    lept_value v, w;
+    char* deep, *out;
+
+    /* deeper than a small thread stack could recurse */
+    deep = (char*)malloc(depth * 2 + 1);
+    for (i = 0; i < depth; i++) {
+        deep[i] = '[';
+        deep[depth * 2 - 1 - i] = ']';
+    }
+    deep[depth * 2] = '\0';
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_iterative(&v, deep, depth * 2, 0));
+    out = lept_stringify_iterative(&v, &length);
+    EXPECT_EQ_SIZE_T(depth * 2, length);
+    EXPECT_TRUE(length == depth * 2 && memcmp(deep, out, length) == 0);
+    free(out);
+    lept_init(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_iterative(&w, deep, depth * 2, depth));
+    EXPECT_TRUE(lept_is_equal_iterative(&v, &w));
+    lept_free_iterative(&w);
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&w));
+    lept_set_number(&w, 1.0);
+    EXPECT_FALSE(lept_is_equal_iterative(&v, &w));
+    lept_free_iterative(&v);
+
+    /* the limit fails fast and frees what was built */
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_parse_iterative(&v, deep, depth * 2, depth - 1));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_parse_iterative(&v, "[1,{\"a\":[{}]}]", 14, 3));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_iterative(&v, "[1,{\"a\":[{}]}]", 14, 4));
+    lept_free(&v);
+
+    lept_push_parser_init(&p);
+    p.max_depth = 2;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_push_parser_feed(&p, "[[1], {\"k\": ", 12));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_push_parser_feed(&p, "[]}]", 4));
+    EXPECT_EQ_INT(LEPT_PARSE_DEPTH_EXCEEDED, lept_push_parser_finish(&p, &v));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_push_parser_feed(&p, "[[1], {\"k\": 2}]", 15));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_push_parser_finish(&p, &v));
+    lept_free(&v);
+    lept_push_parser_free(&p);
+    free(deep);
+
+    /* object members are matched by key, as lept_is_equal() does */
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_iterative(&v, json, sizeof(json) - 1, 0));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&w, "{\"d\":[[null]],\"c\":{},\"a\":[1,{\"b\":\"long enough to live on the heap\"},[]]}"));
+    EXPECT_TRUE(lept_is_equal_iterative(&v, &w));
+    lept_set_null(lept_get_array_element(lept_find_object_value(&w, "d", 1), 0));
+    EXPECT_FALSE(lept_is_equal_iterative(&v, &w));
+    lept_remove_object_value(&w, lept_find_object_index(&w, "d", 1));
+    lept_set_number(lept_set_object_value(&w, "e", 1), 0.0);
+    EXPECT_FALSE(lept_is_equal_iterative(&v, &w));
+    lept_free_iterative(&v);
+    lept_free_iterative(&w);
 }
 
 static void test_all(){
     test_parse();
+    test_parse_whitespace();
     test_parse_number();
+    test_parse_number_exact();
+    test_parse_number_too_big();
     test_parse_invalid_value();
 
     test_access_string();
+    test_access_short_string();
     test_access_boolean();
     test_access_number();
+    test_access_object();
+    test_object_index();
 
     test_parse_string();
     test_parse_invalid_string_char();
@@ -429,6 +1845,23 @@ static void test_all(){
 #endif
 
     test_stringify();
+
+    test_document();
+    test_parse_insitu();
+    test_parse_interned();
+    test_parse_compact();
+    test_parse_lazy();
+    test_pointer();
+    test_parse_projected();
+    test_msgpack();
+    test_snapshot();
+    test_parse_n();
+    test_parse_file();
+    test_parse_sax();
+    test_parse_push();
+    test_parse_ndjson();
+    test_parse_parallel();
+    test_iterative();
 }
 
 int main(){